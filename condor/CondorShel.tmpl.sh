@@ -9,26 +9,19 @@ cd CMSSWBASE/src/
 source /cvmfs/cms.cern.ch/cmsset_default.sh
 eval `scramv1 runtime -sh`
 
-# Get resources and scripts
+# Get the compiled executable (make run)
 echo ""
 echo ""
 echo " --- COPYING FILES ---"
-files=(src src/interface) 
-for dir in ${files[*]} ; do
-    mkdir -p $_CONDOR_SCRATCH_DIR/$dir
-for file in $(xrdfs root://cmseos.fnal.gov ls -u /store/user/ecoleman/HausdorffIsingModel/$dir/) ; do
-    xrdcp $file ${_CONDOR_SCRATCH_DIR}/$dir/
-done
-done
-
-
 cd ${_CONDOR_SCRATCH_DIR}
+xrdcp INDIR/runIsingModel ${_CONDOR_SCRATCH_DIR}/
+chmod +x runIsingModel
 
 # Run model, plot
 echo ""
 echo ""
 echo " --- RUNNING EXE ---"
-root -l -b -q "EXEC(PARAM_DIM, PARAM_DEPTH, PARAM_T, PARAM_SIG, PARAM_H, PARAM_J, PARAM_MCSTEPS, 40)"
+EXEC PARAM_DIM PARAM_DEPTH PARAM_T PARAM_SIG PARAM_H PARAM_J PARAM_MCSTEPS 40 --out NAME.res
 
 # Copy results to output directory
 echo ""
@@ -36,7 +29,7 @@ echo ""
 echo " --- MOVING FILES ---"
 ls -u $_CONDOR_SCRATCH_DIR
 for file in $(ls -u $_CONDOR_SCRATCH_DIR/) ; do 
-    if [[ "condor" =~ "$file" ]] ; then 
+    if [[ "condor" =~ "$file" ]] || [[ "$file" == "runIsingModel" ]] ; then 
         continue
     fi
     echo "\nMoving $file"
@@ -49,5 +42,6 @@ rm -rf interface
 rm -rf output 
 rm -rf scripts 
 rm -rf src 
+rm -f runIsingModel 
 rm *.{png,jpg,gif,root} 
 rm */*.{png,jpg,gif,root} 
@@ -0,0 +1,30 @@
+#!/bin/sh -f
+
+# Local counterpart of CondorShel.tmpl.sh, run by scripts/RunLocal.py,
+# which provides a fresh $_CONDOR_SCRATCH_DIR for every attempt
+
+# Get the compiled executable (make run)
+echo ""
+echo ""
+echo " --- COPYING FILES ---"
+cd ${_CONDOR_SCRATCH_DIR}
+cp INDIR/runIsingModel ${_CONDOR_SCRATCH_DIR}/ || exit 1
+
+# Run model, plot
+echo ""
+echo ""
+echo " --- RUNNING EXE ---"
+EXEC PARAM_DIM PARAM_DEPTH PARAM_T PARAM_SIG PARAM_H PARAM_J PARAM_MCSTEPS 1 --out NAME.res || exit 1
+
+# Copy results to output directory
+echo ""
+echo ""
+echo " --- MOVING FILES ---"
+mkdir -p OUTDIR
+for file in $(ls -u $_CONDOR_SCRATCH_DIR/) ; do 
+    if [ "$file" = "runIsingModel" ] ; then 
+        continue
+    fi
+    echo "Moving $file"
+    cp $file OUTDIR/ || exit 1
+done
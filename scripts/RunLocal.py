@@ -0,0 +1,139 @@
+import os,sys
+from optparse import OptionParser
+import glob
+import multiprocessing
+import shutil
+import subprocess
+import tempfile
+import time
+
+# Runs the jobs written by SubmitCondor.py --local on this machine: every
+# <name>.condor in the job directory names a shell script and its stdout,
+# stderr and log files, as it would for condor_submit.
+
+parser = OptionParser(description='Run SubmitCondor.py jobs on a local process pool.')
+parser.add_option('--jobdir',     action='store', dest='jobdir',   default=os.environ['PWD']+"/output/stdout/",
+        help='Directory with the .condor job descriptions')
+parser.add_option('--cores',      action='store', dest='cores',    default=multiprocessing.cpu_count(), type='int',
+        help='Maximum number of jobs running at once')
+parser.add_option('--memPerJob',  action='store', dest='memPerJob', default=500, type='int',
+        help='Memory needed by one job (MB); no job starts unless this much is available')
+parser.add_option('--maxMem',     action='store', dest='maxMem',   default=0, type='int',
+        help='Memory for all running jobs together (MB, 0: no limit)')
+parser.add_option('--retries',    action='store', dest='retries',  default=2, type='int',
+        help='Number of times a failed job is run again')
+parser.add_option('--scratch',    action='store', dest='scratch',  default=tempfile.gettempdir(),
+        help='Where the per-job scratch directories are made')
+parser.add_option('--interval',   action='store', dest='interval', default=10, type='float',
+        help='Seconds between progress summaries')
+parser.add_option('--rerun',      action='store_true', dest='rerun', default=False,
+        help='Also run jobs whose log shows they already finished')
+
+(options, args) = parser.parse_args()
+
+def log(job, text):
+    f = open(job['Log'], 'a')
+    f.write("%s (%s) %s\n" % (time.strftime('%m/%d %H:%M:%S'), job['name'], text))
+    f.close()
+
+def finished(job):
+    if not os.path.exists(job['Log']): return False
+    return 'Job terminated. (return value 0)' in open(job['Log']).read()
+
+def availableMB():
+    for line in open('/proc/meminfo'):
+        if line.startswith('MemAvailable:'): return int(line.split()[1])/1024
+    return sys.maxsize
+
+# read the job descriptions
+jobs = []
+for conf in sorted(glob.glob(os.path.join(options.jobdir, '*.condor'))):
+    job = {'name': os.path.basename(conf)[:-len('.condor')], 'attempts': 0}
+    for line in open(conf):
+        if '=' not in line: continue
+        key, value = [x.strip() for x in line.split('=', 1)]
+        if key in ['Executable', 'Output', 'Error', 'Log']: job[key] = value
+    if 'Executable' not in job:
+        print("WARNING: no Executable in %s, skipping" % conf)
+        continue
+    for key in ['Output', 'Error', 'Log']:
+        job.setdefault(key, os.path.join(options.jobdir, job['name']+'.'+key.lower()))
+    jobs.append(job)
+
+queue   = [job for job in jobs if options.rerun or not finished(job)]
+nSkip   = len(jobs) - len(queue)
+nTotal  = len(queue)
+running = []
+done    = []
+failed  = []
+print("%i jobs, %i already finished, running %i on up to %i cores" % (len(jobs), nSkip, nTotal, options.cores))
+
+def start(job):
+    job['attempts'] += 1
+    job['scratch'] = tempfile.mkdtemp(prefix=job['name']+'.', dir=options.scratch)
+    env = dict(os.environ)
+    env['_CONDOR_SCRATCH_DIR'] = job['scratch']
+    log(job, 'Job executing (attempt %i)' % job['attempts'])
+    job['stdout'] = open(job['Output'], 'w')
+    job['stderr'] = open(job['Error'], 'w')
+    job['proc'] = subprocess.Popen(['sh', job['Executable']], cwd=job['scratch'], env=env,
+                                   stdout=job['stdout'], stderr=job['stderr'])
+    running.append(job)
+
+def canStart():
+    if not queue or len(running) >= options.cores: return False
+    if not running: return True
+    if options.maxMem > 0 and (len(running)+1)*options.memPerJob > options.maxMem: return False
+    return availableMB() >= options.memPerJob
+
+def summary(final=False):
+    elapsed = time.time() - startTime
+    line = "[%s] done %i/%i, failed %i, running %i, queued %i" % (
+        time.strftime('%H:%M:%S'), len(done), nTotal, len(failed), len(running), len(queue))
+    finishedJobs = len(done) + len(failed)
+    if finishedJobs > 0 and not final:
+        line += ", ETA %i s" % (elapsed/finishedJobs*(nTotal-finishedJobs))
+    print(line)
+    sys.stdout.flush()
+
+startTime  = time.time()
+lastReport = startTime
+try:
+    while queue or running:
+        while canStart(): start(queue.pop(0))
+
+        for job in list(running):
+            code = job['proc'].poll()
+            if code is None: continue
+            running.remove(job)
+            job['stdout'].close()
+            job['stderr'].close()
+            shutil.rmtree(job['scratch'], ignore_errors=True)
+            log(job, 'Job terminated. (return value %i)' % code)
+            if code == 0:
+                done.append(job)
+            elif job['attempts'] <= options.retries:
+                print("WARNING: %s failed (return value %i), retrying" % (job['name'], code))
+                queue.append(job)
+            else:
+                print("ERROR: %s failed %i times, see %s" % (job['name'], job['attempts'], job['Error']))
+                failed.append(job)
+
+        if time.time() - lastReport > options.interval:
+            summary()
+            lastReport = time.time()
+        time.sleep(0.2)
+except KeyboardInterrupt:
+    print("Interrupted, stopping %i running jobs" % len(running))
+    for job in running:
+        job['proc'].terminate()
+        job['proc'].wait()
+        shutil.rmtree(job['scratch'], ignore_errors=True)
+        log(job, 'Job was aborted')
+    sys.exit(1)
+
+summary(True)
+if failed:
+    print("Failed jobs:")
+    for job in failed: print("  " + job['name'])
+    sys.exit(1)
@@ -20,17 +20,33 @@ parser.add_option('--sigList',     action='store', dest='sig',      default='',
 parser.add_option('--mcStepsList', action='store', dest='mcsteps',  default='',  help='List of config # MC steps')
 parser.add_option('--dimList',     action='store', dest='dim',      default='',  help='List of config dimensions')
 parser.add_option('--depthList',   action='store', dest='depth',    default='',  help='List of config depths')
-parser.add_option('--exe',         action='store', dest='ex',       default="src/runIsingModel.cpp",
-        help='Location of ROOT macro')
+parser.add_option('--exe',         action='store', dest='ex',       default="./runIsingModel",
+        help='Command run in the job (the executable built by make run)')
 parser.add_option('--ineos',      action='store', dest='ineos',
         default="root://cmseos.fnal.gov:///store/user/ecoleman/HausdorffIsingModel/",
         help='Location of output eos directory')
 parser.add_option('--outeos',      action='store', dest='outeos',
         default="root://cmseos.fnal.gov:///store/user/ecoleman/HausdorffIsingModel/output/",
         help='Location of output eos directory')
+parser.add_option('--local',       action='store_true', dest='local', default=False,
+        help='Write jobs for scripts/RunLocal.py (executable from --indir, output to --outdir) instead of submitting')
+parser.add_option('--costModel',   action='store', dest='costModel', default='8e-9,1.7e-7',
+        help='Seconds per bond visit and per spin update (runSweep --calibrate)')
+parser.add_option('--bundleCost',  action='store', dest='bundleCost', default=0, type='float',
+        help='Pack cheap points into jobs of about this many estimated seconds (0: one point per job)')
 
 (options, args) = parser.parse_args()
-cmssw_base = os.environ['CMSSW_BASE']
+cmssw_base = os.environ.get('CMSSW_BASE', '')
+
+# local jobs read and write plain directories
+shel_name = './condor/CondorShel.tmpl.sh'
+if options.local :
+    shel_name      = './condor/LocalShel.tmpl.sh'
+    options.ineos  = os.path.abspath(options.indir)
+    options.outeos = os.path.abspath(options.outdir)
+elif cmssw_base == "" :
+    print "ERROR: CMSSW_BASE is not set. Exiting..."
+    quit()
 
 # check that input directory is specified
 if options.indir == "":
@@ -62,7 +78,18 @@ iterList=  [(a,b,c,d,e,f,g)
         for f in options.dim.split(',')
         for g in options.depth.split(',')]
 
-# prepare all configs
+# estimated run time of one point, as SweepEngine::estimateCost (in core):
+# steps*(perBond*N*N*z + perSpin*N) with N=(2*2^depth)^ceil(dim) sites and
+# z=2*ceil(dim)*(L-1)/L neighbours
+costPerBond,costPerSpin = [float(c) for c in options.costModel.split(',')]
+def estimateCost(dim, depth, mcsteps):
+    L = 2*2**int(depth)
+    N = float(L)**ceil(float(dim))
+    z = 2*ceil(float(dim))*(L-1)/L
+    return int(mcsteps)*(costPerBond*N*N*z + costPerSpin*N)
+
+# collect the points in this job range
+points=[]
 nJob=0
 for h,j,t,sig,mcsteps,dim,depth in iterList :
     if h == "" or j == "" or t=="" or sig=="" or mcsteps=="" or dim=="" or depth=="" :
@@ -73,73 +100,65 @@ for h,j,t,sig,mcsteps,dim,depth in iterList :
         continue
     print nJob
 
-    current_name = options.ex.split('/')[1]+"_dim"+dim+"_h"+h+"_j"+j+"_t"+t+"_s"+sig+"_m"+mcsteps+"_dep"+depth
-    current_name = current_name.replace('.','p')
-    current_conf = open(options.outdir+"/stdout/"+current_name + '.condor','w')
-    current_shel = open(options.outdir+"/stdout/"+current_name + '.sh','w')
+    name = options.ex.split('/')[1]+"_dim"+dim+"_h"+h+"_j"+j+"_t"+t+"_s"+sig+"_m"+mcsteps+"_dep"+depth
+    name = name.replace('.','p')
+    points.append({'name':name, 'cost':estimateCost(dim,depth,mcsteps),
+                   'PARAM_H':h, 'PARAM_J':j, 'PARAM_T':t, 'PARAM_SIG':sig,
+                   'PARAM_MCSTEPS':mcsteps, 'PARAM_DIM':dim, 'PARAM_DEPTH':depth})
+    nJob+=1
 
-    # write condor config
-    conf_tmpl = open('./condor/CondorConf.tmpl.condor')
-    for line in conf_tmpl:
-        if 'CMSSWBASE'     in line: line = line.replace('CMSSWBASE',     cmssw_base)
-        if 'OUTDIR'        in line: line = line.replace('OUTDIR',        options.outeos)
-        if 'OUTPUT_PATH'   in line: line = line.replace('OUTPUT_PATH',   "%s/stdout/"%options.outdir)
-        if 'INDIR'         in line: line = line.replace('INDIR',         "%s/"%options.ineos)
-        if 'PARAM_H'       in line: line = line.replace('EXEC',          options.ex)
-        if 'PARAM_H'       in line: line = line.replace('PARAM_H',       h          )
-        if 'PARAM_J'       in line: line = line.replace('PARAM_J',       j          )
-        if 'PARAM_T'       in line: line = line.replace('PARAM_T',       t          )
-        if 'PARAM_SIG'     in line: line = line.replace('PARAM_SIG',     sig        )
-        if 'PARAM_MCSTEPS' in line: line = line.replace('PARAM_MCSTEPS', mcsteps    )
-        if 'PARAM_DIM'     in line: line = line.replace('PARAM_DIM',     dim        )
-        if 'PARAM_DEPTH'   in line: line = line.replace('PARAM_DEPTH',   depth      )
-        if 'NAME'          in line: line = line.replace('NAME',
-                current_name)
-
-        current_conf.write(line)
-
-    conf_tmpl.close()
-
-    # write shell script
-    shel_tmpl = open('./condor/CondorShel.tmpl.sh')
-    for line in shel_tmpl:
+# jobs, most expensive first so the long ones do not start last. With
+# --bundleCost, points cheaper than the target share a job (first fit
+# decreasing); a job runs its points one after the other
+points.sort(key=lambda p: -p['cost'])
+jobs=[]
+for point in points :
+    for job in jobs :
+        if options.bundleCost > 0 and job['cost']+point['cost'] <= options.bundleCost :
+            job['points'].append(point)
+            job['cost']+=point['cost']
+            break
+    else :
+        jobs.append({'points':[point], 'cost':point['cost']})
+for job in jobs :
+    job['name'] = job['points'][0]['name']
+    if len(job['points']) > 1 : job['name'] += "_x%i"%len(job['points'])
+jobs.sort(key=lambda job: -job['cost'])
+print "%i points in %i jobs, estimated %.0f s in total, longest job %.0f s" % (
+    len(points), len(jobs), sum([p['cost'] for p in points]), jobs[0]['cost'] if jobs else 0)
+
+# fill a template; the line running EXEC is repeated for every point
+def writeTemplate(tmpl_name, out_name, job):
+    tmpl = open(tmpl_name)
+    out  = open(out_name,'w')
+    for line in tmpl:
         if 'CMSSWBASE'     in line: line = line.replace('CMSSWBASE',     cmssw_base)
         if 'OUTDIR'        in line: line = line.replace('OUTDIR',        options.outeos)
         if 'OUTPUT_PATH'   in line: line = line.replace('OUTPUT_PATH',   "%s/stdout/"%options.outdir)
         if 'INDIR'         in line: line = line.replace('INDIR',         "%s/"%options.ineos)
-        if 'PARAM_H'       in line: line = line.replace('EXEC',          options.ex)
-        if 'PARAM_H'       in line: line = line.replace('PARAM_H',       h          )
-        if 'PARAM_J'       in line: line = line.replace('PARAM_J',       j          )
-        if 'PARAM_T'       in line: line = line.replace('PARAM_T',       t          )
-        if 'PARAM_SIG'     in line: line = line.replace('PARAM_SIG',     sig        )
-        if 'PARAM_MCSTEPS' in line: line = line.replace('PARAM_MCSTEPS', mcsteps    )
-        if 'PARAM_DIM'     in line: line = line.replace('PARAM_DIM',     dim        )
-        if 'PARAM_DEPTH'   in line: line = line.replace('PARAM_DEPTH',   depth      )
-        if 'NAME'          in line: line = line.replace('NAME',         current_name)
-
-        current_shel.write(line)
-
-    shel_tmpl.close()
-
-    current_conf.close()
-    current_shel.close()
-    nJob+=1
+        if 'NAME'          in line: line = line.replace('NAME',          job['name'])
+        if 'PARAM_H' not in line :
+            out.write(line)
+            continue
+        for point in job['points'] :
+            point_line = line.replace('EXEC', options.ex)
+            for param in ['PARAM_H','PARAM_J','PARAM_T','PARAM_SIG','PARAM_MCSTEPS','PARAM_DIM','PARAM_DEPTH'] :
+                point_line = point_line.replace(param, point[param])
+            out.write(point_line)
+    tmpl.close()
+    out.close()
 
-# end loop so that Python writes files
-# run jobs
-nJob=0
-for h,j,t,sig,mcsteps,dim,depth in iterList :
-    if h == "" or j == "" or t=="" or sig=="" or mcsteps=="" or dim=="" or depth=="" :
-        continue
-    if nJob>float(options.maxJob) : break
-    if nJob<float(options.minJob) :
-        nJob+=1
-        continue
+# prepare all configs
+for job in jobs :
+    writeTemplate('./condor/CondorConf.tmpl.condor', options.outdir+"/stdout/"+job['name']+'.condor', job)
+    writeTemplate(shel_name,                         options.outdir+"/stdout/"+job['name']+'.sh',     job)
 
-    current_name = options.ex.split('/')[1]+"_dim"+dim+"_h"+h+"_j"+j+"_t"+t+"_s"+sig+"_m"+mcsteps+"_dep"+depth
-    current_name = current_name.replace('.','p')
-    current_conf = current_name + '.condor'
+# end loop so that Python writes files
+if options.local :
+    print "Wrote local jobs, run: python scripts/RunLocal.py --jobdir "+options.outdir+"/stdout/"
+    quit()
 
-    os.chdir(options.outdir + '/stdout/')
-    os.system('condor_submit ' + current_conf)
-    nJob+=1
+# run jobs
+os.chdir(options.outdir + '/stdout/')
+for job in jobs :
+    os.system('condor_submit ' + job['name'] + '.condor')
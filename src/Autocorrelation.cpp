@@ -0,0 +1,190 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Autocorrelation.cpp                                                         *
+ *                                                                             *
+ * Definitions for the integrated autocorrelation time estimator               *
+ * (see interface/Autocorrelation.h)                                           *
+ *                                                                             *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#include "interface/Autocorrelation.h"
+#include "interface/StateIO.h"
+#include <algorithm>
+#include <complex>
+
+AutocorrelationEstimator::AutocorrelationEstimator(const int maxBuffer) {
+    setMaxBufferSize(maxBuffer);
+}
+AutocorrelationEstimator::~AutocorrelationEstimator() {};
+
+
+/* (void) setMaxBufferSize
+ *    | Maximum number of buffered entries before the series is coarsened
+ *  I | (int) buffer length (>=64, rounded up to an even number)
+ */
+void AutocorrelationEstimator::setMaxBufferSize(const int num) {
+    if(num < 64) return;
+    maxBufferSize = num + (num % 2);
+    while((int) buffer.size() >= maxBufferSize) coarsen();
+}
+
+
+/* (void) add
+ *    | Append one sample to the series
+ *  I | (double) sample value
+ */
+void AutocorrelationEstimator::add(const double x) {
+    nSamples++;
+    stale=true;
+
+    double delta = x-rawMean;
+    rawMean += delta/nSamples;
+    rawM2   += delta*(x-rawMean);
+
+    pendingSum += x;
+    pendingCount++;
+    if(pendingCount < binSize) return;
+
+    buffer.push_back(pendingSum/binSize);
+    pendingSum=0;
+    pendingCount=0;
+
+    if((int) buffer.size() >= maxBufferSize) coarsen();
+}
+
+
+/* (void) coarsen
+ *    | Halve the buffer by averaging neighbouring entries, doubling the
+ *    | number of samples per entry (see compute for the rescaling)
+ */
+void AutocorrelationEstimator::coarsen() {
+    int half = buffer.size()/2;
+    for(int i=0; i < half; i++) {
+        buffer.at(i) = 0.5*(buffer.at(2*i)+buffer.at(2*i+1));
+    }
+    buffer.resize(half);
+    binSize *= 2;
+}
+
+
+/* (void) reset
+ *    | Clear the series, keeping the settings
+ */
+void AutocorrelationEstimator::reset() {
+    buffer.clear();
+    binSize=1;
+    pendingSum=0;
+    pendingCount=0;
+    nSamples=0;
+    rawMean=0;
+    rawM2=0;
+    stale=true;
+    tauInt=0.5;
+    window=0;
+}
+
+
+/* (double) getMean
+ *    | Mean of the buffered series
+ */
+const double AutocorrelationEstimator::getMean() {
+    if(buffer.empty()) return 0;
+    double sum=0;
+    for(size_t i=0; i < buffer.size(); i++) sum += buffer[i];
+    return sum/buffer.size();
+}
+
+
+/* (double) getTauInt
+ *    | Integrated autocorrelation time, tau_int = 1/2 + sum_t rho(t),
+ *    | in units of input samples (0.5 for an uncorrelated series)
+ */
+const double AutocorrelationEstimator::getTauInt() {
+    if(stale) compute();
+    return tauInt;
+}
+
+
+/* (double) getNumEffSamples
+ *    | Number of effectively independent samples, n / (2 tau_int)
+ */
+const double AutocorrelationEstimator::getNumEffSamples() {
+    if(nSamples == 0) return 0;
+    return nSamples/(2*getTauInt());
+}
+
+
+/* (void) compute
+ *    | Evaluate the normalized autocorrelation function of the buffer
+ *    | by FFT (zero-padded to avoid wrap-around), then sum it up to the
+ *    | first window M satisfying M >= c * tau_int(M). On a coarsened
+ *    | buffer of bins of size b, both give the variance of the overall
+ *    | mean, var_b * 2 tau_b / n_b = var_x * 2 tau / n, so
+ *    | tau = tau_b * b * var_b / var_x with var_x from the raw samples.
+ */
+void AutocorrelationEstimator::compute() {
+    stale=false;
+    tauInt=0.5;
+    window=0;
+
+    int n = buffer.size();
+    if(n < 2) return;
+
+    double mean = getMean();
+    plan.resize(FFTPlan::nextPowerOfTwo(2*n));
+    std::vector<std::complex<double> > data(plan.getSize());
+    for(int i=0; i < n; i++) data[i] = buffer[i]-mean;
+
+    plan.forward(data.data());
+    for(size_t i=0; i < data.size(); i++) data[i] = std::norm(data[i]);
+    plan.inverse(data.data());
+
+    double c0 = data[0].real();
+    if(c0 <= 0) return;
+
+    double tau=0.5;
+    int M=1;
+    for(; M < n; M++) {
+        tau += data[M].real()/c0;
+        if(M >= windowC*tau) break;
+    }
+
+    // A negative sum means the series is far too short to resolve rho(t)
+    tau=std::max(tau,0.5);
+    window=M;
+
+    if(binSize > 1 && rawM2 > 0) {
+        double varBinned = c0/n;
+        double varRaw    = rawM2/nSamples;
+        tau *= binSize*varBinned/varRaw;
+    }
+    tauInt=std::max(tau,0.5);
+}
+
+
+/* (void) writeState
+ *    | Write the accumulated data to a checkpoint stream
+ */
+void AutocorrelationEstimator::writeState(std::ostream& os) {
+    StateIO::write(os,buffer);
+    StateIO::write(os,binSize);
+    StateIO::write(os,pendingSum);
+    StateIO::write(os,pendingCount);
+    StateIO::write(os,nSamples);
+    StateIO::write(os,rawMean);
+    StateIO::write(os,rawM2);
+}
+
+
+/* (void) readState
+ *    | Restore the accumulated data written by writeState. The object
+ *    | must have been set up for the same lattice.
+ */
+void AutocorrelationEstimator::readState(std::istream& is) {
+    StateIO::read(is,buffer);
+    StateIO::read(is,binSize);
+    StateIO::read(is,pendingSum);
+    StateIO::read(is,pendingCount);
+    StateIO::read(is,nSamples);
+    StateIO::read(is,rawMean);
+    StateIO::read(is,rawM2);
+    stale=true;
+}
@@ -0,0 +1,264 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * BinningAnalysis.cpp                                                         *
+ *                                                                             *
+ * Definitions for the binning/jackknife error analysis                        *
+ * (see interface/BinningAnalysis.h)                                           *
+ *                                                                             *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#include "interface/BinningAnalysis.h"
+#include "interface/StateIO.h"
+#include <algorithm>
+#include <cmath>
+
+BinningAnalysis::BinningAnalysis(const int nObs, const int nBins) {
+    nJackknifeBins = std::max(nBins,2);
+    setNumObservables(nObs);
+}
+BinningAnalysis::~BinningAnalysis() {};
+
+
+/* (void) setNumObservables
+ *    | Number of values passed to each add() call
+ *  I | (int) number of observables
+ */
+void BinningAnalysis::setNumObservables(const int num) {
+    if(num < 1) return;
+    nObservables=num;
+    reset();
+}
+
+
+/* (void) setNumJackknifeBins
+ *    | Number of jackknife bins kept (between n and 2n are in use)
+ *  I | (int) number of bins (>=2)
+ */
+void BinningAnalysis::setNumJackknifeBins(const int num) {
+    if(num < 2) return;
+    nJackknifeBins=num;
+    reset();
+}
+
+
+/* (void) reset
+ *    | Clear all accumulated data
+ */
+void BinningAnalysis::reset() {
+    nSamples=0;
+    total.assign(nObservables,0);
+    levels.clear();
+    binLength=1;
+    pendingCount=0;
+    pendingBin.assign(nObservables,0);
+    bins.clear();
+}
+
+
+/* (void) add
+ *    | Add one sample of every observable
+ *  I | (vector<double>) values, one per observable
+ */
+void BinningAnalysis::add(const std::vector<double>& x) {
+    nSamples++;
+    for(int i=0; i < nObservables; i++) total[i] += x[i];
+
+    addToLevel(0,x);
+
+    for(int i=0; i < nObservables; i++) pendingBin[i] += x[i];
+    if(++pendingCount < binLength) return;
+
+    bins.push_back(pendingBin);
+    pendingBin.assign(nObservables,0);
+    pendingCount=0;
+    if((int) bins.size() >= 2*nJackknifeBins) mergeBins();
+}
+
+
+/* (void) addToLevel
+ *    | Accumulate a block mean at level l and, every second block, pass
+ *    | the mean of the pair up to level l+1
+ */
+void BinningAnalysis::addToLevel(const int l, const std::vector<double>& x) {
+    if(l == (int) levels.size()) {
+        binLevel tl;
+        tl.pending.assign(nObservables,0);
+        tl.hasPending=false;
+        tl.nBlocks=0;
+        tl.sum.assign(nObservables,0);
+        tl.sumSq.assign(nObservables,0);
+        levels.push_back(tl);
+    }
+
+    binLevel& cl = levels[l];
+    cl.nBlocks++;
+    for(int i=0; i < nObservables; i++) {
+        cl.sum[i]   += x[i];
+        cl.sumSq[i] += x[i]*x[i];
+    }
+
+    if(!cl.hasPending) {
+        cl.pending=x;
+        cl.hasPending=true;
+        return;
+    }
+
+    std::vector<double> pair(nObservables);
+    for(int i=0; i < nObservables; i++) pair[i] = 0.5*(cl.pending[i]+x[i]);
+    cl.hasPending=false;
+    addToLevel(l+1,pair);
+}
+
+
+/* (void) mergeBins
+ *    | Halve the number of jackknife bins by merging neighbours
+ */
+void BinningAnalysis::mergeBins() {
+    int half = bins.size()/2;
+    for(int b=0; b < half; b++) {
+        for(int i=0; i < nObservables; i++) {
+            bins[b][i] = bins[2*b][i] + bins[2*b+1][i];
+        }
+    }
+    bins.resize(half);
+    binLength *= 2;
+}
+
+
+/* (double) getMean
+ *    | Mean of an observable over all samples
+ */
+const double BinningAnalysis::getMean(const int iObs) {
+    if(nSamples == 0) return 0;
+    return total.at(iObs)/nSamples;
+}
+
+
+/* (double) getBinningError
+ *    | Naive error of the mean computed from blocks of size 2^level.
+ *    | Grows with level until the blocks are longer than the
+ *    | autocorrelation time, then plateaus at the true error.
+ */
+const double BinningAnalysis::getBinningError(const int iObs, const int level) {
+    if(level >= (int) levels.size()) return 0;
+    const binLevel& cl = levels[level];
+    if(cl.nBlocks < 2) return 0;
+
+    double mean = cl.sum.at(iObs)/cl.nBlocks;
+    double var  = cl.sumSq.at(iObs)/cl.nBlocks - mean*mean;
+    return sqrt(std::max(var,0.)/(cl.nBlocks-1));
+}
+
+
+/* (double) getError
+ *    | Error of the mean: largest binning error among the levels that
+ *    | still have at least 32 blocks (conservative plateau estimate)
+ */
+const double BinningAnalysis::getError(const int iObs) {
+    double error=0;
+    for(size_t l=0; l < levels.size(); l++) {
+        if(levels[l].nBlocks < 32) break;
+        error = std::max(error,getBinningError(iObs,l));
+    }
+    return error;
+}
+
+
+/* (Estimate) getEstimate
+ *    | Mean and binning error of an observable
+ */
+const Estimate BinningAnalysis::getEstimate(const int iObs) {
+    Estimate est;
+    est.value = getMean(iObs);
+    est.error = getError(iObs);
+    return est;
+}
+
+
+/* (Estimate) getJackknife
+ *    | Bias-corrected jackknife estimate of f(means) over the complete
+ *    | bins. The samples of an incomplete last bin are left out.
+ *  I | (function) derived quantity, called with the vector of means
+ */
+const Estimate BinningAnalysis::getJackknife(
+        const std::function<double(const std::vector<double>&)>& f) {
+    Estimate est;
+    int nb = bins.size();
+    if(nb < 2) {
+        std::vector<double> means(nObservables);
+        for(int i=0; i < nObservables; i++) means[i] = getMean(i);
+        est.value = f(means);
+        est.error = 0;
+        return est;
+    }
+
+    std::vector<double> sums(nObservables,0);
+    for(int b=0; b < nb; b++) {
+        for(int i=0; i < nObservables; i++) sums[i] += bins[b][i];
+    }
+
+    double nTotal = (double) nb*binLength;
+    std::vector<double> means(nObservables);
+    for(int i=0; i < nObservables; i++) means[i] = sums[i]/nTotal;
+    double fAll = f(means);
+
+    std::vector<double> fLeaveOut(nb);
+    double fMean=0;
+    for(int b=0; b < nb; b++) {
+        for(int i=0; i < nObservables; i++) {
+            means[i] = (sums[i]-bins[b][i])/(nTotal-binLength);
+        }
+        fLeaveOut[b] = f(means);
+        fMean += fLeaveOut[b]/nb;
+    }
+
+    double var=0;
+    for(int b=0; b < nb; b++) var += pow(fLeaveOut[b]-fMean,2);
+
+    est.value = nb*fAll - (nb-1)*fMean;
+    est.error = sqrt((nb-1.)/nb*var);
+    return est;
+}
+
+
+/* (void) writeState
+ *    | Write the accumulated data to a checkpoint stream
+ */
+void BinningAnalysis::writeState(std::ostream& os) {
+    StateIO::write(os,nSamples);
+    StateIO::write(os,total);
+    StateIO::write(os,(unsigned long long) levels.size());
+    for(size_t l=0; l < levels.size(); l++) {
+        StateIO::write(os,levels[l].pending);
+        StateIO::write(os,levels[l].hasPending);
+        StateIO::write(os,levels[l].nBlocks);
+        StateIO::write(os,levels[l].sum);
+        StateIO::write(os,levels[l].sumSq);
+    }
+    StateIO::write(os,binLength);
+    StateIO::write(os,pendingCount);
+    StateIO::write(os,pendingBin);
+    StateIO::write(os,bins);
+}
+
+
+/* (void) readState
+ *    | Restore the accumulated data written by writeState. The object
+ *    | must have been set up for the same lattice.
+ */
+void BinningAnalysis::readState(std::istream& is) {
+    StateIO::read(is,nSamples);
+    StateIO::read(is,total);
+    unsigned long long nLevels=0;
+    StateIO::read(is,nLevels);
+    levels.resize(nLevels);
+    for(size_t l=0; l < levels.size(); l++) {
+        StateIO::read(is,levels[l].pending);
+        StateIO::read(is,levels[l].hasPending);
+        StateIO::read(is,levels[l].nBlocks);
+        StateIO::read(is,levels[l].sum);
+        StateIO::read(is,levels[l].sumSq);
+    }
+    StateIO::read(is,binLength);
+    StateIO::read(is,pendingCount);
+    StateIO::read(is,pendingBin);
+    StateIO::read(is,bins);
+}
@@ -0,0 +1,202 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * BlockSpins.cpp                                                              *
+ *                                                                             *
+ * Definitions for the block-spin observables                                  *
+ * (see interface/BlockSpins.h)                                                *
+ *                                                                             *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#include "interface/BlockSpins.h"
+#include "interface/StateIO.h"
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+
+BlockSpins::BlockSpins() {};
+BlockSpins::~BlockSpins() {};
+
+
+/* (void) setup
+ *    | Map every site to its level-0 block and every block to its parent.
+ *    | Sites are in row-major order; along an axis the site index a lies
+ *    | in the level-k block a/(2*slices^k).
+ *  I | (vector<int>) number of sites along each axis (2*slices^depth)
+ *    | (int) number of sub-cells per axis and level
+ *    | (int) lattice depth
+ *    | (vector<int>) 1 for active sites, 0 for missing ones
+ */
+void BlockSpins::setup(const std::vector<int>& latticeDims,
+                       const int slices,
+                       const int depth,
+                       const std::vector<int>& active) {
+    int p=latticeDims.size();
+    nSlices=slices;
+    nLevels=depth+1;
+    for(int j=0; j < p; j++) {
+        if(latticeDims.at(j) != getBlockLength(depth)) {
+            std::cout<<"ERROR: Lattice does not tile into "<<slices
+                     <<"-fold blocks of depth "<<depth<<std::endl;
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    // Blocks per axis and in total at each level
+    std::vector<int> perAxis(nLevels);
+    std::vector<int> nBlocks(nLevels);
+    for(int k=0; k < nLevels; k++) {
+        perAxis.at(k) = latticeDims.at(0)/getBlockLength(k);
+        nBlocks.at(k) = pow(perAxis.at(k),p);
+    }
+
+    int nSites=active.size();
+    siteBlock.assign(nSites,0);
+    for(int i=0; i < nSites; i++) {
+        int b=0;
+        for(int j=0,rem=i,stride=1; j < p; j++) {
+            int a = rem % latticeDims.at(p-1-j);
+            rem /= latticeDims.at(p-1-j);
+            b += (a/2)*stride;
+            stride *= perAxis.at(0);
+        }
+        siteBlock.at(i)=b;
+    }
+
+    parentBlock.assign(nLevels-1,std::vector<int>());
+    for(int k=0; k+1 < nLevels; k++) {
+        parentBlock.at(k).assign(nBlocks.at(k),0);
+        for(int b=0; b < nBlocks.at(k); b++) {
+            int parent=0;
+            for(int j=0,rem=b,stride=1; j < p; j++) {
+                int a = rem % perAxis.at(k);
+                rem /= perAxis.at(k);
+                parent += (a/nSlices)*stride;
+                stride *= perAxis.at(k+1);
+            }
+            parentBlock.at(k).at(b)=parent;
+        }
+    }
+
+    // Active sites per block, summed bottom-up like the spins
+    blockCount.assign(nLevels,std::vector<double>());
+    blockSum.assign(nLevels,std::vector<double>());
+    for(int k=0; k < nLevels; k++) {
+        blockCount.at(k).assign(nBlocks.at(k),0);
+        blockSum.at(k).assign(nBlocks.at(k),0);
+    }
+    for(int i=0; i < nSites; i++) blockCount[0][siteBlock[i]] += active.at(i);
+    for(int k=0; k+1 < nLevels; k++) {
+        for(size_t b=0; b < blockCount[k].size(); b++) {
+            blockCount[k+1][parentBlock[k][b]] += blockCount[k][b];
+        }
+    }
+
+    moments.setNumObservables(2*nLevels);
+    sample.assign(2*nLevels,0);
+}
+
+
+/* (void) reset
+ *    | Clear the accumulated moments
+ */
+void BlockSpins::reset() {
+    moments.reset();
+}
+
+
+/* (void) accumulate
+ *    | Sum the spins into the level-0 blocks, then each level into the
+ *    | next, and record the mean m^2 and m^4 of the block magnetizations
+ *    | m = (block sum)/(active sites) at every level
+ *  I | (ConstView<int>) spins, 0 at missing sites
+ */
+void BlockSpins::accumulate(const ConstView<int> spins) {
+    if(nLevels == 0) return;
+
+    std::vector<double>& sum0 = blockSum[0];
+    std::fill(sum0.begin(),sum0.end(),0);
+    for(size_t i=0; i < spins.size(); i++) sum0[siteBlock[i]] += spins[i];
+
+    for(int k=0; k < nLevels; k++) {
+        const std::vector<double>& sum   = blockSum[k];
+        const std::vector<double>& count = blockCount[k];
+        if(k+1 < nLevels) {
+            std::vector<double>& next = blockSum[k+1];
+            std::fill(next.begin(),next.end(),0);
+            for(size_t b=0; b < sum.size(); b++) next[parentBlock[k][b]] += sum[b];
+        }
+
+        double m2=0, m4=0, nOccupied=0;
+        for(size_t b=0; b < sum.size(); b++) {
+            if(count[b] == 0) continue;
+            double m  = sum[b]/count[b];
+            m2 += m*m;
+            m4 += m*m*m*m;
+            nOccupied++;
+        }
+        sample[2*k]   = nOccupied > 0 ? m2/nOccupied : 0;
+        sample[2*k+1] = nOccupied > 0 ? m4/nOccupied : 0;
+    }
+
+    moments.add(sample);
+}
+
+
+/* (int) getBlockLength
+ *    | Returns the number of sites along each axis of a level-k block
+ */
+const int BlockSpins::getBlockLength(const int level) {
+    return 2*pow(nSlices,level);
+}
+
+
+/* (double) getMeanSquaredBlockSpin
+ *    | Returns <m^2> of the level-k blocks
+ */
+const double BlockSpins::getMeanSquaredBlockSpin(const int level) {
+    return moments.getMean(2*level);
+}
+
+
+/* (Estimate) getBinderCumulant
+ *    | Returns U_k = 1 - <m^4>/(3<m^2>^2) of the level-k blocks
+ */
+const Estimate BlockSpins::getBinderCumulant(const int level) {
+    int k=level;
+    return moments.getJackknife([k](const std::vector<double>& x) {
+        if(x.at(2*k) == 0) return 0.;
+        return 1 - x.at(2*k+1)/(3*x.at(2*k)*x.at(2*k));
+    });
+}
+
+
+/* (Estimate) getCorrelationRatio
+ *    | Returns R_k = <m_k^2>/<m_{k-1}^2>, the squared block magnetization
+ *    | of a level-k block relative to that of its children (single spins
+ *    | for k = 0). R_k -> 1 when the children are aligned and -> 1/slices^p
+ *    | when they are uncorrelated; curves for different depths cross at
+ *    | the critical point.
+ */
+const Estimate BlockSpins::getCorrelationRatio(const int level) {
+    int k=level;
+    return moments.getJackknife([k](const std::vector<double>& x) {
+        double child = k > 0 ? x.at(2*k-2) : 1;
+        if(child == 0) return 0.;
+        return x.at(2*k)/child;
+    });
+}
+
+
+/* (void) writeState
+ *    | Write the accumulated data to a checkpoint stream
+ */
+void BlockSpins::writeState(std::ostream& os) {
+    moments.writeState(os);
+}
+
+
+/* (void) readState
+ *    | Restore the accumulated data written by writeState. The object
+ *    | must have been set up for the same lattice.
+ */
+void BlockSpins::readState(std::istream& is) {
+    moments.readState(is);
+}
@@ -0,0 +1,231 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * ClusterAnalysis.cpp                                                         *
+ *                                                                             *
+ * Definitions for the union-find cluster statistics                           *
+ * (see interface/ClusterAnalysis.h)                                           *
+ *                                                                             *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#include "interface/ClusterAnalysis.h"
+#include "interface/StateIO.h"
+#include <algorithm>
+#include <cmath>
+
+/* (void) reset
+ *    | Make every element its own set
+ *  I | (int) number of elements
+ */
+void UnionFind::reset(const int n) {
+    parent.resize(n);
+    size.assign(n,1);
+    for(int i=0; i < n; i++) parent[i]=i;
+}
+
+
+/* (int) find
+ *    | Root of the set containing i, halving the path on the way
+ */
+int UnionFind::find(int i) {
+    while(parent[i] != i) {
+        parent[i] = parent[parent[i]];
+        i = parent[i];
+    }
+    return i;
+}
+
+
+/* (void) unite
+ *    | Merge the sets containing i and j, smaller under larger
+ */
+void UnionFind::unite(const int i, const int j) {
+    int ri=find(i);
+    int rj=find(j);
+    if(ri == rj) return;
+    if(size[ri] < size[rj]) std::swap(ri,rj);
+    parent[rj]=ri;
+    size[ri] += size[rj];
+}
+
+
+ClusterAnalysis::ClusterAnalysis() {};
+ClusterAnalysis::~ClusterAnalysis() {};
+
+
+/* (void) setup
+ *    | Store views of the neighbour graph (the arrays must outlive this
+ *    | object's use) and mark the sites on each face of the lattice
+ *  I | (vector<int>) number of sites along each axis (row-major order)
+ *    | (ConstView<int>) CSR offsets into the neighbour list (nSites+1)
+ *    | (ConstView<int>) neighbour list
+ *    | (ConstView<double>) coupling factor w_ij of each neighbour entry
+ *    | (vector<int>) 1 for active sites, 0 for missing ones
+ */
+void ClusterAnalysis::setup(const std::vector<int>& latticeDims,
+                            const ConstView<int> nbrOffsets,
+                            const ConstView<int> nbrIndices,
+                            const ConstView<double> nbrWeights,
+                            const std::vector<int>& active) {
+    offsets=nbrOffsets;
+    neighbours=nbrIndices;
+    weights=nbrWeights;
+    nDims=latticeDims.size();
+
+    int nSites=active.size();
+    nActive=0;
+    boundaryMask.assign(nSites,0);
+    for(int i=0; i < nSites; i++) {
+        nActive += active.at(i);
+        for(int j=nDims-1,rem=i; j >= 0; j--) {
+            int aj = rem % latticeDims.at(j);
+            rem /= latticeDims.at(j);
+            if(aj == 0)                    boundaryMask.at(i) |= 1 << (2*j);
+            if(aj == latticeDims.at(j)-1)  boundaryMask.at(i) |= 1 << (2*j+1);
+        }
+    }
+
+    reset();
+}
+
+
+/* (void) reset
+ *    | Clear the accumulated statistics
+ */
+void ClusterAnalysis::reset() {
+    nMeasurements=0;
+    sumLargest.assign(kNumTypes,0);
+    sumSizeSq.assign(kNumTypes,0);
+    nSpanning.assign(kNumTypes,0);
+    sizeCounts.assign(kNumTypes,std::vector<double>(boundaryMask.size()+1,0));
+}
+
+
+/* (void) accumulate
+ *    | Label the domains and one FK cluster realization of a configuration
+ *  I | (ConstView<int>) spins, 0 at missing sites
+ *    | (double) coupling K = J/kbT; FK bonds need K*w_ij > 0
+ */
+void ClusterAnalysis::accumulate(const ConstView<int> spins, const double K) {
+    if(offsets.empty() || nActive == 0) return;
+    nMeasurements++;
+    int nSites=spins.size();
+
+    // Like-spin domains
+    labels.reset(nSites);
+    for(int i=0; i < nSites; i++) {
+        if(spins[i] == 0) continue;
+        for(int n=offsets[i]; n < offsets[i+1]; n++) {
+            int j=neighbours[n];
+            if(j > i && spins[j] == spins[i]) labels.unite(i,j);
+        }
+    }
+    collect(kDomains,spins);
+
+    // Fortuin-Kasteleyn clusters
+    labels.reset(nSites);
+    for(int i=0; i < nSites; i++) {
+        if(spins[i] == 0) continue;
+        for(int n=offsets[i]; n < offsets[i+1]; n++) {
+            int j=neighbours[n];
+            if(j < i || spins[j] != spins[i]) continue;
+            double Kij = K*weights[n];
+            if(Kij > 0 && rng.Uniform() < 1-exp(-2*Kij)) labels.unite(i,j);
+        }
+    }
+    collect(kFKClusters,spins);
+}
+
+
+/* (void) collect
+ *    | Add the statistics of the current labelling
+ */
+void ClusterAnalysis::collect(const int type, const ConstView<int> spins) {
+    int nSites=spins.size();
+    rootMask.assign(nSites,0);
+    for(int i=0; i < nSites; i++) {
+        if(spins[i] != 0) rootMask[labels.find(i)] |= boundaryMask[i];
+    }
+
+    int largest=0;
+    bool spans=false;
+    for(int i=0; i < nSites; i++) {
+        if(spins[i] == 0 || labels.find(i) != i) continue;
+        int s = labels.getSize(i);
+        largest = std::max(largest,s);
+        sumSizeSq[type] += (double) s*s/nActive;
+        sizeCounts[type][s] += 1;
+
+        for(int j=0; j < nDims; j++) {
+            int faces = 3 << (2*j);
+            if((rootMask[i] & faces) == faces) spans=true;
+        }
+    }
+
+    sumLargest[type] += largest/nActive;
+    if(spans) nSpanning[type] += 1;
+}
+
+
+/* (double) getLargestFraction
+ *    | Returns the mean fraction of active sites in the largest cluster
+ */
+const double ClusterAnalysis::getLargestFraction(const int type) {
+    if(nMeasurements == 0) return 0;
+    return sumLargest.at(type)/nMeasurements;
+}
+
+
+/* (double) getMeanClusterSize
+ *    | Returns <sum_c s_c^2>/N, which for FK clusters is the improved
+ *    | estimator of <M^2>/N
+ */
+const double ClusterAnalysis::getMeanClusterSize(const int type) {
+    if(nMeasurements == 0) return 0;
+    return sumSizeSq.at(type)/nMeasurements;
+}
+
+
+/* (double) getSpanningProbability
+ *    | Returns the fraction of measurements with a cluster touching both
+ *    | faces of at least one axis
+ */
+const double ClusterAnalysis::getSpanningProbability(const int type) {
+    if(nMeasurements == 0) return 0;
+    return nSpanning.at(type)/nMeasurements;
+}
+
+
+/* (vector<double>) getSizeDistribution
+ *    | Returns the mean number of clusters of each size s = 0..N
+ */
+const std::vector<double> ClusterAnalysis::getSizeDistribution(const int type) {
+    std::vector<double> n = sizeCounts.at(type);
+    if(nMeasurements == 0) return n;
+    for(size_t s=0; s < n.size(); s++) n[s] /= nMeasurements;
+    return n;
+}
+
+
+/* (void) writeState
+ *    | Write the accumulated data to a checkpoint stream
+ */
+void ClusterAnalysis::writeState(std::ostream& os) {
+    StateIO::write(os,nMeasurements);
+    StateIO::write(os,sumLargest);
+    StateIO::write(os,sumSizeSq);
+    StateIO::write(os,nSpanning);
+    StateIO::write(os,sizeCounts);
+    rng.writeState(os);
+}
+
+
+/* (void) readState
+ *    | Restore the accumulated data written by writeState. The object
+ *    | must have been set up for the same lattice.
+ */
+void ClusterAnalysis::readState(std::istream& is) {
+    StateIO::read(is,nMeasurements);
+    StateIO::read(is,sumLargest);
+    StateIO::read(is,sumSizeSq);
+    StateIO::read(is,nSpanning);
+    StateIO::read(is,sizeCounts);
+    rng.readState(is);
+}
@@ -0,0 +1,226 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Correlation.cpp                                                             *
+ *                                                                             *
+ * Definitions for the spin-spin correlation accumulator                       *
+ * (see interface/Correlation.h)                                               *
+ *                                                                             *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#include "interface/Correlation.h"
+#include "interface/StateIO.h"
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <map>
+
+SpinCorrelation::SpinCorrelation() {};
+SpinCorrelation::~SpinCorrelation() {};
+
+
+/* (void) setup
+ *    | Precompute the distance tables and pair counts for a lattice
+ *  I | (vector<int>) padded embedding grid dimensions (powers of two)
+ *    | (vector<int>) index of each site on the padded grid
+ *    | (vector<int>) 1 for active sites, 0 for missing ones
+ *    | (ConstView<int>) CSR offsets into the neighbour list (nSites+1)
+ *    | (ConstView<int>) neighbour list
+ *    | (GridFFT*) transform shared with the caller, set up for paddedDims
+ */
+void SpinCorrelation::setup(const std::vector<int>& paddedDims,
+                            const std::vector<int>& embeddedIndex,
+                            const std::vector<int>& active,
+                            const ConstView<int> nbrOffsets,
+                            const ConstView<int> nbrIndices,
+                            GridFFT* fft) {
+    gridFFT=fft;
+    nDims=paddedDims.size();
+    int nSites=active.size();
+    int gridSize=gridFFT->getSize();
+
+    // Sources spread evenly over the active sites
+    sources.clear();
+    std::vector<int> activeList;
+    for(int i=0; i < nSites; i++) if(active.at(i)) activeList.push_back(i);
+    int nUsed = std::min(nSources,(int) activeList.size());
+    for(int s=0; s < nUsed; s++) {
+        sources.push_back(activeList.at((long) s*activeList.size()/nUsed));
+    }
+
+    // Breadth-first search from each source over the neighbour graph
+    sourceDistances.assign(sources.size()*nSites,-1);
+    graphPairs.clear();
+    for(size_t s=0; s < sources.size(); s++) {
+        int* dist = &sourceDistances[s*nSites];
+        std::deque<int> queue(1,sources.at(s));
+        dist[sources.at(s)]=0;
+        while(!queue.empty()) {
+            int i=queue.front();
+            queue.pop_front();
+            for(int n=nbrOffsets[i]; n < nbrOffsets[i+1]; n++) {
+                int j=nbrIndices[n];
+                if(dist[j] >= 0 || !active.at(j)) continue;
+                dist[j]=dist[i]+1;
+                queue.push_back(j);
+            }
+        }
+        for(int i=0; i < nSites; i++) {
+            if(dist[i] < 0) continue;
+            if(dist[i] >= (int) graphPairs.size()) graphPairs.resize(dist[i]+1,0);
+            graphPairs.at(dist[i]) += 1;
+        }
+    }
+
+    // Number of site pairs at each displacement, from the autocorrelation
+    // of the occupancy mask
+    workspace.assign(gridSize,0);
+    for(int i=0; i < nSites; i++) workspace.at(embeddedIndex.at(i)) = active.at(i);
+    gridFFT->forward(workspace);
+    for(int k=0; k < gridSize; k++) workspace[k] = std::norm(workspace[k]);
+    gridFFT->inverse(workspace);
+
+    // Classify displacements by |r|^2 (negative offsets are wrapped)
+    std::map<int,int> r2ToClass;
+    distanceClass.assign(gridSize,-1);
+    for(int k=0; k < gridSize; k++) {
+        double pairs = floor(workspace[k].real()+0.5);
+        if(pairs < 1) continue;
+
+        int r2=0;
+        for(int j=nDims-1,rem=k; j >= 0; j--) {
+            int dj = rem % paddedDims.at(j);
+            rem /= paddedDims.at(j);
+            if(dj > paddedDims.at(j)/2) dj -= paddedDims.at(j);
+            r2 += dj*dj;
+        }
+        if(r2ToClass.find(r2) == r2ToClass.end()) r2ToClass[r2]=0;
+        distanceClass.at(k)=r2;
+    }
+
+    classR2.clear();
+    for(std::map<int,int>::iterator it=r2ToClass.begin(); it != r2ToClass.end(); it++) {
+        it->second=classR2.size();
+        classR2.push_back(it->first);
+    }
+
+    classPairs.assign(classR2.size(),0);
+    for(int k=0; k < gridSize; k++) {
+        if(distanceClass.at(k) < 0) continue;
+        distanceClass.at(k) = r2ToClass[distanceClass.at(k)];
+        classPairs.at(distanceClass.at(k)) += floor(workspace[k].real()+0.5);
+    }
+
+    reset();
+}
+
+
+/* (void) reset
+ *    | Clear the accumulated sums, keeping the distance tables
+ */
+void SpinCorrelation::reset() {
+    nMeasurements=0;
+    graphSum.assign(graphPairs.size(),0);
+    classSum.assign(classR2.size(),0);
+}
+
+
+/* (void) accumulate
+ *    | Add one configuration. Cost is O(nSources * N) for the graph
+ *    | distances plus one inverse FFT of the padded grid.
+ *  I | (ConstView<int>) spins, 0 at missing sites
+ *    | (vector<complex<double>>) forward FFT of the embedded spin field
+ */
+void SpinCorrelation::accumulate(const ConstView<int> spins,
+                                 const std::vector<std::complex<double> >& spectrum) {
+    if(!gridFFT) return;
+    nMeasurements++;
+    int nSites=spins.size();
+
+    for(size_t s=0; s < sources.size(); s++) {
+        const int* dist = &sourceDistances[s*nSites];
+        int S0 = spins[sources[s]];
+        for(int i=0; i < nSites; i++) {
+            if(dist[i] >= 0) graphSum[dist[i]] += S0*spins[i];
+        }
+    }
+
+    // Wiener-Khinchin: the inverse FFT of |F(k)|^2 is the pair sum
+    // C(r) = sum_x S(x) S(x+r) for every displacement r
+    int gridSize=spectrum.size();
+    workspace.resize(gridSize);
+    for(int k=0; k < gridSize; k++) workspace[k] = std::norm(spectrum[k]);
+    gridFFT->inverse(workspace);
+    for(int k=0; k < gridSize; k++) {
+        if(distanceClass[k] >= 0) classSum[distanceClass[k]] += workspace[k].real();
+    }
+}
+
+
+/* (vector<double>) getGraphCorrelation
+ *    | Returns <S_i S_j> for each graph distance d = 0, 1, ...
+ */
+const std::vector<double> SpinCorrelation::getGraphCorrelation() {
+    std::vector<double> G(graphPairs.size(),0);
+    if(nMeasurements == 0) return G;
+    for(size_t d=0; d < G.size(); d++) {
+        if(graphPairs[d] > 0) G[d] = graphSum[d]/(graphPairs[d]*nMeasurements);
+    }
+    return G;
+}
+
+
+/* (void) getEuclideanCorrelation
+ *    | Fills <S_i S_j> for each distance class |r| on the embedding grid
+ *  I | (vector<double>&) distances (output)
+ *    | (vector<double>&) correlations (output)
+ */
+void SpinCorrelation::getEuclideanCorrelation(std::vector<double>& r,
+                                              std::vector<double>& G) {
+    r.resize(classR2.size());
+    G.assign(classR2.size(),0);
+    for(size_t c=0; c < classR2.size(); c++) {
+        r[c] = sqrt(classR2[c]);
+        if(nMeasurements > 0) G[c] = classSum[c]/(classPairs[c]*nMeasurements);
+    }
+}
+
+
+/* (double) getCorrelationLength
+ *    | Second-moment correlation length in embedding grid units,
+ *    |     xi^2 = sum_r r^2 G(r) / (2 D sum_r G(r)),
+ *    | with the sums over all site pairs. G(r) is not connected, which
+ *    | is the usual finite-lattice definition (sum_r G(r) = <M^2>): it
+ *    | measures xi in the symmetric phase and grows like L when ordered.
+ *  O | (double) xi, or 0 before any measurement
+ */
+const double SpinCorrelation::getCorrelationLength() {
+    if(nMeasurements == 0 || nDims == 0) return 0;
+
+    double num=0;
+    double den=0;
+    for(size_t c=0; c < classR2.size(); c++) {
+        num += classR2[c]*classSum[c];
+        den += classSum[c];
+    }
+    if(num <= 0 || den <= 0) return 0;
+    return sqrt(num/(2*nDims*den));
+}
+
+
+/* (void) writeState
+ *    | Write the accumulated data to a checkpoint stream
+ */
+void SpinCorrelation::writeState(std::ostream& os) {
+    StateIO::write(os,nMeasurements);
+    StateIO::write(os,graphSum);
+    StateIO::write(os,classSum);
+}
+
+
+/* (void) readState
+ *    | Restore the accumulated data written by writeState. The object
+ *    | must have been set up for the same lattice.
+ */
+void SpinCorrelation::readState(std::istream& is) {
+    StateIO::read(is,nMeasurements);
+    StateIO::read(is,graphSum);
+    StateIO::read(is,classSum);
+}
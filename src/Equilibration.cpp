@@ -0,0 +1,112 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Equilibration.cpp                                                           *
+ *                                                                             *
+ * Definitions for the MSER burn-in detector (see interface/Equilibration.h)   *
+ *                                                                             *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#include "interface/Equilibration.h"
+#include "interface/StateIO.h"
+
+EquilibrationDetector::EquilibrationDetector(const int batch) {
+    setBatchSize(batch);
+}
+EquilibrationDetector::~EquilibrationDetector() {};
+
+
+/* (void) add
+ *    | Append one sample (e.g. the energy after a sweep) to the series
+ *  I | (double) sample value
+ */
+void EquilibrationDetector::add(const double x) {
+    series.push_back(x);
+}
+
+
+/* (void) reset
+ *    | Clear the series and the decision
+ */
+void EquilibrationDetector::reset() {
+    series.clear();
+    equilibrated=false;
+    truncation=-1;
+    nextCheck=0;
+}
+
+
+/* (bool) isEquilibrated
+ *    | Whether the burn-in is over. Once true, stays true until reset.
+ *    | The MSER test is re-run each time the series grows by 25%.
+ */
+const bool EquilibrationDetector::isEquilibrated() {
+    if(equilibrated) return true;
+
+    int nBatches = series.size()/batchSize;
+    if(nBatches < minBatches || (int) series.size() < nextCheck) return false;
+    nextCheck = series.size() + series.size()/4;
+
+    int dBatch = mserTruncation();
+    if(dBatch >= 0 && 2*dBatch < nBatches) {
+        equilibrated=true;
+        truncation=dBatch*batchSize;
+    }
+    return equilibrated;
+}
+
+
+/* (int) mserTruncation
+ *    | MSER statistic on batch means Y_1..Y_k,
+ *    |     MSER(d) = sum_{j>d} (Y_j - Ybar_d)^2 / (k-d)^2,
+ *    | minimized over d in [0, k/2]. Only the first half is searched,
+ *    | since the statistic is unstable for short tails.
+ *  O | (int) optimal truncation point in batches, -1 if undefined
+ */
+int EquilibrationDetector::mserTruncation() {
+    int k = series.size()/batchSize;
+    if(k < 2) return -1;
+
+    std::vector<double> batches(k,0);
+    for(int j=0; j < k; j++) {
+        for(int i=0; i < batchSize; i++) batches.at(j) += series.at(j*batchSize+i);
+        batches.at(j) /= batchSize;
+    }
+
+    // Suffix sums so that each candidate d costs O(1)
+    double sum=0;
+    double sumSq=0;
+    std::vector<double> mser(k,0);
+    for(int d=k-1; d >= 0; d--) {
+        sum   += batches.at(d);
+        sumSq += batches.at(d)*batches.at(d);
+        double n = k-d;
+        mser.at(d) = (sumSq - sum*sum/n)/(n*n);
+    }
+
+    int best=0;
+    for(int d=1; d <= k/2; d++) {
+        if(mser.at(d) < mser.at(best)) best=d;
+    }
+    return best;
+}
+
+
+/* (void) writeState
+ *    | Write the accumulated data to a checkpoint stream
+ */
+void EquilibrationDetector::writeState(std::ostream& os) {
+    StateIO::write(os,series);
+    StateIO::write(os,equilibrated);
+    StateIO::write(os,truncation);
+    StateIO::write(os,nextCheck);
+}
+
+
+/* (void) readState
+ *    | Restore the accumulated data written by writeState. The object
+ *    | must have been set up for the same lattice.
+ */
+void EquilibrationDetector::readState(std::istream& is) {
+    StateIO::read(is,series);
+    StateIO::read(is,equilibrated);
+    StateIO::read(is,truncation);
+    StateIO::read(is,nextCheck);
+}
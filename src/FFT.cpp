@@ -0,0 +1,168 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * FFT.cpp                                                                     *
+ *                                                                             *
+ * Definitions for the radix-2 FFT plan (see interface/FFT.h)                  *
+ *                                                                             *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#include "interface/FFT.h"
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+
+FFTPlan::FFTPlan(const int n) {
+    resize(n);
+}
+FFTPlan::~FFTPlan() {};
+
+
+/* (int) nextPowerOfTwo
+ *    | Smallest power of two that is >= n
+ *  I | (int) length to round up
+ */
+int FFTPlan::nextPowerOfTwo(const int n) {
+    int p=1;
+    while(p < n) p <<= 1;
+    return p;
+}
+
+
+/* (void) resize
+ *    | Rebuild the bit-reversal and twiddle tables for a new length.
+ *    | Does nothing if the length is unchanged.
+ *  I | (int) transform length, must be a power of two
+ */
+void FFTPlan::resize(const int n) {
+    if(n == size) return;
+    if(n < 1 || (n & (n-1)) != 0) {
+        std::cout<<"ERROR: FFT length "<<n<<" is not a power of two"<<std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    size=n;
+    bitReverse.assign(size,0);
+    for(int i=1,j=0; i < size; i++) {
+        int bit = size >> 1;
+        for(; j & bit; bit >>= 1) j ^= bit;
+        j ^= bit;
+        bitReverse.at(i)=j;
+    }
+
+    twiddles.resize(size/2);
+    for(int i=0; i < size/2; i++) {
+        double angle = -2*M_PI*i/size;
+        twiddles.at(i) = std::complex<double>(cos(angle),sin(angle));
+    }
+}
+
+
+/* (void) forward
+ *    | In-place forward transform, F(k) = sum_x f(x) e^{-2 pi i k x / n}
+ *  I | (complex<double>*) first element of the data
+ *    | (int) distance between consecutive elements
+ */
+void FFTPlan::forward(std::complex<double>* data, const int stride) {
+    transform(data,stride,false);
+}
+
+
+/* (void) inverse
+ *    | In-place inverse transform, normalized by 1/n
+ *  I | (complex<double>*) first element of the data
+ *    | (int) distance between consecutive elements
+ */
+void FFTPlan::inverse(std::complex<double>* data, const int stride) {
+    transform(data,stride,true);
+    double norm = 1./size;
+    for(int i=0; i < size; i++) data[i*stride] *= norm;
+}
+
+
+/* (void) transform
+ *    | Iterative Cooley-Tukey butterfly over the precomputed tables
+ */
+void FFTPlan::transform(std::complex<double>* data, const int stride,
+                        const bool invert) {
+    for(int i=0; i < size; i++) {
+        int j=bitReverse[i];
+        if(i < j) std::swap(data[i*stride],data[j*stride]);
+    }
+
+    for(int len=2; len <= size; len <<= 1) {
+        int half = len/2;
+        int step = size/len;
+        for(int i=0; i < size; i += len) {
+            for(int j=0; j < half; j++) {
+                std::complex<double> w = twiddles[j*step];
+                if(invert) w = std::conj(w);
+                std::complex<double> u = data[(i+j)*stride];
+                std::complex<double> v = data[(i+j+half)*stride]*w;
+                data[(i+j)*stride]      = u+v;
+                data[(i+j+half)*stride] = u-v;
+            }
+        }
+    }
+}
+
+
+GridFFT::GridFFT() {};
+GridFFT::~GridFFT() {};
+
+
+/* (void) setDimensions
+ *    | Prepare one plan per axis of a row-major grid (last axis fastest)
+ *  I | (vector<int>) length of each axis
+ */
+void GridFFT::setDimensions(const std::vector<int>& dims) {
+    dimensions=dims;
+    plans.resize(dims.size());
+    strides.resize(dims.size());
+
+    size=1;
+    for(int j=dims.size()-1; j >= 0; j--) {
+        strides.at(j)=size;
+        plans.at(j).resize(dims.at(j));
+        size *= dims.at(j);
+    }
+}
+
+
+/* (void) forward
+ *    | In-place forward transform of the full grid
+ */
+void GridFFT::forward(std::vector<std::complex<double> >& data) {
+    transform(data,false);
+}
+
+
+/* (void) inverse
+ *    | In-place normalized inverse transform of the full grid
+ */
+void GridFFT::inverse(std::vector<std::complex<double> >& data) {
+    transform(data,true);
+}
+
+
+/* (void) transform
+ *    | Apply the 1D plan along every line of every axis
+ */
+void GridFFT::transform(std::vector<std::complex<double> >& data,
+                        const bool invert) {
+    if((int) data.size() != size) {
+        std::cout<<"ERROR: GridFFT data has "<<data.size()
+                 <<" entries, expected "<<size<<std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    for(size_t j=0; j < dimensions.size(); j++) {
+        int stride = strides.at(j);
+        int length = dimensions.at(j)*stride;
+
+        // Lines along axis j start at every index whose j-th coordinate is 0
+        for(int outer=0; outer < size; outer += length) {
+            for(int inner=0; inner < stride; inner++) {
+                if(invert) plans.at(j).inverse(&data[outer+inner],stride);
+                else       plans.at(j).forward(&data[outer+inner],stride);
+            }
+        }
+    }
+}
@@ -9,11 +9,29 @@
  *                                                                             *
  * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
 #include "interface/IsingModel.h"
+#include "interface/StateIO.h"
+#include <chrono>
+#include <cstring>
+#include <fstream>
 #include <iomanip>
+#include <sstream>
+#include <unistd.h>
+
+static const char checkpointMagic[] = "ISCHKPT1";
+static const unsigned int checkpointVersion = 3;
+
+// Sub-streams of the run seed, besides the Monte Carlo generator itself
+enum {kClusterStream=1, kSpinStream=2};
+
+// Part of the configuration hash: bump it whenever a change alters the
+// results of a given configuration, so that stored results are not reused
+static const unsigned int resultsVersion = 5;
 
 // Constructors/destructors implemented simply
 // (because of number of options)
-IsingModel::IsingModel() {};
+IsingModel::IsingModel() {
+    measurements.setNumObservables(kNumObs);
+};
 IsingModel::~IsingModel() {};
 
 
@@ -29,12 +47,162 @@ void IsingModel::setNumThreads(const int num) {
 
 
 /* (void) setNumMCSteps 
- *    | How many MC steps to perform 
+ *    | How many MC steps to perform (can change between runs without a
+ *    | new setup)
  *  I | (int) number of steps 
  */
 void IsingModel::setNumMCSteps(const int num) {
     if(num < 1) return;
     nMCSteps = num;
+}
+
+
+/* (void) setTargetEffSamples
+ *    | Run until this many effectively independent samples of both
+ *    | E and |M| have been collected (nMCSteps becomes the upper limit)
+ *  I | (int) number of samples (0 = always run nMCSteps)
+ */
+void IsingModel::setTargetEffSamples(const int num) {
+    if(num < 0) return;
+    targetEffSamples = num;
+}
+
+
+/* (void) setAutoEquilibrate
+ *    | Detect the end of burn-in (MSER test on the energy series) and
+ *    | only measure afterwards. Burn-in is capped at half of nMCSteps.
+ *  I | (bool) whether to detect burn-in (if false, measure every sweep)
+ */
+void IsingModel::setAutoEquilibrate(const bool autoEq) {
+    autoEquilibrate = autoEq;
+}
+
+
+/* (void) setCorrelationInterval
+ *    | Accumulate the spin-spin correlation function every n-th
+ *    | measurement sweep
+ *  I | (int) interval in sweeps (0 = no correlation measurements)
+ */
+void IsingModel::setCorrelationInterval(const int num) {
+    if(num < 0) return;
+    correlationInterval = num;
+}
+
+
+/* (void) setStructureFactorInterval
+ *    | Accumulate the structure factor S(k) every n-th measurement sweep
+ *  I | (int) interval in sweeps (0 = no structure factor measurements)
+ */
+void IsingModel::setStructureFactorInterval(const int num) {
+    if(num < 0) return;
+    structureFactorInterval = num;
+}
+
+
+/* (void) addStructureFactorWaveVector
+ *    | Evaluate S(k) directly at this wave vector, using the physical
+ *    | site coordinates (in addition to the full embedding grid)
+ *  I | (vector<double>) k, one component per lattice dimension
+ */
+void IsingModel::addStructureFactorWaveVector(const std::vector<double>& k) {
+    structureFactor.addWaveVector(k);
+    hasStructureFactorSetup=false;
+}
+
+
+/* (void) setClusterInterval
+ *    | Label like-spin domains and FK clusters every n-th measurement sweep
+ *  I | (int) interval in sweeps (0 = no cluster measurements)
+ */
+void IsingModel::setClusterInterval(const int num) {
+    if(num < 0) return;
+    clusterInterval = num;
+}
+
+
+/* (void) setSiteMapInterval
+ *    | Accumulate the per-site <S_i> and <S_i S_nbr> maps every n-th
+ *    | measurement sweep
+ *  I | (int) interval in sweeps (0 = no site maps)
+ */
+void IsingModel::setSiteMapInterval(const int num) {
+    if(num < 0) return;
+    siteMapInterval = num;
+}
+
+
+/* (void) setBlockInterval
+ *    | Measure the level-resolved block magnetizations every n-th
+ *    | measurement sweep
+ *  I | (int) interval in sweeps (0 = no block observables)
+ */
+void IsingModel::setBlockInterval(const int num) {
+    if(num < 0) return;
+    blockInterval = num;
+}
+
+
+/* (void) setSweepOutput
+ *    | Stream one row per measurement (sweep, beta*H, M, acceptance rate
+ *    | and summed |Delta(beta*H)| of the sweep) to a columnar file
+ *  I | (string) output file name ("" = no time series)
+ */
+void IsingModel::setSweepOutput(const std::string& fileName) {
+    sweepOutputFile = fileName;
+}
+
+
+/* (void) setSnapshotOutput
+ *    | Store the spin configuration every n-th measurement sweep in a
+ *    | compressed snapshot file (see Snapshots.h)
+ *  I | (string) output file name
+ *    | (int) interval in sweeps (0 = no snapshots)
+ */
+void IsingModel::setSnapshotOutput(const std::string& fileName, const int num) {
+    if(num < 0) return;
+    snapshotFile = fileName;
+    snapshotInterval = num;
+}
+
+
+/* (void) setCheckpoint
+ *    | Save the run state to a file every few seconds of wall-clock time
+ *    | and at the end of the run. If the file exists when runMonteCarlo
+ *    | starts, the run continues from it with an identical trajectory.
+ *  I | (string) checkpoint file name ("" = no checkpoints)
+ *    | (double) interval in seconds (0 = only at the end)
+ */
+void IsingModel::setCheckpoint(const std::string& fileName, const double seconds) {
+    if(seconds < 0) return;
+    checkpointFile = fileName;
+    checkpointInterval = seconds;
+}
+
+
+/* (void) setConvergenceHistory
+ *    | How many of the most recent sweeps keep their convergence counters
+ *  I | (int) number of sweeps (default 1024)
+ */
+void IsingModel::setConvergenceHistory(const int num) {
+    if(num < 2) return;
+    sweepHistory.setCapacity(num);
+}
+
+
+/* (void) setOutOfCore
+ *    | Keep the spin, coordinate and neighbour arrays in scratch files so
+ *    | that lattices larger than memory can be paged to disk. Single-spin
+ *    | sweeps then go tile by tile with local energy updates, which
+ *    | changes the order of the updates (and so the random trajectory).
+ *    | HYBRID group moves still use the full energy sum.
+ *  I | (string) directory for the scratch files, "" to switch it off
+ *    | (int) fractal level of the sweep tiles, -1 to choose one
+ */
+void IsingModel::setOutOfCore(const std::string& directory, const int tileLevel) {
+    if(tileLevel < -1) return;
+    outOfCore = !directory.empty();
+    backingDirectory=directory;
+    requestedTileLevel=tileLevel;
     hasBeenSetup=false;
 }
 
@@ -76,7 +244,7 @@ void IsingModel::setHausdorffDimension(const double dim) {
  *    |         - SCALING   = modify separation
  *    |         - SPLITTING = modify # divisions
  */
-void IsingModel::setHausdorffMethod(char* const hmtd) {
+void IsingModel::setHausdorffMethod(const char* hmtd) {
     hausdorffMethod=hmtd;
     hasBeenSetup=false;
 }
@@ -88,53 +256,61 @@ void IsingModel::setHausdorffMethod(char* const hmtd) {
  *    |         - METROPOLIS (no multithread) 
  *    |         - HEATBATH   (multithread)
  */
-void IsingModel::setMCMethod(char* const mcmd) {
+void IsingModel::setMCMethod(const char* mcmd) {
     mcMethod=mcmd;
     hasBeenSetup=false;
 }
 
 
 /* (void) setCouplingConsts
- *    | Set the values of H,J in the hamiltonian 
+ *    | Set the values of H,J in the hamiltonian. The lattice and its
+ *    | coupling factors do not depend on them, so a set-up model keeps
+ *    | its spins and the next run starts from them.
  *  I | (double) value of H, magnetic field coupling 
  *    | (double) value of J, neighbor couplings
  */
 void IsingModel::setCouplingConsts(const double tH, const double tJ) {
     H=tH;
     J=tJ;
-    hasBeenSetup=false;
 }
 
 
 /* (void) setTemperature
- *    | Set the temperature of the system
+ *    | Set the temperature of the system (as the couplings, without a
+ *    | new setup)
  *  I | (double) value of k_B * T (>0) to use 
  */
 void IsingModel::setTemperature(const double tkbT) {
     if (tkbT < 0) return;
     kbT=tkbT;
-    hasBeenSetup=false;
 }
 
 
-/* (vector<int>) getSpinArray 
- *    | Returns an array of the spins (+1,-1, or 0)
+/* (ConstView<double>) getSiteCoordinates
+ *    | Returns the coordinates of a single site, without copying
+ *  I | (int) site index
  */
-const std::vector<int> IsingModel::getSpinArray() {
-    std::vector<int> spins(0);
-    for(const auto &it : spinArray) {
-        spins.push_back(it.active ? it.S : 0);
-    }
-    return spins;
+ConstView<double> IsingModel::getSiteCoordinates(const int i) {
+    int p=latticeDimensions.size();
+    if(i < 0 || i >= nSpins) return ConstView<double>();
+    return ConstView<double>(siteCoordinates.data() + (size_t) i*p,p);
 }
 
 
-/* (vector<int>) getLatticeDimensions 
- *    | Returns an array of the number of spins along
- *    | each lattice edge
+/* (ActiveSiteRange) getActiveSites
+ *    | Returns a range over the active sites, e.g.
+ *    |     for(const ActiveSite& s : model.getActiveSites()) ...
+ *    | Each element carries the site index, its spin and a view of its
+ *    | coordinates
  */
-const std::vector<int> IsingModel::getLatticeDimensions() {
-    return latticeDimensions;
+ActiveSiteRange IsingModel::getActiveSites() {
+    int p=latticeDimensions.size();
+    const int* first=activeIndices.data();
+    const int* last =first+activeIndices.size();
+    return ActiveSiteRange(
+        ActiveSiteIterator(first,spinValues.data(),siteCoordinates.data(),p),
+        ActiveSiteIterator(last, spinValues.data(),siteCoordinates.data(),p),
+        activeIndices.size());
 }
 
 
@@ -143,9 +319,7 @@ const std::vector<int> IsingModel::getLatticeDimensions() {
  */
 const int IsingModel::getMagnetization() {
     int mag=0;
-    for(const auto &it : spinArray) {
-       mag += it.S*it.active;
-    }
+    for(int i=0; i < nSpins; i++) mag += spinValues[i];
     magnetization=mag;
     return mag;
 }
@@ -153,16 +327,19 @@ const int IsingModel::getMagnetization() {
 
 /* (int) getDistanceSq() 
  *    | Returns the square of the distance between two spins
- *  I | (spin) first spin
- *    | (spin) second spin
+ *  I | (int) index of the first spin
+ *    | (int) index of the second spin
  *  O | (double) distance between the spins, or 1 if distance=0
  */
-double IsingModel::getDistanceSq(spin s1, spin s2) {
+double IsingModel::getDistanceSq(const int i1, const int i2) {
     if(interactionSigma==0) return 1;
     else {
+        int p=latticeDimensions.size();
+        const double* x1 = &siteCoordinates[(size_t) i1*p];
+        const double* x2 = &siteCoordinates[(size_t) i2*p];
         double distance=0;
-        for(int i=0; i < s1.coords.size(); i++) {
-            distance += pow(s1.coords.at(i)-s2.coords.at(i),2);
+        for(int i=0; i < p; i++) {
+            distance += pow(x1[i]-x2[i],2);
         }
         if(distance==0) return 1;
         return distance;
@@ -170,6 +347,103 @@ double IsingModel::getDistanceSq(spin s1, spin s2) {
 }
 
 
+/* (vector<SweepStats>) getSweepHistory
+ *    | Returns the counters of the retained sweeps, oldest first
+ */
+const std::vector<SweepStats> IsingModel::getSweepHistory() {
+    std::vector<SweepStats> history(sweepHistory.size());
+    for(int i=0; i < sweepHistory.size(); i++) history.at(i)=sweepHistory.at(i);
+    return history;
+}
+
+
+/* (vector<double>) getHybridInfo
+ *    | Returns the summed |Delta(beta*H)| of the accepted flips in each
+ *    | retained sweep, oldest first
+ */
+const std::vector<double> IsingModel::getHybridInfo() {
+    std::vector<double> info(sweepHistory.size());
+    for(int i=0; i < sweepHistory.size(); i++) info.at(i)=sweepHistory.at(i).sumAbsDeltaE;
+    return info;
+}
+
+
+/* (double) getAcceptanceRate
+ *    | Returns the fraction of accepted proposals over the retained sweeps
+ */
+const double IsingModel::getAcceptanceRate() {
+    double proposals=0, accepted=0;
+    for(int i=0; i < sweepHistory.size(); i++) {
+        proposals += sweepHistory.at(i).proposals;
+        accepted  += sweepHistory.at(i).accepted;
+    }
+    if(proposals == 0) return 0;
+    return accepted/proposals;
+}
+
+
+/* (double) getNumEffSamples
+ *    | Returns the number of independent samples in the last run,
+ *    | the smaller of the E and |M| estimates
+ */
+const double IsingModel::getNumEffSamples() {
+    return std::min(energyAutocorr.getNumEffSamples(),
+                    absMagAutocorr.getNumEffSamples());
+}
+
+
+/* (Estimate) getMeanEnergy
+ *    | Returns <beta*H> over the measurement phase, with binning error
+ */
+const Estimate IsingModel::getMeanEnergy() {
+    return measurements.getEstimate(kObsE);
+}
+
+
+/* (Estimate) getMeanAbsMagnetization
+ *    | Returns <|M|> over the measurement phase, with binning error
+ */
+const Estimate IsingModel::getMeanAbsMagnetization() {
+    return measurements.getEstimate(kObsAbsM);
+}
+
+
+/* (Estimate) getSpecificHeat
+ *    | Returns the specific heat per spin (units of k_B), 
+ *    | C = (<(beta*H)^2> - <beta*H>^2)/N, with jackknife error
+ */
+const Estimate IsingModel::getSpecificHeat() {
+    double n = nSpins;
+    return measurements.getJackknife([n](const std::vector<double>& x) {
+        return (x.at(kObsE2) - x.at(kObsE)*x.at(kObsE))/n;
+    });
+}
+
+
+/* (Estimate) getSusceptibility
+ *    | Returns the susceptibility per spin, 
+ *    | chi = (<M^2> - <|M|>^2)/(N k_B T), with jackknife error
+ */
+const Estimate IsingModel::getSusceptibility() {
+    double n = nSpins;
+    double t = kbT;
+    return measurements.getJackknife([n,t](const std::vector<double>& x) {
+        return (x.at(kObsM2) - x.at(kObsAbsM)*x.at(kObsAbsM))/(n*t);
+    });
+}
+
+
+/* (Estimate) getBinderCumulant
+ *    | Returns U = 1 - <M^4>/(3 <M^2>^2), with jackknife error
+ */
+const Estimate IsingModel::getBinderCumulant() {
+    return measurements.getJackknife([](const std::vector<double>& x) {
+        if(x.at(kObsM2) == 0) return 0.;
+        return 1 - x.at(kObsM4)/(3*x.at(kObsM2)*x.at(kObsM2));
+    });
+}
+
+
 /* (double) getEffHamiltonian 
  *    | Get the effective energy of the system state (no multithread)
  *  I | (int) single spin to flip 
@@ -182,62 +456,56 @@ const double IsingModel::getEffHamiltonian(const int flip) {
 
 
 /* (double) getEffHamiltonian 
- *    | Get the effective energy of the system state, -(beta*Hamiltonian) (no multithread)
+ *    | Get the effective energy of the system state, beta*Hamiltonian (no multithread)
  *  I | (vector<int> (default: empty)) array of spin indices to flip 
  */
 const double IsingModel::getEffHamiltonian(const std::vector<int>& flips) {
     double energy=0;
     for(int i=0; i<nSpins; i++) {
-        spin s=spinArray.at(i);
-        if (!s.active) continue;
+        int S=spinValues[i];
+        if (S == 0) continue;
         int spinFlip=
             (std::find(flips.begin(),flips.end(),i)!=flips.end() ? -1 : 1);
 
-        energy -= geth()*s.S*spinFlip;
+        energy -= geth()*S*spinFlip;
 
 
         // Nearest neighbor sum, no circular boundary conditions
-        for(int j=0,p=latticeDimensions.size(); j < p; j++) {
-            double indexPM = pow(latticeDimensions.at(j),p-1-j);
-            
-            // get to the left
-            if(i > indexPM-1 && s.coords.at(j) != xmin 
-               && spinArray.at(i-indexPM).coords.at(j) != xmax) {
-                int newIndex=i-indexPM;
+        // (see buildNeighbourTable)
+        for(int n=neighbourOffsets[i]; n < neighbourOffsets[i+1]; n++) {
+            int newIndex=neighbourIndices[n];
 
-                if(spinArray.at(newIndex).active) {
-
-                    int tspinFlip=
-                        (std::find(flips.begin(),flips.end(),newIndex)!=flips.end() ? -1 : 1); 
-    
-                    energy -= getK()*pow(getDistanceSq(s,spinArray.at(newIndex)),interactionSigma/2)
-                              *s.S*spinArray.at(newIndex).S*spinFlip*tspinFlip/2;
-
-                }
-            } 
-
-            // get to the right
-            if(i + indexPM < nSpins && s.coords.at(j) != xmax 
-               && spinArray.at(i+indexPM).coords.at(j) != xmin) {
-                int newIndex=i+indexPM;
-                
-                if(spinArray.at(newIndex).active) {
-            
-                    int tspinFlip=
-                        (std::find(flips.begin(),flips.end(),newIndex)!=flips.end() ? -1 : 1); 
-    
-                    energy -= getK()*pow(getDistanceSq(s,spinArray.at(newIndex)),interactionSigma/2)
-                              *s.S*spinArray.at(newIndex).S*spinFlip*tspinFlip/2;
-
-                }
-            }
+            int tspinFlip=
+                (std::find(flips.begin(),flips.end(),newIndex)!=flips.end() ? -1 : 1); 
 
+            energy -= getK()*neighbourWeights[n]
+                      *S*spinValues[newIndex]*spinFlip*tspinFlip/2;
         }
     }
     return energy;
 }
 
 
+/* (double) getFlipEnergy
+ *    | Effective energy after flipping a single spin. Out of core only the
+ *    | spin's neighbours are read, the change being
+ *    |     2 S_i (h + K sum_j w_ij S_j);
+ *    | otherwise the full sum is recomputed like getEffHamiltonian(i).
+ *  I | (int) spin to flip
+ */
+double IsingModel::getFlipEnergy(const int i) {
+    if(!outOfCore) return getEffHamiltonian(i);
+
+    int S=spinValues[i];
+    if(S == 0) return currentEffH;
+    double field=0;
+    for(int n=neighbourOffsets[i]; n < neighbourOffsets[i+1]; n++) {
+        field += neighbourWeights[n]*spinValues[neighbourIndices[n]];
+    }
+    return currentEffH + 2*S*(geth() + getK()*field);
+}
+
+
 /* (double) computePartitionFunction 
  *    | Get the partition function of the system (no multithread)
  *  I | (int (default: 0)) index to start the trace at 
@@ -291,8 +559,11 @@ void IsingModel::nextPermutation(std::vector<int>& tvN, const int max) {
 
 
 /* (void) addSpins 
- *    | Adds spins to the spinArray by isolating each smallest hypercube
- *    | making up the lattice at a given depth 
+ *    | Adds the spins of the lattice at a given depth, one at each corner
+ *    | of the smallest hypercubes. The fractal is the product of the same
+ *    | construction along every axis, so the corner coordinates are made
+ *    | per axis and the sites stored in row-major order of the sorted axis
+ *    | coordinates (i.e. sorted by their coordinates).
  *  I | (int) depth to build to
  *    | (double) vector of coordinates to start fractal at
  *    | (double) vector of coordinates to end fractal at
@@ -307,56 +578,53 @@ void IsingModel::addSpins(const int depth,
     //double sliceLen = hausdorffScale * delta;
     //double spaceLen = (delta - sliceLen*hausdorffSlices)/(hausdorffSlices-1);
 
-    // Create an array of length dimension, p
-    // Containing arrays of length depth, d
-    // Which will contain our p*d indices 
-    std::vector<int> vN(latticeDimensions.size()*depth);
-
-    // Loop over all valid positions for a spin hypercube
-    for(std::fill(vN.begin(),vN.end(),0); 
-        vN.at(0) != -1; 
-        nextPermutation(vN,hausdorffSlices)) {
-        // Current position is lower corner of hypercube we produce 
-        // (think in terms of the origin for the unit hypercube, [0,1]^p) 
-        std::vector<double> cPos(latticeDimensions.size());
-        for(size_t iDim=0; iDim < latticeDimensions.size(); iDim++) {
-            cPos.at(iDim) += x0.at(iDim);
-            
+    int p=latticeDimensions.size();
+    std::vector<std::vector<double> > axisCoords(p);
+    for(int iDim=0; iDim < p; iDim++) {
+
+        // Loop over all valid positions of a hypercube along this axis,
+        // one slice index per depth
+        std::vector<int> vN(depth);
+        for(std::fill(vN.begin(),vN.end(),0); 
+            vN.at(0) != -1; 
+            nextPermutation(vN,hausdorffSlices)) {
+            // Current position is lower corner of hypercube we produce 
+            // (think in terms of the origin for the unit hypercube, [0,1]^p) 
+            double cPos=0;
+            cPos += x0.at(iDim);
             for(int iDepth=0; iDepth < depth; iDepth++) {
-                int depthVal = vN.at(iDim*depth+iDepth);
+                int depthVal = vN.at(iDepth);
                 double depthScale = pow(hausdorffScale,depth-iDepth)*delta;
-                cPos.at(iDim) += (1 + (1/hausdorffScale-hausdorffSlices)/(hausdorffSlices-1))
-                                 *depthScale
-                                 *depthVal;
+                cPos += (1 + (1/hausdorffScale-hausdorffSlices)/(hausdorffSlices-1))
+                        *depthScale
+                        *depthVal;
             }
-        }
 
-        // - place spins at each corner of a hypercube
-        // - cube will have side length s^d and bottom corner at cPos
-        // - loop will go through e.g. for p=2 (0,0) , (0,1) , (1,0) , (1,1)
-        std::vector<int> cubePoints(latticeDimensions.size());
-        for(std::fill(cubePoints.begin(),cubePoints.end(),0);
-            cubePoints.at(0) != -1;
-            nextPermutation(cubePoints,2)) {
-           
-            spin ts;
-            ts.active=1;
-            ts.S=1;
-            ts.coords=std::vector<double>(latticeDimensions.size());
-            for(size_t index=0; index < cubePoints.size(); index++) {
-                ts.coords.at(index) = cubePoints.at(index) * pow(hausdorffScale,depth)*delta
-                                        + cPos.at(index);
+            // - both corners of a cube with side length s^d and bottom
+            //   corner at cPos
+            for(int cubePoint=0; cubePoint < 2; cubePoint++) {
+                axisCoords.at(iDim).push_back(cubePoint * pow(hausdorffScale,depth)*delta
+                                              + cPos);
             }
-
-
-            spinArray.push_back(ts);
-            nSpins++;
-        } 
+        }
+        std::sort(axisCoords.at(iDim).begin(),axisCoords.at(iDim).end());
     }
 
-    if(debug) std::cout<<"\t\t- spinArray made, sorting..."<<std::endl;
-    QuickSort(spinArray,0,nSpins-1);
+    nSpins=1;
+    for(int iDim=0; iDim < p; iDim++) nSpins *= axisCoords.at(iDim).size();
+    if(debug) std::cout<<"\t\t- "<<nSpins<<" spins"<<std::endl;
 
+    spinValues.assign(nSpins,1,backingDirectory);
+    siteCoordinates.allocate((size_t) nSpins*p,backingDirectory);
+    activeIndices.allocate(nSpins,backingDirectory);
+    for(int i=0; i < nSpins; i++) {
+        for(int j=p-1,rem=i; j >= 0; j--) {
+            int n=axisCoords.at(j).size();
+            siteCoordinates[(size_t) i*p+j] = axisCoords.at(j)[rem % n];
+            rem /= n;
+        }
+        activeIndices[i]=i;
+    }
 }
 
 
@@ -393,11 +661,211 @@ void IsingModel::setup() {
     }
 
     addSpins(latticeDepth,x0,x1);
+    buildNeighbourTable();
+    if(outOfCore) buildSweepOrder();
 
     hasBeenSetup=true;
 }
 
 
+/* (int) getNeighbour
+ *    | Nearest neighbour of a spin one step along an axis, with the same
+ *    | boundary conditions as always (open, no wrapping along any axis)
+ *  I | (int) spin index
+ *    | (int) axis
+ *    | (int) direction, -1 or +1
+ *  O | (int) index of the neighbour, -1 if there is no active one
+ */
+int IsingModel::getNeighbour(const int i, const int j, const int dir) {
+    int p=latticeDimensions.size();
+    int indexPM = pow(latticeDimensions.at(j),p-1-j);
+    double x = siteCoordinates[(size_t) i*p+j];
+
+    // get to the left
+    if(dir < 0 && i > indexPM-1 && x != xmin
+       && siteCoordinates[(size_t) (i-indexPM)*p+j] != xmax
+       && spinValues[i-indexPM] != 0) return i-indexPM;
+
+    // get to the right
+    if(dir > 0 && i + indexPM < nSpins && x != xmax
+       && siteCoordinates[(size_t) (i+indexPM)*p+j] != xmin
+       && spinValues[i+indexPM] != 0) return i+indexPM;
+
+    return -1;
+}
+
+
+/* (void) buildNeighbourTable
+ *    | Store the nearest neighbours of each spin (CSR, left then right
+ *    | along each axis). The degrees are counted first, so every list is
+ *    | allocated once at its final size.
+ */
+void IsingModel::buildNeighbourTable() {
+    int p=latticeDimensions.size();
+
+    neighbourOffsets.allocate(nSpins+1,backingDirectory);
+    for(int i=0; i<nSpins; i++) {
+        int degree=0;
+        for(int j=0; j < p && spinValues[i] != 0; j++) {
+            degree += (getNeighbour(i,j,-1) >= 0) + (getNeighbour(i,j,+1) >= 0);
+        }
+        neighbourOffsets[i+1] = neighbourOffsets[i] + degree;
+    }
+
+    neighbourIndices.allocate(neighbourOffsets[nSpins],backingDirectory);
+    neighbourWeights.allocate(neighbourOffsets[nSpins],backingDirectory);
+    for(int i=0; i<nSpins; i++) {
+        int n=neighbourOffsets[i];
+        for(int j=0; j < p && spinValues[i] != 0; j++) {
+            for(int dir=-1; dir <= 1; dir += 2) {
+                int k=getNeighbour(i,j,dir);
+                if(k < 0) continue;
+                neighbourIndices[n] = k;
+                neighbourWeights[n] = pow(getDistanceSq(i,k),interactionSigma/2);
+                n++;
+            }
+        }
+    }
+}
+
+
+/* (void) buildSweepOrder
+ *    | Order in which single-spin sweeps visit the sites out of core:
+ *    | tile by tile, a tile being one level-k cell of the fractal
+ *    | (2 s^k sites along each axis), row-major within a tile. Tiles are
+ *    | grouped in bands along the first axis, each band a contiguous range
+ *    | of the arrays. By default k is the largest level with at most 2^16
+ *    | sites per tile.
+ */
+void IsingModel::buildSweepOrder() {
+    int p=latticeDimensions.size();
+    int slices=hausdorffSlices;
+    int L=latticeDimensions.at(0);
+
+    sweepTileLevel=0;
+    for(int k=1; k <= latticeDepth; k++) {
+        if(requestedTileLevel >= 0 ? k <= requestedTileLevel
+                                   : pow(2*pow(slices,k),p) <= 65536) sweepTileLevel=k;
+    }
+    int tileLength = 2*pow(slices,sweepTileLevel);
+    int tilesPerAxis = L/tileLength;
+    long tileSites = pow(tileLength,p);
+    sweepBandSites = (long) nSpins/tilesPerAxis;
+
+    sweepOrder.allocate(nSpins,backingDirectory);
+    for(int i=0; i < nSpins; i++) {
+        long tile=0, rank=0;
+        for(int j=0,rem=i; j < p; j++) {
+            int stride = pow(L,p-1-j);
+            int a = rem/stride;
+            rem %= stride;
+            tile = tile*tilesPerAxis + a/tileLength;
+            rank = rank*tileLength   + a%tileLength;
+        }
+        sweepOrder[tile*tileSites+rank] = i;
+    }
+
+    // Only the sweeps run from here on, and they go band by band
+    siteCoordinates.advise(MappedArray<double>::kDontNeed);
+    activeIndices.advise(MappedArray<int>::kDontNeed);
+    if(debug) std::cout<<"\t\t- Out-of-core sweeps in level-"<<sweepTileLevel
+                       <<" tiles ("<<tileSites<<" sites)"<<std::endl;
+}
+
+
+/* (void) adviseSweepWindow
+ *    | Paging hints at the start of each band of tiles: prefetch the band
+ *    | and the rows next to it, drop the band before the previous one
+ *  I | (long) position in the sweep order
+ */
+void IsingModel::adviseSweepWindow(const long n) {
+    if(sweepBandSites <= 0 || n % sweepBandSites != 0) return;
+    long first = n;
+    long last  = std::min(n+sweepBandSites,(long) nSpins);
+    long halo  = nSpins/latticeDimensions.at(0);
+
+    long from = std::max(first-halo,0L);
+    long to   = std::min(last+halo,(long) nSpins);
+    spinValues.advise(MappedArray<int>::kWillNeed,from,to-from);
+    neighbourOffsets.advise(MappedArray<int>::kWillNeed,first,last-first+1);
+    long nbrFirst = neighbourOffsets[first];
+    long nbrLast  = neighbourOffsets[last];
+    neighbourIndices.advise(MappedArray<int>::kWillNeed,nbrFirst,nbrLast-nbrFirst);
+    neighbourWeights.advise(MappedArray<double>::kWillNeed,nbrFirst,nbrLast-nbrFirst);
+
+    if(first < 2*sweepBandSites) return;
+    long oldFirst = first-2*sweepBandSites;
+    long oldLast  = first-sweepBandSites-halo;
+    if(oldLast <= oldFirst) return;
+    spinValues.advise(MappedArray<int>::kDontNeed,oldFirst,oldLast-oldFirst);
+    neighbourOffsets.advise(MappedArray<int>::kDontNeed,oldFirst,oldLast-oldFirst);
+    long nbrOldFirst = neighbourOffsets[oldFirst];
+    long nbrOldLast  = neighbourOffsets[oldLast];
+    neighbourIndices.advise(MappedArray<int>::kDontNeed,nbrOldFirst,nbrOldLast-nbrOldFirst);
+    neighbourWeights.advise(MappedArray<double>::kDontNeed,nbrOldFirst,nbrOldLast-nbrOldFirst);
+}
+
+
+/* (void) buildEmbedding
+ *    | Map every spin onto a grid padded to a power of two >= twice the
+ *    | lattice size along each axis, so that FFT-based pair sums do not
+ *    | wrap around the open boundaries
+ */
+void IsingModel::buildEmbedding() {
+    if(!embeddedIndex.empty()) return;
+    int p=latticeDimensions.size();
+    embeddingDimensions.resize(p);
+    for(int j=0; j < p; j++) {
+        embeddingDimensions.at(j) = FFTPlan::nextPowerOfTwo(2*latticeDimensions.at(j));
+    }
+
+    embeddedIndex.resize(nSpins);
+    for(int i=0; i < nSpins; i++) {
+        int index=0;
+        for(int j=0,rem=i; j < p; j++) {
+            int stride = pow(latticeDimensions.at(j),p-1-j);
+            index = index*embeddingDimensions.at(j) + rem/stride;
+            rem %= stride;
+        }
+        embeddedIndex.at(i)=index;
+    }
+
+    embeddingFFT.setDimensions(embeddingDimensions);
+}
+
+
+/* (void) setupCorrelations
+ *    | Prepare the correlation accumulator for the current lattice
+ */
+void IsingModel::setupCorrelations() {
+    if(debug) std::cout<<"\t\t- Preparing correlation measurements"<<std::endl;
+    buildEmbedding();
+
+    std::vector<int> active(nSpins);
+    for(int i=0; i < nSpins; i++) active.at(i) = (spinValues[i] != 0);
+
+    correlation.setup(embeddingDimensions,embeddedIndex,active,
+                      neighbourOffsets,neighbourIndices,&embeddingFFT);
+    hasCorrelationSetup=true;
+}
+
+
+/* (void) setupStructureFactor
+ *    | Prepare the structure factor accumulator for the current lattice
+ */
+void IsingModel::setupStructureFactor() {
+    if(debug) std::cout<<"\t\t- Preparing structure factor measurements"<<std::endl;
+    buildEmbedding();
+
+    std::vector<int> active(nSpins);
+    for(int i=0; i < nSpins; i++) active.at(i) = (spinValues[i] != 0);
+
+    structureFactor.setup(embeddingDimensions,latticeDimensions,
+                          siteCoordinates,active);
+    hasStructureFactorSetup=true;
+}
+
+
 /* (void) runMonteCarlo 
  *    | Run the Monte Carlo simulation (spin-flipping) 
  */
@@ -409,24 +877,67 @@ void IsingModel::runMonteCarlo() {
     }
     
     // Various utils 
-    TRandom3* rNG = new TRandom3(); 
-
-    currentEffH=getEffHamiltonian();
-    double avgAbsDeltaE=-1;
-    int nSpinsPerThread = floor(nSpins/nThreads);
+    RandomGenerator* rNG = &rng;
     int cNumThreads=nThreads;
     //std::vector<boost::thread*> threads;
 
+    if(correlationInterval > 0 && !hasCorrelationSetup) setupCorrelations();
+    if(structureFactorInterval > 0 && !hasStructureFactorSetup) setupStructureFactor();
+    if(clusterInterval > 0 && !hasClusterSetup) {
+        std::vector<int> active(nSpins);
+        for(int i=0; i < nSpins; i++) active.at(i) = (spinValues[i] != 0);
+        clusters.setup(latticeDimensions,neighbourOffsets,neighbourIndices,
+                       neighbourWeights,active);
+        hasClusterSetup=true;
+    }
+    if(siteMapInterval > 0) siteMaps.setup(neighbourOffsets,neighbourIndices);
+    if(blockInterval > 0) {
+        std::vector<int> active(nSpins);
+        for(int i=0; i < nSpins; i++) active.at(i) = (spinValues[i] != 0);
+        blockSpins.setup(latticeDimensions,hausdorffSlices,latticeDepth,active);
+    }
+
+    // Continue from the checkpoint if there is one, else start afresh
+    if(checkpointFile.empty() || !readCheckpoint(checkpointFile)) {
+        rng.SetSeed(seed);
+        clusters.setSeed(RandomGenerator::deriveSeed(seed,kClusterStream));
+        currentEffH=getEffHamiltonian();
+        nSpinsPerThread = floor(nSpins/nThreads);
+
+        energyAutocorr.reset();
+        absMagAutocorr.reset();
+        burnInDetector.reset();
+        measurements.reset();
+        sweepHistory.clear();
+        correlation.reset();
+        structureFactor.reset();
+        clusters.reset();
+        siteMaps.reset();
+        blockSpins.reset();
+        nSweeps=0;
+        nBurnInSweeps=0;
+        isEquilibrated=false;
+        burningIn=autoEquilibrate;
+        nextCheck=100;
+        runComplete=false;
+    } else if(debug) {
+        std::cout<<"\t\t- Resuming from "<<checkpointFile
+                 <<" at sweep "<<nSweeps<<std::endl;
+    }
+
+    if(!runComplete) openStreams();
+    std::chrono::steady_clock::time_point lastCheckpoint = std::chrono::steady_clock::now();
+
     // Start performing MC steps
-    for(int i=0; i < nMCSteps; i++) {
+    while(!runComplete && nSweeps < nMCSteps) {
         if(debug && nMCSteps < 100) std::cout<<"\t\t At MC Step "
-                                             <<i<<"/"<<nMCSteps<<std::endl;
+                                             <<nSweeps<<"/"<<nMCSteps<<std::endl;
 
-
-        double newAvgAbsDeltaE=0;
-        for(int iDE=0,lMCI=mcInfo.size(); iDE < lMCI; iDE++)
-             newAvgAbsDeltaE+=(mcInfo.at(iDE));
-        mcInfo.clear();
+        // Sum |Delta E| of the last two sweeps, for the HYBRID heuristic
+        int nHistory=sweepHistory.size();
+        double newAvgAbsDeltaE = nHistory > 0 ? sweepHistory.at(nHistory-1).sumAbsDeltaE : 0;
+        double avgAbsDeltaE    = nHistory > 1 ? sweepHistory.at(nHistory-2).sumAbsDeltaE : -1;
+        sweepStats=SweepStats();
 
         //std::cout<<" - "<<newAvgAbsDeltaE<<" "<<avgAbsDeltaE<<std::endl;
 
@@ -451,13 +962,13 @@ void IsingModel::runMonteCarlo() {
                                         || newAvgAbsDeltaE <= avgAbsDeltaE  // if we are converging on minimum
                                         || newAvgAbsDeltaE==0)) {          // if nothing is changing (stuck)
                 nSpinsPerThread /= 2;
-                nSpinsPerThread=max(nSpinsPerThread,1);
+                nSpinsPerThread=std::max(nSpinsPerThread,1);
                 if(debug) std::cout<<"\t\tHYBRID: Increasing granularity to "
                                     <<nSpinsPerThread<<" spins / thread"<<std::endl;
             // if energy change is moderate and magnetization is low, more spins/thread
             } else if(nSpinsPerThread >= 1 && abs(magnetization) < nSpins/2) {   
                 nSpinsPerThread *= 2;
-                nSpinsPerThread=max(nSpinsPerThread,1);
+                nSpinsPerThread=std::max(nSpinsPerThread,1);
                 if(debug) std::cout<<"\t\tHYBRID: Decreasing granularity to "
                                     <<nSpinsPerThread<<" spins / thread"<<std::endl;   
             }
@@ -498,25 +1009,367 @@ void IsingModel::runMonteCarlo() {
             //}
         }
 
+        sweepHistory.push(sweepStats);
+        nSweeps++;
+
+        // Burn-in: feed the detector until it (or the cap at half of the
+        // allowed sweeps) ends the phase. All burn-in sweeps are discarded.
+        if(burningIn) {
+            burnInDetector.add(currentEffH);
+            nBurnInSweeps=nSweeps;
+            isEquilibrated = burnInDetector.isEquilibrated();
+            if(isEquilibrated || 2*nSweeps >= nMCSteps) {
+                burningIn=false;
+                if(debug) std::cout<<"\t\t- Burn-in "
+                                   <<(isEquilibrated ? "detected" : "capped")
+                                   <<" after "<<nBurnInSweeps<<" sweeps"<<std::endl;
+            }
+        } else {
+            measure();
+
+            // Checking tau_int costs an FFT of the series, so only do it
+            // each time the series has grown by 25%
+            int nMeasured = energyAutocorr.getNumSamples();
+            if(targetEffSamples > 0 && nMeasured >= nextCheck) {
+                nextCheck = nMeasured + nMeasured/4;
+                if(hasEnoughSamples()) {
+                    if(debug) std::cout<<"\t\t- Reached "<<getNumEffSamples()
+                                       <<" independent samples after "
+                                       <<nSweeps<<" sweeps"<<std::endl;
+                    runComplete=true;
+                }
+            }
+        }
 
-        if(avgAbsDeltaE >= 0) hybridInfo.push_back(avgAbsDeltaE);
-        avgAbsDeltaE=newAvgAbsDeltaE;   
-            
+        // Periodic checkpoint. The output streams are closed first, so
+        // everything up to this sweep is complete on disk, and continue
+        // in a new segment.
+        if(!checkpointFile.empty() && checkpointInterval > 0 && !runComplete
+           && std::chrono::duration<double>(std::chrono::steady_clock::now()
+                                            - lastCheckpoint).count() >= checkpointInterval) {
+            closeStreams();
+            writeCheckpoint(checkpointFile);
+            openStreams();
+            lastCheckpoint = std::chrono::steady_clock::now();
+        }
     }
 
-    delete rNG;
+    runComplete=true;
+    closeStreams();
+    if(!checkpointFile.empty()) writeCheckpoint(checkpointFile);
+}
+
+
+/* (void) openStreams
+ *    | Open the time-series and snapshot outputs. Later segments of a run
+ *    | (after a checkpoint) get the starting sweep appended to the name.
+ */
+void IsingModel::openStreams() {
+    std::string suffix = nSweeps > 0 ? "."+std::to_string(nSweeps) : "";
+    if(!sweepOutputFile.empty()) {
+        sweepWriter.open(sweepOutputFile+suffix,{"sweep","betaH","M","acceptance","absDeltaE"});
+    }
+    if(snapshotInterval > 0 && !snapshotFile.empty()) {
+        snapshotWriter.open(snapshotFile+suffix,nSpins);
+    }
+}
+
+
+/* (void) closeStreams
+ */
+void IsingModel::closeStreams() {
+    sweepWriter.close();
+    snapshotWriter.close();
+}
+
+
+/* (ull) getGeometryHash
+ *    | FNV-1a hash of the lattice: dimensions, scaling, coupling range
+ *    | and the coordinates and activity of every site
+ */
+const unsigned long long IsingModel::getGeometryHash() {
+    unsigned long long h=StateIO::hash(nSpins,14695981039346656037ULL);
+    h=StateIO::hash(latticeDepth,h);
+    h=StateIO::hash(hausdorffDim,h);
+    h=StateIO::hash(hausdorffSlices,h);
+    h=StateIO::hash(hausdorffScale,h);
+    h=StateIO::hash(interactionSigma,h);
+    for(size_t j=0; j < latticeDimensions.size(); j++) h=StateIO::hash(latticeDimensions[j],h);
+    int p=latticeDimensions.size();
+    for(int i=0; i < nSpins; i++) {
+        bool active = (spinValues[i] != 0);
+        h=StateIO::hash(active,h);
+        for(int j=0; j < p; j++) {
+            h=StateIO::hash(siteCoordinates[(size_t) i*p+j],h);
+        }
+    }
+    return h;
+}
+
+
+/* (ull) getSettingsHash
+ *    | FNV-1a hash of everything else that determines a trajectory:
+ *    | couplings, temperature, method, seed, starting spins, run length
+ *    | and measurements
+ */
+const unsigned long long IsingModel::getSettingsHash() {
+    unsigned long long h=StateIO::hash(kbT,14695981039346656037ULL);
+    h=StateIO::hash(H,h);
+    h=StateIO::hash(J,h);
+    h=StateIO::hash(mcMethod,h);
+    h=StateIO::hash(seed,h);
+    h=StateIO::hash(startHash,h);
+    h=StateIO::hash(nThreads,h);
+    h=StateIO::hash(nMCSteps,h);
+    h=StateIO::hash(targetEffSamples,h);
+    h=StateIO::hash(autoEquilibrate,h);
+    h=StateIO::hash(correlationInterval,h);
+    h=StateIO::hash(structureFactorInterval,h);
+    h=StateIO::hash(structureFactor.getNumWaveVectors(),h);
+    h=StateIO::hash(clusterInterval,h);
+    h=StateIO::hash(siteMapInterval,h);
+    h=StateIO::hash(blockInterval,h);
+    if(outOfCore) h=StateIO::hash(requestedTileLevel,h);
+    return h;
+}
+
+
+/* (ull) getConfigurationHash
+ *    | FNV-1a hash identifying the results of a run, available before
+ *    | setup: code version, the parameters the lattice is built from and
+ *    | the run settings. Key of the ResultStore.
+ */
+const unsigned long long IsingModel::getConfigurationHash() {
+    unsigned long long h=StateIO::hash(resultsVersion,14695981039346656037ULL);
+    h=StateIO::hash(hausdorffMethod,h);
+    h=StateIO::hash(hausdorffDim,h);
+    h=StateIO::hash(hausdorffSlices,h);
+    if(hausdorffMethod != "SCALING") h=StateIO::hash(hausdorffScale,h);
+    h=StateIO::hash(latticeDepth,h);
+    h=StateIO::hash(interactionSigma,h);
+    h=StateIO::hash(getSettingsHash(),h);
+    return h;
+}
+
+
+/* (void) writeCheckpoint
+ *    | Save the complete run state. The file is written under a temporary
+ *    | name, synced and renamed, so an eviction never leaves a partial file.
+ *  I | (string) checkpoint file name
+ */
+void IsingModel::writeCheckpoint(const std::string& fileName) {
+    std::ostringstream os(std::ios::binary);
+    os.write(checkpointMagic,8);
+    StateIO::write(os,checkpointVersion);
+    StateIO::write(os,getGeometryHash());
+    StateIO::write(os,getSettingsHash());
+
+    StateIO::write(os,spinValues.view().toVector());
+    StateIO::write(os,currentEffH);
+    StateIO::write(os,magnetization);
+    rng.writeState(os);
+    StateIO::write(os,nSweeps);
+    StateIO::write(os,nBurnInSweeps);
+    StateIO::write(os,isEquilibrated);
+    StateIO::write(os,burningIn);
+    StateIO::write(os,nextCheck);
+    StateIO::write(os,nSpinsPerThread);
+    StateIO::write(os,runComplete);
+    StateIO::write(os,sweepStats);
+    sweepHistory.writeState(os);
+
+    energyAutocorr.writeState(os);
+    absMagAutocorr.writeState(os);
+    burnInDetector.writeState(os);
+    measurements.writeState(os);
+    correlation.writeState(os);
+    structureFactor.writeState(os);
+    clusters.writeState(os);
+    siteMaps.writeState(os);
+    blockSpins.writeState(os);
+
+    std::string data=os.str();
+    std::string tmpName=fileName+".tmp";
+    FILE* file=fopen(tmpName.c_str(),"wb");
+    bool ok = file && fwrite(data.data(),1,data.size(),file) == data.size();
+    ok = file && fflush(file) == 0 && fsync(fileno(file)) == 0 && ok;
+    if(file) fclose(file);
+    if(!ok || rename(tmpName.c_str(),fileName.c_str()) != 0) {
+        std::cout<<"WARNING: Could not write checkpoint "<<fileName<<std::endl;
+        return;
+    }
+    if(debug) std::cout<<"\t\t- Checkpoint at sweep "<<nSweeps<<std::endl;
+}
+
+
+/* (bool) readCheckpoint
+ *    | Restore the run state written by writeCheckpoint. The measurement
+ *    | accumulators must already be set up.
+ *  I | (string) checkpoint file name
+ *  O | (bool) false if there is no checkpoint to resume from
+ */
+bool IsingModel::readCheckpoint(const std::string& fileName) {
+    std::ifstream file(fileName.c_str(),std::ios::binary);
+    if(!file) return false;
+    std::stringstream is(std::ios::in | std::ios::out | std::ios::binary);
+    is<<file.rdbuf();
+
+    char magic[8];
+    unsigned int version=0;
+    unsigned long long geometryHash=0, settingsHash=0;
+    is.read(magic,8);
+    StateIO::read(is,version);
+    StateIO::read(is,geometryHash);
+    StateIO::read(is,settingsHash);
+    if(!is || memcmp(magic,checkpointMagic,8) != 0 || version != checkpointVersion) {
+        std::cout<<"ERROR: "<<fileName<<" is not a checkpoint of this version"<<std::endl;
+        exit(EXIT_FAILURE);
+    }
+    if(geometryHash != getGeometryHash()) {
+        std::cout<<"ERROR: Checkpoint "<<fileName<<" is for a different lattice"<<std::endl;
+        exit(EXIT_FAILURE);
+    }
+    if(settingsHash != getSettingsHash()) {
+        std::cout<<"ERROR: Checkpoint "<<fileName<<" is for different run settings"<<std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    std::vector<int> spins;
+    StateIO::read(is,spins);
+    for(int i=0; i < nSpins && i < (int) spins.size(); i++) setSpin(i,spins.at(i));
+    StateIO::read(is,currentEffH);
+    StateIO::read(is,magnetization);
+    rng.readState(is);
+    StateIO::read(is,nSweeps);
+    StateIO::read(is,nBurnInSweeps);
+    StateIO::read(is,isEquilibrated);
+    StateIO::read(is,burningIn);
+    StateIO::read(is,nextCheck);
+    StateIO::read(is,nSpinsPerThread);
+    StateIO::read(is,runComplete);
+    StateIO::read(is,sweepStats);
+    sweepHistory.readState(is);
+
+    energyAutocorr.readState(is);
+    absMagAutocorr.readState(is);
+    burnInDetector.readState(is);
+    measurements.readState(is);
+    correlation.readState(is);
+    structureFactor.readState(is);
+    clusters.readState(is);
+    siteMaps.readState(is);
+    blockSpins.readState(is);
+
+    if(!is || (int) spins.size() != nSpins) {
+        std::cout<<"ERROR: Checkpoint "<<fileName<<" is truncated"<<std::endl;
+        exit(EXIT_FAILURE);
+    }
+    return true;
+}
+
+
+/* (void) measure
+ *    | Record the per-sweep observables 
+ */
+void IsingModel::measure() {
+    double m = getMagnetization();
+    energyAutocorr.add(currentEffH);
+    absMagAutocorr.add(fabs(m));
+
+    // The effective Hamiltonian is beta*H itself
+    std::vector<double> obs(kNumObs);
+    obs.at(kObsE)    = currentEffH;
+    obs.at(kObsE2)   = currentEffH*currentEffH;
+    obs.at(kObsAbsM) = fabs(m);
+    obs.at(kObsM2)   = m*m;
+    obs.at(kObsM4)   = m*m*m*m;
+    measurements.add(obs);
+
+    if(sweepWriter.isOpen()) {
+        sweepRow.assign(5,0);
+        sweepRow.at(0) = nSweeps;
+        sweepRow.at(1) = currentEffH;
+        sweepRow.at(2) = m;
+        sweepRow.at(3) = sweepStats.proposals > 0 ?
+                         (double) sweepStats.accepted/sweepStats.proposals : 0;
+        sweepRow.at(4) = sweepStats.sumAbsDeltaE;
+        sweepWriter.add(sweepRow);
+    }
+
+    long nMeasured = measurements.getNumSamples();
+    bool doCorrelation     = correlationInterval > 0
+                             && nMeasured % correlationInterval == 0;
+    bool doStructureFactor = structureFactorInterval > 0
+                             && nMeasured % structureFactorInterval == 0;
+    if(doCorrelation || doStructureFactor) {
+        measureEmbeddedField(doCorrelation,doStructureFactor);
+    }
+
+    if(clusterInterval > 0 && nMeasured % clusterInterval == 0) {
+        clusters.accumulate(spinValues,getK());
+    }
+
+    if(siteMapInterval > 0 && nMeasured % siteMapInterval == 0) {
+        siteMaps.accumulate(spinValues);
+    }
+
+    if(blockInterval > 0 && nMeasured % blockInterval == 0) {
+        blockSpins.accumulate(spinValues);
+    }
+
+    if(snapshotWriter.isOpen() && nMeasured % snapshotInterval == 0) {
+        snapshotWriter.add(spinValues,nSweeps);
+    }
+}
+
+
+/* (void) measureEmbeddedField
+ *    | Transform the embedded spin field once and hand the spectrum to
+ *    | the correlation and/or structure factor accumulators
+ *  I | (bool) whether to accumulate the correlation function
+ *    | (bool) whether to accumulate the structure factor
+ */
+void IsingModel::measureEmbeddedField(const bool doCorrelation,
+                                      const bool doStructureFactor) {
+    ConstView<int> spins = spinValues;
+
+    embeddedField.assign(embeddingFFT.getSize(),0);
+    for(int i=0; i < nSpins; i++) embeddedField[embeddedIndex[i]] = spins[i];
+    embeddingFFT.forward(embeddedField);
+
+    if(doCorrelation)     correlation.accumulate(spins,embeddedField);
+    if(doStructureFactor) structureFactor.accumulate(spins,embeddedField);
+}
+
+
+/* (bool) hasEnoughSamples
+ *    | Whether the run has collected targetEffSamples independent samples.
+ *    | The tau_int estimate is only trusted once the run is much longer 
+ *    | than tau_int itself (50x, as recommended by Sokal).
+ */
+bool IsingModel::hasEnoughSamples() {
+    double tauE = energyAutocorr.getTauInt();
+    double tauM = absMagAutocorr.getTauInt();
+    if(energyAutocorr.getNumSamples() < 50*std::max(tauE,tauM)) return false;
+
+    return getNumEffSamples() >= targetEffSamples;
 }
 
 
 /* (void) metropolisStep 
  *    | Perform one run over the lattice, using Metropolis acceptance function
- *  I | (TRandom3*) pointer to random number generator
+ *  I | (RandomGenerator*) pointer to random number generator
  */
-double IsingModel::metropolisStep(TRandom3* rNG) {
+double IsingModel::metropolisStep(RandomGenerator* rNG) {
 
     // loop over spins
-    for(int i=0; i < nSpins; i++) {
-        double tE = getEffHamiltonian(i);
+    for(int n=0; n < nSpins; n++) {
+        int i=n;
+        if(outOfCore) {
+            adviseSweepWindow(n);
+            i=sweepOrder[n];
+        }
+        double tE = getFlipEnergy(i);
         bool spinFlip=false;
 
         //std::cout<<"\t\t\t-F= "<<currentEffH<<", vs temp: "<<tE<<std::endl;
@@ -524,26 +1377,36 @@ double IsingModel::metropolisStep(TRandom3* rNG) {
         if(tE-currentEffH<0) spinFlip = true;
         else spinFlip = (rNG->Uniform() < exp(currentEffH-tE));
 
+        sweepStats.proposals++;
         if(spinFlip) {
-            spinArray.at(i).S=-spinArray.at(i).S;
-            mcInfo.push_back(abs(tE-currentEffH));            
+            setSpin(i,-spinValues[i]);
+            sweepStats.accepted++;
+            sweepStats.sumAbsDeltaE += fabs(tE-currentEffH);
             currentEffH=tE;
         }
     }
 
+    // Local updates accumulate rounding, resynchronize once per sweep
+    if(outOfCore) currentEffH=getEffHamiltonian();
+
     return currentEffH;
 }
 
 
 /* (void) heatBathStep 
  *    | Perform one run over the lattice, using the Heat Bath acceptance function
- *  I | (TRandom3*) pointer to random number generator
+ *  I | (RandomGenerator*) pointer to random number generator
  */
-double IsingModel::heatBathStep(TRandom3* rNG) {
+double IsingModel::heatBathStep(RandomGenerator* rNG) {
 
     // loop over spins
-    for(int i=0; i < nSpins; i++) {
-        double tE = getEffHamiltonian(i);
+    for(int n=0; n < nSpins; n++) {
+        int i=n;
+        if(outOfCore) {
+            adviseSweepWindow(n);
+            i=sweepOrder[n];
+        }
+        double tE = getFlipEnergy(i);
 
         //std::cout<<"\t\t\t-F= "<<currentEffH<<", vs temp: "<<tE<<std::endl;
 
@@ -557,13 +1420,17 @@ double IsingModel::heatBathStep(TRandom3* rNG) {
             spinFlip = (rNG->Uniform() < acceptance);
         }
 
+        sweepStats.proposals++;
         if(spinFlip) {
-            spinArray.at(i).S=-spinArray.at(i).S;
-            mcInfo.push_back(abs(tE-currentEffH));
+            setSpin(i,-spinValues[i]);
+            sweepStats.accepted++;
+            sweepStats.sumAbsDeltaE += fabs(tE-currentEffH);
             currentEffH=tE;
         }
     }
 
+    // Local updates accumulate rounding, resynchronize once per sweep
+    if(outOfCore) currentEffH=getEffHamiltonian();
 
     return currentEffH;
 }
@@ -581,11 +1448,13 @@ void IsingModel::hybridStep(const double rng, const std::vector<int>& spinFlips)
     if(tE-currentEffH<0) spinFlip=true;
     else spinFlip = (rng < exp(currentEffH-tE));
         
+    sweepStats.proposals++;
     if(spinFlip) {
         for(size_t i=0; i<spinFlips.size(); i++) {
-            spinArray.at(spinFlips.at(i)).S=-spinArray.at(spinFlips.at(i)).S;
+            setSpin(spinFlips[i],-spinValues[spinFlips[i]]);
         }
-        mcInfo.push_back(abs(tE-currentEffH));
+        sweepStats.accepted++;
+        sweepStats.sumAbsDeltaE += fabs(tE-currentEffH);
         currentEffH=tE;
     }
 
@@ -597,14 +1466,36 @@ void IsingModel::hybridStep(const double rng, const std::vector<int>& spinFlips)
  */
 void IsingModel::reset() {
     if(debug) std::cout<<"\tReset:"<<std::endl;
-    spinArray.clear();
-    hybridInfo.clear();
-    mcInfo.clear();
+    spinValues.release();
+    siteCoordinates.release();
+    activeIndices.release();
+    sweepOrder.release();
+    sweepHistory.clear();
     latticeDimensions.clear();
+    neighbourOffsets.release();
+    neighbourIndices.release();
+    neighbourWeights.release();
+    embeddedIndex.clear();
+    embeddedField.clear();
+    hasCorrelationSetup=false;
+    hasStructureFactorSetup=false;
+    hasClusterSetup=false;
+    correlation.reset();
+    structureFactor.reset();
+    clusters.reset();
+    siteMaps.setup(neighbourOffsets,neighbourIndices);
+    blockSpins.reset();
+    energyAutocorr.reset();
+    absMagAutocorr.reset();
+    burnInDetector.reset();
+    measurements.reset();
 
     magnetization=0;
     currentEffH=0;
     nSpins=0;
+    nSweeps=0;
+    nBurnInSweeps=0;
+    isEquilibrated=false;
 
     hasBeenSetup=false;
 }
@@ -622,6 +1513,38 @@ void IsingModel::status() {
     std::cout<<"\t\t| Number of spins: "<<getNumSpins()          <<std::endl;
     std::cout<<"\t\t| MC Method:       "<<getMCMethod()          <<std::endl;
     std::cout<<"\t\t| Number MC steps: "<<getNumMCSteps()        <<std::endl;
+    std::cout<<"\t\t| Sweeps run:      "<<getNumSweeps()         <<std::endl;
+    std::cout<<"\t\t| Acceptance rate: "<<getAcceptanceRate()     <<std::endl;
+    std::cout<<"\t\t| Burn-in sweeps:  "<<getNumBurnInSweeps()
+                                         <<(getIsEquilibrated() ? "" : " (not detected)")
+                                         <<std::endl;
+    std::cout<<"\t\t| Specific heat:   "<<getSpecificHeat().value<<" +- "
+                                         <<getSpecificHeat().error<<std::endl;
+    std::cout<<"\t\t| Susceptibility:  "<<getSusceptibility().value<<" +- "
+                                         <<getSusceptibility().error<<std::endl;
+    std::cout<<"\t\t| Binder cumulant: "<<getBinderCumulant().value<<" +- "
+                                         <<getBinderCumulant().error<<std::endl;
+    if(correlationInterval > 0)
+        std::cout<<"\t\t| Corr. length:    "<<getCorrelationLength()<<std::endl;
+    if(structureFactorInterval > 0)
+        std::cout<<"\t\t| S(k) corr. len.: "<<getStructureFactorLength()<<std::endl;
+    if(clusterInterval > 0) {
+        std::cout<<"\t\t| Largest FK/dom.: "
+                 <<clusters.getLargestFraction(ClusterAnalysis::kFKClusters)<<", "
+                 <<clusters.getLargestFraction(ClusterAnalysis::kDomains)<<std::endl;
+        std::cout<<"\t\t| Spanning FK/dom: "
+                 <<clusters.getSpanningProbability(ClusterAnalysis::kFKClusters)<<", "
+                 <<clusters.getSpanningProbability(ClusterAnalysis::kDomains)<<std::endl;
+    }
+    if(blockInterval > 0) {
+        for(int k=0; k < blockSpins.getNumLevels(); k++) {
+            std::cout<<"\t\t| Level "<<k<<" U, R:    "
+                     <<blockSpins.getBinderCumulant(k).value<<", "
+                     <<blockSpins.getCorrelationRatio(k).value<<std::endl;
+        }
+    }
+    std::cout<<"\t\t| tau_int (E,|M|): "<<getTauIntEnergy()<<", "
+                                         <<getTauIntMagnetization()<<std::endl;
     std::cout<<"\t\t| Number threads:  "<<getNumThreads()        <<std::endl;
     std::cout<<"\t\t|                  "<<getNumThreads()        <<std::endl;
     std::cout<<"\t\t| Beta * Hamiltonian: "<<"-1/"<<kbT<<" * "    <<std::endl;
@@ -635,65 +1558,18 @@ void IsingModel::status() {
 }
 
 
-/* (void) swap (for QUICKSORT)
- *    | Swap two spins in an array
- */
-void IsingModel::swap(spin* a, spin* b) {
-    spin t = *a;
-    *a = *b;
-    *b = t;
-}
-
-
-/* (void) QSPartition (for QUICKSORT)
- *    | Splits the sort into a sort within a small range
- */
- int IsingModel::QSPartition (std::vector<spin>& vec, int low, int high) {
-    spin pivot = vec[high];
-    int i = (low - 1);
-
-    for (int j = low; j <= high - 1; j++)
-    {
-        if (!(vec[j] > pivot)) {
-            i++;
-            swap(&vec[i], &vec[j]);
-        }
-    }
-    swap(&vec[i + 1], &vec[high]);
-    return (i + 1);
-}
-
-
-/* (void) QuickSort
- *    | Tail-recursive quick sorting. Must be used, as other sorting methods
- *    | are either too slow or cause a stack overflow.
- */
-void IsingModel::QuickSort(std::vector<spin>& vec, int left, int right) {
-    while (left < right)
-    {
-        int pi = QSPartition(vec, left, right);
-
-        if (pi - left < right - pi) {
-            QuickSort(vec, left, pi - 1);
-            left = pi + 1; 
-        } else {
-            QuickSort(vec, pi + 1, right);
-            right = pi - 1;
-        }
-    }
-}
-
-
 /* (void) randomizeSpins
  *    | Randomly flips spins in the array (does not necessarily lead to 0 mag.)
+ *    | A seeded run draws the flips from its own sub-stream of the seed, so
+ *    | its starting configuration is reproducible too
  */
 void IsingModel::randomizeSpins() {
-    TRandom3 *rNG = new TRandom3(0);
+    RandomGenerator *rNG = new RandomGenerator(seed != 0 ? RandomGenerator::deriveSeed(seed,kSpinStream) : 0);
     int nFlips=0;
 
-    for(int i=0; i < spinArray.size(); i++) {
+    for(int i=0; i < nSpins; i++) {
         if(rNG->Uniform() < 0.5) {
-          spinArray.at(i).S = spinArray.at(i).S * -1;
+          setSpin(i,-spinValues[i]);
           nFlips++;
         }
     }
@@ -711,9 +1587,103 @@ void IsingModel::randomizeSpins() {
  */
 void IsingModel::setAllSpins(const int direction) {
     int allSpin = (direction > 0) ? 1: -1;
-    for(int i=0; i<spinArray.size(); i++) {
-        spinArray.at(i).S=allSpin;
+    for(int i=0; i<nSpins; i++) {
+        setSpin(i,allSpin);
+    }
+}
+
+/* (TGraph*) getEquilibrationGr
+ *    | Get a graph of the effective energy during burn-in, i.e. the 
+ *    | series the equilibration detector decided on
+ *  O | (TGraph*) dynamically allocated graph of beta*H vs. sweep
+ */
+TGraph* IsingModel::getEquilibrationGr() {
+    const std::vector<double>& energies = burnInDetector.getSeries();
+    std::vector<double> stepIndices(energies.size());
+
+    for(size_t i=0; i < stepIndices.size(); i++) {
+        stepIndices.at(i)=i+1;
+    }
+
+    TGraph *equilibrationGr
+        = new TGraph(energies.size(),
+                     stepIndices.data(),
+                     energies.data());
+    return equilibrationGr;
+}
+
+/* (TGraph*) getGraphCorrelationGr
+ *    | Get a graph of <S_i S_j> against graph distance
+ *  O | (TGraph*) dynamically allocated graph of the correlation function
+ */
+TGraph* IsingModel::getGraphCorrelationGr() {
+    std::vector<double> G = correlation.getGraphCorrelation();
+    std::vector<double> distances(G.size());
+
+    for(size_t i=0; i < distances.size(); i++) {
+        distances.at(i)=i;
     }
+
+    TGraph *correlationGr
+        = new TGraph(G.size(),
+                     distances.data(),
+                     G.data());
+    return correlationGr;
+}
+
+/* (TGraph*) getEuclideanCorrelationGr
+ *    | Get a graph of <S_i S_j> against distance on the embedding grid
+ *  O | (TGraph*) dynamically allocated graph of the correlation function
+ */
+TGraph* IsingModel::getEuclideanCorrelationGr() {
+    std::vector<double> distances;
+    std::vector<double> G;
+    correlation.getEuclideanCorrelation(distances,G);
+
+    TGraph *correlationGr
+        = new TGraph(G.size(),
+                     distances.data(),
+                     G.data());
+    return correlationGr;
+}
+
+/* (TGraph*) getStructureFactorGr
+ *    | Get a graph of S(k) averaged over shells of equal |k|
+ *  O | (TGraph*) dynamically allocated graph of the structure factor
+ */
+TGraph* IsingModel::getStructureFactorGr() {
+    std::vector<double> k;
+    std::vector<double> S;
+    structureFactor.getRadialAverage(k,S);
+
+    TGraph *structureFactorGr
+        = new TGraph(S.size(),
+                     k.data(),
+                     S.data());
+    return structureFactorGr;
+}
+
+/* (TGraph*) getClusterSizeGr
+ *    | Get a graph of the mean number of clusters of each size
+ *  I | (int) ClusterAnalysis::kDomains or ClusterAnalysis::kFKClusters
+ *  O | (TGraph*) dynamically allocated graph of the size distribution
+ */
+TGraph* IsingModel::getClusterSizeGr(const int type) {
+    std::vector<double> counts = clusters.getSizeDistribution(type);
+    std::vector<double> sizes;
+    std::vector<double> nonzero;
+
+    for(size_t s=1; s < counts.size(); s++) {
+        if(counts.at(s) == 0) continue;
+        sizes.push_back(s);
+        nonzero.push_back(counts.at(s));
+    }
+
+    TGraph *clusterSizeGr
+        = new TGraph(sizes.size(),
+                     sizes.data(),
+                     nonzero.data());
+    return clusterSizeGr;
 }
 
 /* (TGraph*) getConvergenceGr
@@ -721,12 +1691,13 @@ void IsingModel::setAllSpins(const int direction) {
  *  O | (TGraph*) dynamically allocated graph of the convergence
  */
 TGraph* IsingModel::getConvergenceGr() {
-    std::vector<double> convergenceDt = hybridInfo;
-    convergenceDt.erase(convergenceDt.begin());
+    std::vector<double> convergenceDt = getHybridInfo();
     std::vector<double> stepIndices(convergenceDt.size());
     
+    // Number the retained sweeps from the start of the run
+    long firstSweep = sweepHistory.getNumPushed() - convergenceDt.size();
     for(int i=0; i < stepIndices.size(); i++) {
-        stepIndices.at(i)=i+1;
+        stepIndices.at(i)=firstSweep+i+1;
     }
 
     TGraph *convergenceGr 
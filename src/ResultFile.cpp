@@ -0,0 +1,666 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * ResultFile.cpp                                                              *
+ *                                                                             *
+ * Definitions for the multi-configuration result file                         *
+ * (see interface/ResultFile.h)                                                *
+ *                                                                             *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#include "interface/ResultFile.h"
+#include "interface/StateIO.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char recordMagic[] = "IREC";
+static const char parMagic[]    = "IPAR";
+
+// What merge() keeps of an input record: its location, keys and
+// parameters, but not its values and arrays
+struct mergeEntry {
+    unsigned long long key;      // configuration hash, or getKey() if unset
+    unsigned long long indexKey; // getKey()
+    int  input;
+    long position;
+    unsigned long long offset;
+    unsigned long long length;
+    int  nameSet;                // parameter names, per input
+    std::string tag;
+    std::vector<double> values;
+};
+
+struct mergeInput {
+    std::vector<mergeEntry> entries;
+    std::vector<std::vector<std::string> > nameSets;
+    long nBad=0;
+};
+
+
+/* (void) addParameter
+ *    | Add one element of the parameter tuple that identifies the record
+ */
+void ResultRecord::addParameter(const std::string& name, const double value) {
+    parameters.push_back(std::make_pair(name,value));
+}
+
+
+/* (void) addValue
+ */
+void ResultRecord::addValue(const std::string& name, const double value) {
+    values.push_back(std::make_pair(name,value));
+}
+
+
+/* (void) addArray
+ */
+void ResultRecord::addArray(const std::string& name, const std::vector<double>& vals) {
+    arrays.push_back(std::make_pair(name,vals));
+}
+
+
+/* (void) clear
+ */
+void ResultRecord::clear() {
+    tag.clear();
+    configHash=0;
+    parameters.clear();
+    values.clear();
+    arrays.clear();
+}
+
+
+/* (double) getParameter, getValue
+ *    | Returns the named entry, NaN if it does not exist
+ */
+const double ResultRecord::getParameter(const std::string& name) {
+    for(size_t i=0; i < parameters.size(); i++) {
+        if(parameters[i].first == name) return parameters[i].second;
+    }
+    return NAN;
+}
+
+const double ResultRecord::getValue(const std::string& name) {
+    for(size_t i=0; i < values.size(); i++) {
+        if(values[i].first == name) return values[i].second;
+    }
+    return NAN;
+}
+
+
+/* (vector<double>) getArray
+ *    | Returns the named array, empty if it does not exist
+ */
+const std::vector<double> ResultRecord::getArray(const std::string& name) {
+    for(size_t i=0; i < arrays.size(); i++) {
+        if(arrays[i].first == name) return arrays[i].second;
+    }
+    return std::vector<double>();
+}
+
+
+/* (ull) getKey
+ *    | FNV-1a hash of the tag and the parameter tuple (names and values)
+ */
+const unsigned long long ResultRecord::getKey() {
+    unsigned long long h=StateIO::hash(tag,14695981039346656037ULL);
+    for(size_t i=0; i < parameters.size(); i++) {
+        h=StateIO::hash(parameters[i].first,h);
+        h=StateIO::hash(parameters[i].second,h);
+    }
+    return h;
+}
+
+
+/* (string) serialize
+ *    | Magic, tag, then counted lists of parameters, values and arrays,
+ *    | then the configuration hash
+ */
+const std::string ResultRecord::serialize() {
+    std::ostringstream os(std::ios::binary);
+    os.write(recordMagic,4);
+    StateIO::write(os,tag);
+    StateIO::write(os,(unsigned long long) parameters.size());
+    for(size_t i=0; i < parameters.size(); i++) {
+        StateIO::write(os,parameters[i].first);
+        StateIO::write(os,parameters[i].second);
+    }
+    StateIO::write(os,(unsigned long long) values.size());
+    for(size_t i=0; i < values.size(); i++) {
+        StateIO::write(os,values[i].first);
+        StateIO::write(os,values[i].second);
+    }
+    StateIO::write(os,(unsigned long long) arrays.size());
+    for(size_t i=0; i < arrays.size(); i++) {
+        StateIO::write(os,arrays[i].first);
+        StateIO::write(os,arrays[i].second);
+    }
+    StateIO::write(os,configHash);
+    return os.str();
+}
+
+
+/* (bool) deserialize
+ *  O | (bool) false if the data is not a complete record
+ */
+bool ResultRecord::deserialize(const std::string& data) {
+    clear();
+    std::istringstream is(data,std::ios::binary);
+    char magic[4];
+    is.read(magic,4);
+    if(!is || memcmp(magic,recordMagic,4) != 0) return false;
+    StateIO::read(is,tag);
+
+    unsigned long long n=0;
+    StateIO::read(is,n);
+    parameters.resize(is ? n : 0);
+    for(size_t i=0; i < parameters.size(); i++) {
+        StateIO::read(is,parameters[i].first);
+        StateIO::read(is,parameters[i].second);
+    }
+    StateIO::read(is,n);
+    values.resize(is ? n : 0);
+    for(size_t i=0; i < values.size(); i++) {
+        StateIO::read(is,values[i].first);
+        StateIO::read(is,values[i].second);
+    }
+    StateIO::read(is,n);
+    arrays.resize(is ? n : 0);
+    for(size_t i=0; i < arrays.size(); i++) {
+        StateIO::read(is,arrays[i].first);
+        StateIO::read(is,arrays[i].second);
+    }
+    if(is.fail()) return false;
+
+    // Records written before the configuration hash existed end here
+    if(is.peek() != std::char_traits<char>::eof()) StateIO::read(is,configHash);
+    return !is.fail();
+}
+
+
+ResultFile::ResultFile() {};
+ResultFile::~ResultFile() {};
+
+
+/* (void) append
+ *    | Append the record to the data file and its entry to the index,
+ *    | both under an exclusive lock on the data file. Both are synced
+ *    | before the lock is released. A job killed in between leaves an
+ *    | unindexed record, which readers never see, or a partial index
+ *    | entry, which readers ignore and the next append overwrites.
+ *  I | (string) data file name (the index is <fileName>.idx)
+ *    | (ResultRecord&) record to store
+ */
+void ResultFile::append(const std::string& fileName, ResultRecord& record) {
+    std::string data=record.serialize();
+
+    int fd=::open(fileName.c_str(),O_WRONLY | O_CREAT | O_APPEND,0644);
+    if(fd < 0 || flock(fd,LOCK_EX) != 0) {
+        std::cout<<"ERROR: Cannot open "<<fileName<<" for appending"<<std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    indexEntry entry;
+    entry.key=record.getKey();
+    entry.offset=lseek(fd,0,SEEK_END);
+    entry.length=data.size();
+    bool ok = write(fd,data.data(),data.size()) == (ssize_t) data.size()
+              && fdatasync(fd) == 0;
+
+    // A partial entry left by a killed job is cut off first, so the new
+    // entry stays aligned with the ones before it
+    int idx=::open((fileName+".idx").c_str(),O_WRONLY | O_CREAT,0644);
+    off_t idxSize = idx >= 0 ? lseek(idx,0,SEEK_END) : -1;
+    off_t idxEnd = idxSize - idxSize % (off_t) sizeof(entry);
+    ok = ok && idxSize >= 0
+         && (idxEnd == idxSize || (ftruncate(idx,idxEnd) == 0 && lseek(idx,idxEnd,SEEK_SET) == idxEnd))
+         && write(idx,&entry,sizeof(entry)) == (ssize_t) sizeof(entry)
+         && fdatasync(idx) == 0;
+    if(idx >= 0) ::close(idx);
+
+    flock(fd,LOCK_UN);
+    ::close(fd);
+    if(!ok) {
+        std::cout<<"ERROR: Failed to append to "<<fileName<<std::endl;
+        exit(EXIT_FAILURE);
+    }
+}
+
+
+/* (void) scanInput
+ *    | Read the records of one input in index order and keep their entries.
+ *    | Only one record is held in memory at a time.
+ */
+static void scanInput(const std::string& fileName, const int input, mergeInput& out) {
+    ResultFile index;
+    index.open(fileName);
+    std::ifstream file(fileName.c_str(),std::ios::binary);
+    std::string data;
+    ResultRecord record;
+    for(long k=0; k < index.getNumRecords(); k++) {
+        mergeEntry entry;
+        if(!index.locate(k,entry.offset,entry.length)) break;
+        data.resize(entry.length);
+        file.seekg(entry.offset);
+        if(!file.read(&data[0],entry.length) || !record.deserialize(data)) {
+            file.clear();
+            out.nBad++;
+            continue;
+        }
+
+        entry.indexKey=record.getKey();
+        entry.key = record.getConfigurationHash() != 0 ? record.getConfigurationHash()
+                                                       : entry.indexKey;
+        entry.input=input;
+        entry.position=k;
+        entry.tag=record.getTag();
+
+        const ResultRecord::NamedValues& pars=record.getParameters();
+        std::vector<std::string> names(pars.size());
+        entry.values.resize(pars.size());
+        for(size_t i=0; i < pars.size(); i++) {
+            names[i]=pars[i].first;
+            entry.values[i]=pars[i].second;
+        }
+        entry.nameSet = std::find(out.nameSets.begin(),out.nameSets.end(),names)
+                        - out.nameSets.begin();
+        if(entry.nameSet == (int) out.nameSets.size()) out.nameSets.push_back(names);
+        out.entries.push_back(entry);
+    }
+}
+
+
+/* (bool) mergeOrder
+ *    | Sort order of the merged file: tag, then the parameter columns
+ *    | (missing values last), then input order
+ */
+static bool mergeOrder(const mergeEntry& a, const mergeEntry& b) {
+    if(a.tag != b.tag) return a.tag < b.tag;
+    for(size_t i=0; i < a.values.size(); i++) {
+        bool aNaN=std::isnan(a.values[i]);
+        bool bNaN=std::isnan(b.values[i]);
+        if(aNaN != bNaN) return bNaN;
+        if(!aNaN && a.values[i] != b.values[i]) return a.values[i] < b.values[i];
+    }
+    if(a.input != b.input) return a.input < b.input;
+    return a.position < b.position;
+}
+
+
+/* (long) merge
+ *    | Combine result files into one. Of several records with the same
+ *    | configuration hash (or tag and parameters, for records without a
+ *    | hash) the last one wins, in the order of the inputs and of the
+ *    | records within each input. The inputs are scanned in parallel and
+ *    | only the record locations and parameters are kept in memory; the
+ *    | record data is then copied in sorted order. The output (data, index
+ *    | and parameter table) is written under temporary names and renamed
+ *    | when complete, so it may replace one of the inputs.
+ *  I | (vector<string>) input data files (each with its index)
+ *    | (string) output data file name
+ *    | (int) number of threads scanning the inputs
+ *  O | (long) number of records written
+ */
+const long ResultFile::merge(const std::vector<std::string>& inputs,
+                             const std::string& fileName, const int nThreads) {
+    // Scan the inputs
+    std::vector<mergeInput> scanned(inputs.size());
+    std::atomic<size_t> next(0);
+    std::vector<std::thread> workers;
+    int nWorkers = std::max(1,std::min(nThreads,(int) inputs.size()));
+    for(int t=0; t < nWorkers; t++) {
+        workers.push_back(std::thread([&]() {
+            for(size_t i=next++; i < inputs.size(); i=next++) {
+                scanInput(inputs[i],i,scanned[i]);
+            }
+        }));
+    }
+    for(size_t t=0; t < workers.size(); t++) workers[t].join();
+
+    // Parameter columns in order of first appearance, then keep the last
+    // entry of each key with its parameters moved into those columns
+    std::vector<std::string> names;
+    std::map<unsigned long long,mergeEntry> kept;
+    long nRead=0, nBad=0;
+    for(size_t i=0; i < scanned.size(); i++) {
+        mergeInput& in=scanned[i];
+        std::vector<std::vector<int> > columns(in.nameSets.size());
+        for(size_t s=0; s < in.nameSets.size(); s++) {
+            for(size_t j=0; j < in.nameSets[s].size(); j++) {
+                const std::string& name=in.nameSets[s][j];
+                int c = std::find(names.begin(),names.end(),name) - names.begin();
+                if(c == (int) names.size()) names.push_back(name);
+                columns[s].push_back(c);
+            }
+        }
+        for(size_t k=0; k < in.entries.size(); k++) {
+            mergeEntry& entry=in.entries[k];
+            std::vector<double> row(names.size(),NAN);
+            for(size_t j=0; j < entry.values.size(); j++) {
+                row[columns[entry.nameSet][j]]=entry.values[j];
+            }
+            entry.values.swap(row);
+            kept[entry.key]=entry;
+        }
+        nRead += in.entries.size();
+        nBad  += in.nBad;
+        std::vector<mergeEntry>().swap(in.entries);
+    }
+
+    std::vector<mergeEntry> sorted;
+    sorted.reserve(kept.size());
+    for(std::map<unsigned long long,mergeEntry>::iterator it=kept.begin(); it != kept.end(); ++it) {
+        it->second.values.resize(names.size(),NAN);
+        sorted.push_back(it->second);
+    }
+    kept.clear();
+    std::sort(sorted.begin(),sorted.end(),mergeOrder);
+
+    // Copy the records and write the index and parameter table
+    char suffix[32];
+    snprintf(suffix,sizeof(suffix),".tmp%d",(int) getpid());
+    std::string tmpName=fileName+suffix;
+    std::ofstream data(tmpName.c_str(),std::ios::binary);
+    std::ofstream idx((tmpName+".idx").c_str(),std::ios::binary);
+    std::ofstream par((tmpName+".par").c_str(),std::ios::binary);
+    par.write(parMagic,4);
+    StateIO::write(par,names);
+    StateIO::write(par,(unsigned long long) sorted.size());
+
+    std::ifstream input;
+    int current=-1;
+    std::string buffer;
+    unsigned long long offset=0;
+    bool ok = data && idx && par;
+    for(size_t k=0; k < sorted.size() && ok; k++) {
+        const mergeEntry& entry=sorted[k];
+        if(entry.input != current) {
+            input.close();
+            input.clear();
+            input.open(inputs[entry.input].c_str(),std::ios::binary);
+            current=entry.input;
+        }
+        buffer.resize(entry.length);
+        input.seekg(entry.offset);
+        ok = (bool) input.read(&buffer[0],entry.length);
+
+        indexEntry out;
+        out.key=entry.indexKey;
+        out.offset=offset;
+        out.length=entry.length;
+        data.write(buffer.data(),buffer.size());
+        idx.write(reinterpret_cast<const char*>(&out),sizeof(out));
+        for(size_t j=0; j < entry.values.size(); j++) StateIO::write(par,entry.values[j]);
+        offset += entry.length;
+    }
+    data.close();
+    idx.close();
+    par.close();
+    ok = ok && !data.fail() && !idx.fail() && !par.fail()
+         && rename(tmpName.c_str(),fileName.c_str()) == 0
+         && rename((tmpName+".idx").c_str(),(fileName+".idx").c_str()) == 0
+         && rename((tmpName+".par").c_str(),(fileName+".par").c_str()) == 0;
+    if(!ok) {
+        std::cout<<"ERROR: Failed to merge into "<<fileName<<std::endl;
+        remove(tmpName.c_str());
+        remove((tmpName+".idx").c_str());
+        remove((tmpName+".par").c_str());
+        exit(EXIT_FAILURE);
+    }
+
+    std::cout<<"Merged "<<nRead<<" records from "<<inputs.size()<<" files into "
+             <<sorted.size()<<" ("<<nRead-(long) sorted.size()<<" duplicates";
+    if(nBad > 0) std::cout<<", "<<nBad<<" unreadable records skipped";
+    std::cout<<")"<<std::endl;
+    return sorted.size();
+}
+
+
+/* (void) open
+ *    | Load the index. A trailing partial entry (from a job killed while
+ *    | writing it) is ignored.
+ *  I | (string) data file name
+ */
+void ResultFile::open(const std::string& fileName) {
+    dataFile=fileName;
+    entries.clear();
+    latest.clear();
+
+    std::ifstream idx((fileName+".idx").c_str(),std::ios::binary);
+    indexEntry entry;
+    while(idx.read(reinterpret_cast<char*>(&entry),sizeof(entry))) {
+        latest[entry.key]=entries.size();
+        entries.push_back(entry);
+    }
+
+    parNames.clear();
+    parTable.clear();
+    hasParTable=false;
+    std::ifstream par((fileName+".par").c_str(),std::ios::binary);
+    char magic[4];
+    unsigned long long nRows=0;
+    par.read(magic,4);
+    StateIO::read(par,parNames);
+    StateIO::read(par,nRows);
+    // A table that does not match the index (records appended after the
+    // merge) is rebuilt from the records when needed
+    if(!par || memcmp(magic,parMagic,4) != 0 || nRows != entries.size()) {
+        parNames.clear();
+        return;
+    }
+    parTable.resize(nRows*parNames.size());
+    if(!parTable.empty()) par.read(reinterpret_cast<char*>(&parTable[0]),parTable.size()*sizeof(double));
+    hasParTable = (bool) par;
+    if(!hasParTable) {
+        parNames.clear();
+        parTable.clear();
+    }
+}
+
+
+/* (bool) locate
+ *    | Position and length of the k-th record in the data file
+ */
+bool ResultFile::locate(const long k, unsigned long long& offset,
+                        unsigned long long& length) {
+    if(k < 0 || k >= (long) entries.size()) return false;
+    offset=entries[k].offset;
+    length=entries[k].length;
+    return true;
+}
+
+
+/* (bool) read
+ *    | Read the k-th record in append order
+ */
+bool ResultFile::read(const long k, ResultRecord& record) {
+    if(k < 0 || k >= (long) entries.size()) return false;
+    return readAt(entries[k],record);
+}
+
+
+/* (bool) find
+ *    | Look up the newest record with the tag and parameter tuple of the
+ *    | given record, and replace the record by it
+ *  I | (ResultRecord&) key: tag and parameters set (output: full record)
+ *  O | (bool) false if there is no such record
+ */
+bool ResultFile::find(ResultRecord& key) {
+    std::map<unsigned long long,long>::iterator it=latest.find(key.getKey());
+    if(it == latest.end()) return false;
+
+    ResultRecord found;
+    if(!readAt(entries[it->second],found)) return false;
+    if(found.getTag() != key.getTag() || found.getParameters() != key.getParameters()) {
+        return false;
+    }
+    key=found;
+    return true;
+}
+
+
+/* (void) loadParTable
+ *    | Build the parameter table by reading every record, for files
+ *    | without a valid <file>.par
+ */
+void ResultFile::loadParTable() {
+    if(hasParTable) return;
+    parNames.clear();
+    std::vector<std::vector<std::pair<int,double> > > rows(entries.size());
+    ResultRecord record;
+    for(size_t k=0; k < entries.size(); k++) {
+        if(!readAt(entries[k],record)) continue;
+        const ResultRecord::NamedValues& pars=record.getParameters();
+        for(size_t j=0; j < pars.size(); j++) {
+            int c = std::find(parNames.begin(),parNames.end(),pars[j].first) - parNames.begin();
+            if(c == (int) parNames.size()) parNames.push_back(pars[j].first);
+            rows[k].push_back(std::make_pair(c,pars[j].second));
+        }
+    }
+    parTable.assign(entries.size()*parNames.size(),NAN);
+    for(size_t k=0; k < rows.size(); k++) {
+        for(size_t j=0; j < rows[k].size(); j++) {
+            parTable[k*parNames.size()+rows[k][j].first]=rows[k][j].second;
+        }
+    }
+    hasParTable=true;
+}
+
+
+/* (vector<string>) getParameterNames
+ *    | Returns the columns of the parameter table
+ */
+const std::vector<std::string>& ResultFile::getParameterNames() {
+    loadParTable();
+    return parNames;
+}
+
+
+/* (double) getParameter
+ *    | Returns a parameter of the k-th record from the table, NaN if the
+ *    | record does not have it
+ */
+const double ResultFile::getParameter(const long k, const std::string& name) {
+    loadParTable();
+    int c = std::find(parNames.begin(),parNames.end(),name) - parNames.begin();
+    if(k < 0 || k >= (long) entries.size() || c == (int) parNames.size()) return NAN;
+    return parTable[k*parNames.size()+c];
+}
+
+
+/* (vector<long>) select
+ *    | Returns the records whose parameter lies in [lo, hi], e.g. one
+ *    | dimension and a temperature range:
+ *    |   file.select("kbT",1,3,file.select("hDim",1.5,1.5))
+ *  I | (string) parameter name
+ *    | (double) lower and upper bound
+ *    | (vector<long>) records to choose from (all if not given)
+ */
+const std::vector<long> ResultFile::select(const std::string& name,
+                                           const double lo, const double hi) {
+    std::vector<long> all(entries.size());
+    for(size_t k=0; k < all.size(); k++) all[k]=k;
+    return select(name,lo,hi,all);
+}
+
+const std::vector<long> ResultFile::select(const std::string& name,
+                                           const double lo, const double hi,
+                                           const std::vector<long>& among) {
+    std::vector<long> chosen;
+    for(size_t i=0; i < among.size(); i++) {
+        double value=getParameter(among[i],name);
+        if(value >= lo && value <= hi) chosen.push_back(among[i]);
+    }
+    return chosen;
+}
+
+
+/* (bool) readAt
+ */
+bool ResultFile::readAt(const indexEntry& entry, ResultRecord& record) {
+    std::ifstream file(dataFile.c_str(),std::ios::binary);
+    std::string data(entry.length,' ');
+    file.seekg(entry.offset);
+    if(!file.read(&data[0],entry.length)) return false;
+    return record.deserialize(data);
+}
+
+
+/* (string) getPath
+ *    | File holding the record of a configuration hash
+ */
+const std::string ResultStore::getPath(const unsigned long long hash) {
+    char name[32];
+    snprintf(name,sizeof(name),"%016llx",hash);
+    return directory+"/"+std::string(name,2)+"/"+name+".rec";
+}
+
+
+/* (bool) contains
+ *    | Whether a record for the configuration hash exists
+ */
+bool ResultStore::contains(const unsigned long long hash) {
+    struct stat info;
+    return stat(getPath(hash).c_str(),&info) == 0;
+}
+
+
+/* (bool) load
+ *    | Read the record of a configuration hash. A file whose record carries
+ *    | a different hash (e.g. copied by hand) does not count as a hit.
+ *  I | (ull) configuration hash
+ *    | (ResultRecord&) the stored record (output)
+ *  O | (bool) false if the configuration is not in the store
+ */
+bool ResultStore::load(const unsigned long long hash, ResultRecord& record) {
+    std::ifstream file(getPath(hash).c_str(),std::ios::binary);
+    if(!file) return false;
+    std::stringstream data;
+    data<<file.rdbuf();
+
+    ResultRecord found;
+    if(!found.deserialize(data.str()) || found.getConfigurationHash() != hash) {
+        std::cout<<"WARNING: Ignoring damaged or mismatched "<<getPath(hash)<<std::endl;
+        return false;
+    }
+    record=found;
+    return true;
+}
+
+
+/* (void) store
+ *    | Save the record under its configuration hash. The file is written
+ *    | under a temporary name, synced and renamed, so a concurrent reader
+ *    | sees either nothing or the complete record.
+ *  I | (ull) configuration hash
+ *    | (ResultRecord&) record to store (its hash is set to the given one)
+ */
+void ResultStore::store(const unsigned long long hash, ResultRecord& record) {
+    record.setConfigurationHash(hash);
+    std::string data=record.serialize();
+    std::string path=getPath(hash);
+    mkdir(directory.c_str(),0755);
+    mkdir(path.substr(0,path.rfind('/')).c_str(),0755);
+
+    char suffix[32];
+    snprintf(suffix,sizeof(suffix),".tmp%d",(int) getpid());
+    std::string tmpName=path+suffix;
+    FILE* file=fopen(tmpName.c_str(),"wb");
+    bool ok = file && fwrite(data.data(),1,data.size(),file) == data.size();
+    ok = file && fflush(file) == 0 && fsync(fileno(file)) == 0 && ok;
+    if(file) fclose(file);
+    if(!ok || rename(tmpName.c_str(),path.c_str()) != 0) {
+        std::cout<<"ERROR: Could not write "<<path<<std::endl;
+        remove(tmpName.c_str());
+        exit(EXIT_FAILURE);
+    }
+}
@@ -0,0 +1,118 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * SiteMaps.cpp                                                                *
+ *                                                                             *
+ * Definitions for the per-site magnetization maps                             *
+ * (see interface/SiteMaps.h)                                                  *
+ *                                                                             *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#include "interface/SiteMaps.h"
+#include "interface/StateIO.h"
+
+SiteMaps::SiteMaps() {};
+SiteMaps::~SiteMaps() {};
+
+
+/* (void) setup
+ *    | Store views of the neighbour graph (the arrays must outlive this
+ *    | object's use) and size the maps
+ *  I | (ConstView<int>) CSR offsets into the neighbour list (nSites+1)
+ *    | (ConstView<int>) neighbour list
+ */
+void SiteMaps::setup(const ConstView<int> nbrOffsets,
+                     const ConstView<int> nbrIndices) {
+    offsets=nbrOffsets;
+    neighbours=nbrIndices;
+    int nSites = nbrOffsets.empty() ? 0 : nbrOffsets.size()-1;
+    spinValues.assign(nSites,0);
+    bondValues.assign(nSites,0);
+    reset();
+}
+
+
+/* (void) reset
+ *    | Clear the accumulated sums
+ */
+void SiteMaps::reset() {
+    nMeasurements=0;
+    spinSum.assign(spinValues.size(),0);
+    bondSum.assign(bondValues.size(),0);
+}
+
+
+/* (void) accumulate
+ *    | Add one configuration. The neighbour products need a gather, the
+ *    | three remaining passes are contiguous and vectorize.
+ *  I | (ConstView<int>) spins, 0 at missing sites
+ */
+void SiteMaps::accumulate(const ConstView<int> spins) {
+    if(offsets.empty()) return;
+    nMeasurements++;
+    int nSites=spinValues.size();
+
+    const int* s = spins.data();
+    float* sv = spinValues.data();
+    for(int i=0; i < nSites; i++) sv[i] = s[i];
+
+    // Sum of S_j over the neighbours of i, times S_i
+    const int* off = offsets.data();
+    const int* nbr = neighbours.data();
+    float* bv = bondValues.data();
+    for(int i=0; i < nSites; i++) {
+        float local=0;
+        for(int n=off[i]; n < off[i+1]; n++) local += sv[nbr[n]];
+        bv[i] = local;
+    }
+    for(int i=0; i < nSites; i++) bv[i] *= sv[i];
+
+    float* ss = spinSum.data();
+    float* bs = bondSum.data();
+    for(int i=0; i < nSites; i++) ss[i] += sv[i];
+    for(int i=0; i < nSites; i++) bs[i] += bv[i];
+}
+
+
+/* (vector<double>) getMagnetizationMap
+ *    | Returns <S_i> for every site (0 at missing sites)
+ */
+const std::vector<double> SiteMaps::getMagnetizationMap() {
+    std::vector<double> m(spinSum.size(),0);
+    if(nMeasurements == 0) return m;
+    for(size_t i=0; i < m.size(); i++) m[i] = (double) spinSum[i]/nMeasurements;
+    return m;
+}
+
+
+/* (vector<double>) getBondMap
+ *    | Returns <S_i S_j> averaged over the neighbours j of every site
+ *    | (0 at sites without neighbours)
+ */
+const std::vector<double> SiteMaps::getBondMap() {
+    std::vector<double> b(bondSum.size(),0);
+    if(nMeasurements == 0) return b;
+    for(size_t i=0; i < b.size(); i++) {
+        int degree = offsets[i+1]-offsets[i];
+        if(degree > 0) b[i] = (double) bondSum[i]/degree/nMeasurements;
+    }
+    return b;
+}
+
+
+/* (void) writeState
+ *    | Write the accumulated data to a checkpoint stream
+ */
+void SiteMaps::writeState(std::ostream& os) {
+    StateIO::write(os,nMeasurements);
+    StateIO::write(os,spinSum);
+    StateIO::write(os,bondSum);
+}
+
+
+/* (void) readState
+ *    | Restore the accumulated data written by writeState. The object
+ *    | must have been set up for the same lattice.
+ */
+void SiteMaps::readState(std::istream& is) {
+    StateIO::read(is,nMeasurements);
+    StateIO::read(is,spinSum);
+    StateIO::read(is,bondSum);
+}
@@ -0,0 +1,258 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Snapshots.cpp                                                               *
+ *                                                                             *
+ * Definitions for the snapshot writer and reader                              *
+ * (see interface/Snapshots.h)                                                 *
+ *                                                                             *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#include "interface/Snapshots.h"
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+static const char snapMagic[]  = "ISNAPS01";
+static const char snapFooter[] = "ISNIDX01";
+
+// Variable-length unsigned integers, 7 bits per byte
+static void putVarint(std::vector<unsigned char>& out, unsigned long v) {
+    while(v >= 0x80) {
+        out.push_back((v & 0x7f) | 0x80);
+        v >>= 7;
+    }
+    out.push_back(v);
+}
+
+static unsigned long getVarint(const unsigned char*& in) {
+    unsigned long v=0;
+    for(int shift=0; ; shift += 7) {
+        unsigned char b=*in++;
+        v |= (unsigned long) (b & 0x7f) << shift;
+        if(!(b & 0x80)) return v;
+    }
+}
+
+
+SnapshotWriter::SnapshotWriter() {};
+SnapshotWriter::~SnapshotWriter() {close();};
+
+
+/* (void) open
+ *    | Create the file and write the header
+ *  I | (string) output file name
+ *    | (long) number of sites per snapshot
+ */
+void SnapshotWriter::open(const std::string& fileName, const long sites) {
+    close();
+    file=fopen(fileName.c_str(),"wb");
+    if(!file) {
+        std::cout<<"ERROR: Cannot open "<<fileName<<" for writing"<<std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    nSites=sites;
+    unsigned long long n=nSites;
+    unsigned int interval=keyframeInterval;
+    fwrite(snapMagic,1,8,file);
+    fwrite(&n,sizeof(n),1,file);
+    fwrite(&interval,sizeof(interval),1,file);
+
+    previous.assign((nSites+7)/8,0);
+    current.assign((nSites+7)/8,0);
+    offsets.clear();
+    tags.clear();
+}
+
+
+/* (void) add
+ *    | Pack the spins and write them as a keyframe or as an RLE delta
+ *  I | (ConstView<int>) spins, 0 at missing sites
+ *    | (long) tag stored in the index
+ */
+void SnapshotWriter::add(const ConstView<int> spins, const long tag) {
+    if(!file) return;
+    if((long) spins.size() != nSites) {
+        std::cout<<"ERROR: Snapshot has "<<spins.size()<<" sites, expected "
+                 <<nSites<<std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    std::fill(current.begin(),current.end(),0);
+    for(long i=0; i < nSites; i++) {
+        if(spins[i] > 0) current[i >> 3] |= 1 << (i & 7);
+    }
+
+    offsets.push_back(ftello(file));
+    tags.push_back(tag);
+    payload.clear();
+
+    if((offsets.size()-1) % keyframeInterval == 0) {
+        payload=current;
+        writeRecord(0);
+    } else {
+        // Runs of unchanged bytes, then the literal XOR bytes up to the
+        // next run of at least two unchanged bytes
+        size_t nBytes=current.size();
+        size_t i=0;
+        while(i < nBytes) {
+            size_t zeros=0;
+            while(i+zeros < nBytes && current[i+zeros] == previous[i+zeros]) zeros++;
+            size_t start=i+zeros, end=start;
+            while(end < nBytes && !(current[end] == previous[end]
+                                    && (end+1 == nBytes || current[end+1] == previous[end+1]))) end++;
+            putVarint(payload,zeros);
+            putVarint(payload,end-start);
+            for(size_t b=start; b < end; b++) payload.push_back(current[b]^previous[b]);
+            i=end;
+        }
+        writeRecord(1);
+    }
+    previous.swap(current);
+}
+
+
+/* (void) writeRecord
+ */
+void SnapshotWriter::writeRecord(const unsigned char type) {
+    unsigned int length=payload.size();
+    fwrite(&type,1,1,file);
+    fwrite(&length,sizeof(length),1,file);
+    fwrite(payload.data(),1,length,file);
+}
+
+
+/* (void) close
+ *    | Write the index and close the file
+ */
+void SnapshotWriter::close() {
+    if(!file) return;
+    unsigned long long nSnaps=offsets.size();
+    for(size_t k=0; k < nSnaps; k++) {
+        fwrite(&offsets[k],sizeof(unsigned long long),1,file);
+        fwrite(&tags[k],sizeof(long long),1,file);
+    }
+    fwrite(&nSnaps,sizeof(nSnaps),1,file);
+    fwrite(snapFooter,1,8,file);
+    fclose(file);
+    file=0;
+}
+
+
+SnapshotReader::SnapshotReader() {};
+SnapshotReader::~SnapshotReader() {close();};
+
+
+/* (void) open
+ *    | Read the header and the snapshot index
+ *  I | (string) file written by SnapshotWriter
+ */
+void SnapshotReader::open(const std::string& fileName) {
+    close();
+    file=fopen(fileName.c_str(),"rb");
+    char magic[8];
+    if(!file || fread(magic,1,8,file) != 8 || memcmp(magic,snapMagic,8) != 0) {
+        std::cout<<"ERROR: "<<fileName<<" is not a snapshot file"<<std::endl;
+        exit(EXIT_FAILURE);
+    }
+    unsigned long long n=0;
+    unsigned int interval=1;
+    fread(&n,sizeof(n),1,file);
+    fread(&interval,sizeof(interval),1,file);
+    nSites=n;
+    keyframeInterval=interval;
+
+    unsigned long long nSnaps=0;
+    fseeko(file,-16,SEEK_END);
+    fread(&nSnaps,sizeof(nSnaps),1,file);
+    if(fread(magic,1,8,file) != 8 || memcmp(magic,snapFooter,8) != 0) {
+        std::cout<<"ERROR: "<<fileName<<" has no snapshot index (not closed?)"<<std::endl;
+        exit(EXIT_FAILURE);
+    }
+    offsets.resize(nSnaps);
+    tags.resize(nSnaps);
+    fseeko(file,-16-16*(off_t) nSnaps,SEEK_END);
+    for(size_t k=0; k < nSnaps; k++) {
+        fread(&offsets[k],sizeof(unsigned long long),1,file);
+        fread(&tags[k],sizeof(long long),1,file);
+    }
+    cached.assign((nSites+7)/8,0);
+    cachedIndex=-1;
+}
+
+
+/* (void) close
+ */
+void SnapshotReader::close() {
+    if(file) fclose(file);
+    file=0;
+    nSites=0;
+    offsets.clear();
+    tags.clear();
+    cachedIndex=-1;
+}
+
+
+/* (void) applyRecord
+ *    | Decode record k on top of the cached snapshot k-1 (or from scratch
+ *    | for a keyframe)
+ */
+void SnapshotReader::applyRecord(const long k) {
+    unsigned char type=0;
+    unsigned int length=0;
+    fseeko(file,offsets.at(k),SEEK_SET);
+    fread(&type,1,1,file);
+    fread(&length,sizeof(length),1,file);
+    payload.resize(length);
+    fread(payload.data(),1,length,file);
+
+    if(type == 0) {
+        cached=payload;
+    } else {
+        const unsigned char* in=payload.data();
+        const unsigned char* end=in+length;
+        size_t i=0;
+        while(in < end) {
+            i += getVarint(in);
+            unsigned long nLiteral=getVarint(in);
+            for(unsigned long b=0; b < nLiteral; b++) cached[i++] ^= *in++;
+        }
+    }
+    cachedIndex=k;
+}
+
+
+/* (void) decode
+ *    | Bring the cache to snapshot k: forward from the cache when it lies
+ *    | between the last keyframe and k, otherwise from that keyframe
+ */
+void SnapshotReader::decode(const long k) {
+    if(!file || k < 0 || k >= (long) offsets.size()) {
+        std::cout<<"ERROR: No snapshot "<<k<<std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    long keyframe = k - k % keyframeInterval;
+    long first = (cachedIndex >= keyframe && cachedIndex <= k) ? cachedIndex+1 : keyframe;
+    for(long j=first; j <= k; j++) applyRecord(j);
+}
+
+
+/* (void) readBits
+ *    | Decode snapshot k as packed bits
+ *  I | (long) snapshot index
+ *    | (unsigned char*) caller buffer of (nSites+7)/8 bytes (output)
+ */
+void SnapshotReader::readBits(const long k, unsigned char* bits) {
+    decode(k);
+    memcpy(bits,cached.data(),cached.size());
+}
+
+
+/* (void) read
+ *    | Decode snapshot k as +1/-1 spins
+ *  I | (long) snapshot index
+ *    | (int*) caller buffer of nSites values (output)
+ */
+void SnapshotReader::read(const long k, int* spins) {
+    decode(k);
+    for(long i=0; i < nSites; i++) spins[i] = (cached[i >> 3] >> (i & 7)) & 1 ? 1 : -1;
+}
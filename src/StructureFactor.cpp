@@ -0,0 +1,207 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * StructureFactor.cpp                                                         *
+ *                                                                             *
+ * Definitions for the structure factor accumulator                            *
+ * (see interface/StructureFactor.h)                                           *
+ *                                                                             *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#include "interface/StructureFactor.h"
+#include "interface/StateIO.h"
+#include <cmath>
+#include <map>
+
+StructureFactor::StructureFactor() {};
+StructureFactor::~StructureFactor() {};
+
+
+/* (void) addWaveVector
+ *    | Add a wave vector (in inverse units of the site coordinates) at
+ *    | which S(k) is evaluated directly. Takes effect at the next setup.
+ *  I | (vector<double>) k, one component per lattice dimension
+ */
+void StructureFactor::addWaveVector(const std::vector<double>& k) {
+    waveVectors.push_back(k);
+}
+
+
+/* (void) setup
+ *    | Precompute the |k| shells of the padded grid and the site phases
+ *    | for the selected wave vectors
+ *  I | (vector<int>) padded embedding grid dimensions
+ *    | (vector<int>) number of sites along each lattice axis
+ *    | (ConstView<double>) site coordinates, nDims per site
+ *    | (vector<int>) 1 for active sites, 0 for missing ones
+ */
+void StructureFactor::setup(const std::vector<int>& paddedDims,
+                            const std::vector<int>& latticeDims,
+                            const ConstView<double> coords,
+                            const std::vector<int>& active) {
+    paddedDimensions=paddedDims;
+    nDims=paddedDims.size();
+    int nSites=active.size();
+    int gridSize=1;
+    for(int j=0; j < nDims; j++) gridSize *= paddedDims.at(j);
+
+    nActive=0;
+    for(int i=0; i < nSites; i++) nActive += active.at(i);
+
+    // Shells of equal |k| (k_j = 2 pi n_j / P_j, n_j wrapped to +-P_j/2)
+    std::map<double,int> shells;
+    std::vector<double> kAbs(gridSize);
+    for(int g=0; g < gridSize; g++) {
+        double k2=0;
+        for(int j=nDims-1,rem=g; j >= 0; j--) {
+            int nj = rem % paddedDims.at(j);
+            rem /= paddedDims.at(j);
+            if(nj > paddedDims.at(j)/2) nj -= paddedDims.at(j);
+            k2 += pow(2*M_PI*nj/paddedDims.at(j),2);
+        }
+        kAbs.at(g)=sqrt(k2);
+        shells[kAbs.at(g)]=0;
+    }
+
+    shellK.clear();
+    for(std::map<double,int>::iterator it=shells.begin(); it != shells.end(); it++) {
+        it->second=shellK.size();
+        shellK.push_back(it->first);
+    }
+    kShell.resize(gridSize);
+    shellCount.assign(shellK.size(),0);
+    for(int g=0; g < gridSize; g++) {
+        kShell.at(g)=shells[kAbs.at(g)];
+        shellCount.at(kShell.at(g)) += 1;
+    }
+
+    // Smallest lattice momentum 2 pi / L along each axis, i.e. grid
+    // index P/L on the padded grid
+    kMinIndices.clear();
+    kMin=0;
+    for(int j=0; j < nDims; j++) {
+        int n = floor((double) paddedDims.at(j)/latticeDims.at(j) + 0.5);
+        int stride=1;
+        for(int jj=j+1; jj < nDims; jj++) stride *= paddedDims.at(jj);
+        kMinIndices.push_back(n*stride);
+        kMin += 2*M_PI*n/paddedDims.at(j)/nDims;
+    }
+
+    // Phases e^{i k.x} of every site for the selected wave vectors
+    phases.assign(waveVectors.size(),std::vector<std::complex<double> >(nSites,0));
+    for(size_t iK=0; iK < waveVectors.size(); iK++) {
+        for(int i=0; i < nSites; i++) {
+            double kx=0;
+            for(int j=0; j < nDims && j < (int) waveVectors[iK].size(); j++) {
+                kx += waveVectors[iK][j]*coords[(size_t) i*nDims+j];
+            }
+            if(active.at(i)) phases[iK][i] = std::polar(1.,kx);
+        }
+    }
+
+    reset();
+}
+
+
+/* (void) reset
+ *    | Clear the accumulated sums
+ */
+void StructureFactor::reset() {
+    nMeasurements=0;
+    gridSum.assign(kShell.size(),0);
+    selectedSum.assign(phases.size(),0);
+}
+
+
+/* (void) accumulate
+ *    | Add one configuration: O(grid) for the full grid plus O(N) per
+ *    | selected wave vector
+ *  I | (ConstView<int>) spins, 0 at missing sites
+ *    | (vector<complex<double>>) forward FFT of the embedded spin field
+ */
+void StructureFactor::accumulate(const ConstView<int> spins,
+                                 const std::vector<std::complex<double> >& spectrum) {
+    if(nActive == 0) return;
+    nMeasurements++;
+
+    for(size_t g=0; g < gridSum.size(); g++) gridSum[g] += std::norm(spectrum[g])/nActive;
+
+    int nSites=spins.size();
+    for(size_t iK=0; iK < phases.size(); iK++) {
+        std::complex<double> amplitude=0;
+        const std::complex<double>* phase = phases[iK].data();
+        for(int i=0; i < nSites; i++) amplitude += (double) spins[i]*phase[i];
+        selectedSum[iK] += std::norm(amplitude)/nActive;
+    }
+}
+
+
+/* (double) getSelected
+ *    | Returns S(k) for one of the selected wave vectors
+ */
+const double StructureFactor::getSelected(const int iK) {
+    if(nMeasurements == 0) return 0;
+    return selectedSum.at(iK)/nMeasurements;
+}
+
+
+/* (vector<double>) getSelected
+ *    | Returns S(k) for all selected wave vectors, in insertion order
+ */
+const std::vector<double> StructureFactor::getSelected() {
+    std::vector<double> S(selectedSum.size());
+    for(size_t iK=0; iK < S.size(); iK++) S[iK]=getSelected(iK);
+    return S;
+}
+
+
+/* (void) getRadialAverage
+ *    | Fills S averaged over shells of equal |k| on the padded grid
+ *  I | (vector<double>&) |k| in inverse grid units (output)
+ *    | (vector<double>&) S(|k|) (output)
+ */
+void StructureFactor::getRadialAverage(std::vector<double>& k,
+                                       std::vector<double>& S) {
+    k=shellK;
+    S.assign(shellK.size(),0);
+    if(nMeasurements == 0) return;
+    for(size_t g=0; g < gridSum.size(); g++) S[kShell[g]] += gridSum[g];
+    for(size_t s=0; s < S.size(); s++) S[s] /= shellCount[s]*nMeasurements;
+}
+
+
+/* (double) getCorrelationLength
+ *    | Correlation length in grid units from the smallest momentum,
+ *    |     xi = sqrt(S(0)/S(k_min) - 1) / (2 sin(k_min/2)),
+ *    | with S(k_min) averaged over the lattice axes
+ *  O | (double) xi, or 0 if S(0) <= S(k_min)
+ */
+const double StructureFactor::getCorrelationLength() {
+    if(nMeasurements == 0 || kMinIndices.empty()) return 0;
+
+    double S0 = gridSum.at(0);
+    double Smin=0;
+    for(size_t j=0; j < kMinIndices.size(); j++) {
+        Smin += gridSum.at(kMinIndices[j])/kMinIndices.size();
+    }
+    if(Smin <= 0 || S0 <= Smin) return 0;
+    return sqrt(S0/Smin-1)/(2*sin(kMin/2));
+}
+
+
+/* (void) writeState
+ *    | Write the accumulated data to a checkpoint stream
+ */
+void StructureFactor::writeState(std::ostream& os) {
+    StateIO::write(os,nMeasurements);
+    StateIO::write(os,gridSum);
+    StateIO::write(os,selectedSum);
+}
+
+
+/* (void) readState
+ *    | Restore the accumulated data written by writeState. The object
+ *    | must have been set up for the same lattice.
+ */
+void StructureFactor::readState(std::istream& is) {
+    StateIO::read(is,nMeasurements);
+    StateIO::read(is,gridSum);
+    StateIO::read(is,selectedSum);
+}
@@ -0,0 +1,910 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * SweepEngine.cpp                                                             *
+ *                                                                             *
+ * Definitions for the in-process parameter sweep                              *
+ * (see interface/SweepEngine.h)                                               *
+ *                                                                             *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#include "interface/SweepEngine.h"
+#include "interface/IsingModel.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Grid axes, outermost first (the nesting of SubmitCondor.py)
+enum {kSweepH, kSweepJ, kSweepT, kSweepSigma, kSweepSteps, kSweepDim, kSweepDepth,
+      kNumSweepAxes};
+static const char* sweepAxisNames[kNumSweepAxes] = {
+    "h","J","kbT","sigma","numSteps","hDim","depth"};
+
+// The axes a refinement can split (the integer ones cannot)
+static double* refinableValue(SweepPoint& point, const int axis) {
+    switch(axis) {
+        case kSweepH:     return &point.h;
+        case kSweepJ:     return &point.J;
+        case kSweepT:     return &point.kbT;
+        case kSweepSigma: return &point.sigma;
+        case kSweepDim:   return &point.hDim;
+    }
+    return 0;
+}
+
+static double sweepSeconds() {
+    return std::chrono::duration<double>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+static const char* manifestStateNames[SweepManifest::kNumStates] = {
+    "planned","running","done","failed"};
+
+
+/* (const char*) getStateName
+ */
+const char* SweepManifest::getStateName(const int state) {
+    if(state < 0 || state >= kNumStates) return "unknown";
+    return manifestStateNames[state];
+}
+
+
+/* (bool) read
+ *    | Load the manifest file. Points still running in it belong to a
+ *    | sweep that died and are read as failed.
+ *  O | (bool) false if there is none
+ */
+bool SweepManifest::read() {
+    entries.clear();
+    std::ifstream file(fileName.c_str());
+    if(!file) return false;
+
+    std::string line;
+    while(std::getline(file,line)) {
+        if(line.empty() || line[0] == '#') continue;
+        std::istringstream is(line);
+        std::string hashText, state, startText;
+        ManifestEntry entry;
+        SweepPoint& p=entry.point;
+        is>>hashText>>state>>p.index>>p.hDim>>p.depth>>p.kbT>>p.sigma
+          >>p.h>>p.J>>p.numSteps>>startText;
+        if(!is) {
+            std::cout<<"WARNING: Skipping manifest line '"<<line<<"'"<<std::endl;
+            continue;
+        }
+        std::getline(is>>std::ws,entry.location);
+        entry.state=-1;
+        for(int k=0; k < kNumStates; k++) {
+            if(state == manifestStateNames[k]) entry.state=k;
+        }
+        if(entry.state < 0) entry.state=kPlanned;
+        if(entry.state == kRunning) entry.state=kFailed;
+        entry.startHash=strtoull(startText.c_str(),0,16);
+        entries[strtoull(hashText.c_str(),0,16)]=entry;
+    }
+    return true;
+}
+
+
+/* (void) write
+ *    | Write the manifest under a temporary name, sync and rename it, so
+ *    | that the file is complete whenever the sweep dies
+ */
+void SweepManifest::write() {
+    char suffix[32];
+    snprintf(suffix,sizeof(suffix),".tmp%d",(int) getpid());
+    std::string tmpName=fileName+suffix;
+    FILE* file=fopen(tmpName.c_str(),"w");
+    bool ok = file != 0;
+    if(ok) {
+        fprintf(file,"# hash state index hDim depth kbT sigma h J numSteps start location\n");
+        for(auto& entry : entries) {
+            const SweepPoint& p=entry.second.point;
+            fprintf(file,"%016llx %s %d %.17g %d %.17g %.17g %.17g %.17g %d %016llx %s\n",
+                    entry.first,getStateName(entry.second.state),p.index,p.hDim,
+                    p.depth,p.kbT,p.sigma,p.h,p.J,p.numSteps,entry.second.startHash,
+                    entry.second.location.c_str());
+        }
+        ok = fflush(file) == 0 && fsync(fileno(file)) == 0 && !ferror(file);
+        fclose(file);
+    }
+    if(!ok || rename(tmpName.c_str(),fileName.c_str()) != 0) {
+        std::cout<<"ERROR: Could not write "<<fileName<<std::endl;
+        remove(tmpName.c_str());
+        exit(EXIT_FAILURE);
+    }
+}
+
+
+/* (void) plan
+ *    | Add a point in the planned state, unless it is known already
+ */
+void SweepManifest::plan(const unsigned long long hash, const SweepPoint& point) {
+    if(entries.count(hash)) return;
+    entries[hash].point=point;
+}
+
+
+/* (void) setState
+ *  I | (ull) configuration hash of a planned point
+ *    | (int) new state
+ *    | (string) result location, kept if empty
+ */
+void SweepManifest::setState(const unsigned long long hash, const int state,
+                             const std::string& location) {
+    std::map<unsigned long long,ManifestEntry>::iterator found=entries.find(hash);
+    if(found == entries.end()) return;
+    found->second.state=state;
+    if(!location.empty()) found->second.location=location;
+}
+
+
+/* (int) getState
+ *    | Returns the state of a point, -1 if it is not in the manifest
+ */
+const int SweepManifest::getState(const unsigned long long hash) {
+    std::map<unsigned long long,ManifestEntry>::iterator found=entries.find(hash);
+    return found == entries.end() ? -1 : found->second.state;
+}
+
+
+/* (void) setStartHash
+ *    | Record the start of a planned point's run (0: randomized spins),
+ *    | which its checkpoint must be resumed with
+ */
+void SweepManifest::setStartHash(const unsigned long long hash,
+                                 const unsigned long long start) {
+    std::map<unsigned long long,ManifestEntry>::iterator found=entries.find(hash);
+    if(found != entries.end()) found->second.startHash=start;
+}
+
+
+/* (ull) getStartHash
+ *    | Returns the start of a point's last run, 0 if unknown
+ */
+const unsigned long long SweepManifest::getStartHash(const unsigned long long hash) {
+    std::map<unsigned long long,ManifestEntry>::iterator found=entries.find(hash);
+    return found == entries.end() ? 0 : found->second.startHash;
+}
+
+
+/* (long) getNumPoints
+ *    | Number of points in a state
+ */
+const long SweepManifest::getNumPoints(const int state) {
+    long n=0;
+    for(auto& entry : entries) n += (entry.second.state == state);
+    return n;
+}
+
+
+SweepEngine::SweepEngine() {
+    lists.assign(kNumSweepAxes,std::vector<double>());
+};
+SweepEngine::~SweepEngine() {};
+
+
+/* (void) setList
+ *    | Set the values of one grid axis. Unknown names are ignored.
+ *  I | (string) parameter name, as in the result records
+ *    | (vector<double>) values
+ */
+void SweepEngine::setList(const std::string& name, const std::vector<double>& values) {
+    for(int a=0; a < kNumSweepAxes; a++) {
+        if(name == sweepAxisNames[a]) lists[a]=values;
+    }
+}
+
+
+/* (void) setRefinement
+ *    | Refine the grid along one axis after it has run
+ *  I | (string) axis name, as in setList
+ *    | (double) target spacing near the peaks
+ *    | (int) maximum number of refinement stages
+ */
+void SweepEngine::setRefinement(const std::string& name, const double resolution,
+                                const int maxStages) {
+    SweepPoint point;
+    refineAxis=-1;
+    for(int a=0; a < kNumSweepAxes; a++) {
+        if(name == sweepAxisNames[a] && refinableValue(point,a)) refineAxis=a;
+    }
+    if(refineAxis < 0 || resolution <= 0) {
+        std::cout<<"ERROR: Cannot refine along '"<<name<<"' to "<<resolution<<std::endl;
+        exit(EXIT_FAILURE);
+    }
+    refineResolution=resolution;
+    refineMaxStages=maxStages;
+}
+
+
+/* (vector<double>) parseList
+ *    | Values from "a,b,c" or an inclusive range "first:last:step" (as the
+ *    | awk loops in steerScript.sh); both forms can be mixed, "0:1:0.5,3"
+ *  I | (string) list
+ */
+const std::vector<double> SweepEngine::parseList(const std::string& text) {
+    std::vector<double> values;
+    std::stringstream items(text);
+    std::string item;
+    while(std::getline(items,item,',')) {
+        if(item.empty()) continue;
+        double first=0, last=0, step=0;
+        char* end=0;
+        if(item.find(':') == std::string::npos) {
+            first=strtod(item.c_str(),&end);
+            if(*end == '\0') {
+                values.push_back(first);
+                continue;
+            }
+        } else if(sscanf(item.c_str(),"%lf:%lf:%lf",&first,&last,&step) == 3 && step > 0) {
+            // Tolerance against the accumulated rounding of the step
+            for(long i=0; first+i*step <= last+1e-9*step; i++) {
+                values.push_back(first+i*step);
+            }
+            continue;
+        }
+        std::cout<<"ERROR: Invalid list entry '"<<item<<"'"<<std::endl;
+        exit(EXIT_FAILURE);
+    }
+    return values;
+}
+
+
+/* (long) getNumPoints
+ */
+const long SweepEngine::getNumPoints() {
+    long n=1;
+    for(int a=0; a < kNumSweepAxes; a++) n *= lists[a].size();
+    return n;
+}
+
+
+/* (vector<SweepPoint>) getPoints
+ *    | Returns the Cartesian product of the lists, the last axis (depth)
+ *    | running fastest
+ */
+const std::vector<SweepPoint> SweepEngine::getPoints() {
+    std::vector<SweepPoint> points(getNumPoints());
+    for(long n=0; n < (long) points.size(); n++) {
+        std::vector<double> v(kNumSweepAxes);
+        for(int a=kNumSweepAxes-1, rem=n; a >= 0; a--) {
+            v[a] = lists[a][rem % lists[a].size()];
+            rem /= lists[a].size();
+        }
+        SweepPoint& p=points[n];
+        p.index   =n;
+        p.h       =v[kSweepH];
+        p.J       =v[kSweepJ];
+        p.kbT     =v[kSweepT];
+        p.sigma   =v[kSweepSigma];
+        p.numSteps=lround(v[kSweepSteps]);
+        p.hDim    =v[kSweepDim];
+        p.depth   =lround(v[kSweepDepth]);
+    }
+    return points;
+}
+
+
+/* (double) getNumSpins, getCoordination
+ *    | Number of sites, (2 s^depth)^ceil(dim) with s = 2 slices, and the
+ *    | mean number of nearest neighbours 2 p (L-1)/L with open boundaries
+ */
+const double SweepEngine::getNumSpins(const SweepPoint& point) {
+    double L=2*pow(2.,point.depth);
+    return pow(L,ceil(point.hDim));
+}
+
+const double SweepEngine::getCoordination(const SweepPoint& point) {
+    double L=2*pow(2.,point.depth);
+    return 2*ceil(point.hDim)*(L-1)/L;
+}
+
+
+/* (void) setCostModel
+ *  I | (double) seconds per bond visited
+ *    | (double) seconds per spin update
+ */
+void SweepEngine::setCostModel(const double perBond, const double perSpin) {
+    if(perBond < 0 || perSpin < 0) return;
+    costPerBond=perBond;
+    costPerSpin=perSpin;
+}
+
+
+/* (double) estimateCost
+ *    | Returns the predicted run time of a point in seconds
+ */
+const double SweepEngine::estimateCost(const SweepPoint& point) {
+    double N=getNumSpins(point);
+    double bonds = N*getCoordination(point)*(scratchDir.empty() ? N : 1);
+    return point.numSteps*(costPerBond*bonds + costPerSpin*N);
+}
+
+
+/* (void) calibrateCost
+ *    | Fit the cost model to two short benchmark runs on this machine: a
+ *    | small lattice (spin updates dominate) and a larger one (bond visits
+ *    | dominate)
+ */
+void SweepEngine::calibrateCost() {
+    SweepPoint bench[2];
+    bench[0].hDim=1;  bench[0].depth=3; bench[0].numSteps=4000;
+    bench[1].hDim=2;  bench[1].depth=3; bench[1].numSteps=20;
+    bench[0].kbT = bench[1].kbT = 2;
+
+    double t[2], bonds[2], N[2];
+    ResultRecord record;
+    for(int b=0; b < 2; b++) {
+        double begin=sweepSeconds();
+        runPoint(bench[b],record);
+        t[b]=(sweepSeconds()-begin)/bench[b].numSteps;
+        N[b]=getNumSpins(bench[b]);
+        bonds[b]=N[b]*getCoordination(bench[b])*(scratchDir.empty() ? N[b] : 1);
+    }
+
+    // t = perBond*bonds + perSpin*N for both runs
+    double det = bonds[0]*N[1] - bonds[1]*N[0];
+    double perBond = (t[0]*N[1] - t[1]*N[0])/det;
+    double perSpin = (bonds[0]*t[1] - bonds[1]*t[0])/det;
+    if(perBond <= 0) perBond = t[1]/bonds[1];
+    if(perSpin <= 0) perSpin = 0;
+    setCostModel(perBond,perSpin);
+}
+
+
+/* (vector<SweepPoint>) refine
+ *    | One refinement stage. The points are split into lines that differ
+ *    | only along the refinement axis. On each line the intervals next to
+ *    | the chi and C maxima (both sides, or the one inside at an end) and
+ *    | the interval with the steepest |dU/dx| get their midpoint, when
+ *    | they are wider than the resolution.
+ *  I | (vector<SweepPoint>) every point run so far
+ *  O | (vector<SweepPoint>) the new points
+ */
+const std::vector<SweepPoint> SweepEngine::refine(const std::vector<SweepPoint>& points) {
+    std::map<std::vector<double>,std::vector<std::pair<double,int> > > lines;
+    int nextIndex=0;
+    for(size_t n=0; n < points.size(); n++) {
+        SweepPoint p=points[n];
+        double x=*refinableValue(p,refineAxis);
+        *refinableValue(p,refineAxis)=0;
+        std::vector<double> key = {p.h, p.J, p.kbT, p.sigma,
+                                   (double) p.numSteps, p.hDim, (double) p.depth};
+        lines[key].push_back(std::make_pair(x,(int) n));
+        nextIndex=std::max(nextIndex,p.index+1);
+    }
+
+    std::vector<SweepPoint> added;
+    for(auto& entry : lines) {
+        std::vector<std::pair<double,int> >& line=entry.second;
+        std::sort(line.begin(),line.end());
+        int nLine=line.size();
+        if(nLine < 2) continue;
+
+        // Observables along the line (NaN if missing)
+        std::vector<std::vector<double> > obs(nLine,std::vector<double>(3,NAN));
+        for(int i=0; i < nLine; i++) {
+            std::map<int,std::vector<double> >::iterator found
+                = observed.find(points[line[i].second].index);
+            if(found != observed.end()) obs[i]=found->second;
+        }
+
+        // Intervals [i,i+1] to split
+        std::vector<bool> split(nLine-1,false);
+        for(int o=0; o < 2; o++) {
+            int peak=-1;
+            for(int i=0; i < nLine; i++) {
+                if(std::isnan(obs[i][o])) continue;
+                if(peak < 0 || obs[i][o] > obs[peak][o]) peak=i;
+            }
+            if(peak < 0) continue;
+            if(peak > 0)       split[peak-1]=true;
+            if(peak < nLine-1) split[peak]=true;
+        }
+        int steepest=-1;
+        double maxSlope=0;
+        for(int i=0; i < nLine-1; i++) {
+            double slope=fabs(obs[i+1][2]-obs[i][2])/(line[i+1].first-line[i].first);
+            if(std::isnan(slope) || slope <= maxSlope) continue;
+            maxSlope=slope;
+            steepest=i;
+        }
+        if(steepest >= 0) split[steepest]=true;
+
+        for(int i=0; i < nLine-1; i++) {
+            double width=line[i+1].first-line[i].first;
+            if(!split[i] || width <= refineResolution*(1+1e-9)) continue;
+            SweepPoint p=points[line[i].second];
+            *refinableValue(p,refineAxis)=line[i].first+width/2;
+            p.index=nextIndex++;
+            added.push_back(p);
+        }
+    }
+    return added;
+}
+
+
+/* (vector<vector<int> >) groupByGeometry
+ *    | Points with the same lattice (dim, depth, sigma) in the order one
+ *    | model walks them: by steps, J and h, with kbT running down and up
+ *    | on alternate lines, so that every point is a neighbour of the one
+ *    | before and the first starts hot. A group costing more than a
+ *    | worker's share of the sweep is cut into consecutive pieces of about
+ *    | that share, which then build their lattice separately.
+ *  I | (vector<SweepPoint>) the points
+ *  O | (vector<vector<int> >) point indices of each group
+ */
+const std::vector<std::vector<int> > SweepEngine::groupByGeometry(
+        const std::vector<SweepPoint>& points) {
+    std::vector<int> order(points.size());
+    double total=0;
+    for(size_t n=0; n < points.size(); n++) {
+        order[n]=n;
+        total += estimateCost(points[n]);
+    }
+    std::sort(order.begin(),order.end(),[&](const int a, const int b) {
+        const SweepPoint& p=points[a];
+        const SweepPoint& q=points[b];
+        if(p.hDim != q.hDim)         return p.hDim < q.hDim;
+        if(p.depth != q.depth)       return p.depth < q.depth;
+        if(p.sigma != q.sigma)       return p.sigma < q.sigma;
+        if(p.numSteps != q.numSteps) return p.numSteps < q.numSteps;
+        if(p.J != q.J)               return p.J < q.J;
+        if(p.h != q.h)               return p.h < q.h;
+        return p.kbT > q.kbT;
+    });
+
+    double share=total/std::max(1,pool.getNumThreads());
+    std::vector<std::vector<int> > groups;
+    double cost=0;
+    bool reverse=false;
+    for(size_t begin=0, end=0; begin < order.size(); begin=end) {
+        const SweepPoint& first=points[order[begin]];
+        bool newLattice = begin == 0
+                       || first.hDim  != points[order[begin-1]].hDim
+                       || first.depth != points[order[begin-1]].depth
+                       || first.sigma != points[order[begin-1]].sigma;
+
+        // One line of kbT values
+        for(end=begin; end < order.size(); end++) {
+            const SweepPoint& p=points[order[end]];
+            if(p.hDim != first.hDim || p.depth != first.depth || p.sigma != first.sigma
+               || p.numSteps != first.numSteps || p.J != first.J || p.h != first.h) break;
+        }
+        reverse = newLattice ? false : !reverse;
+        if(reverse) std::reverse(order.begin()+begin,order.begin()+end);
+
+        for(size_t n=begin; n < end; n++) {
+            double c=estimateCost(points[order[n]]);
+            if(groups.empty() || (newLattice && n == begin)
+               || cost >= share) {
+                groups.push_back(std::vector<int>());
+                cost=0;
+            }
+            groups.back().push_back(order[n]);
+            cost += c;
+        }
+    }
+    return groups;
+}
+
+
+/* (vector<vector<int> >) scheduleByCost
+ *    | Longest processing time first: tasks sorted by decreasing cost,
+ *    | each given to the worker with the least work so far. Every queue
+ *    | then holds its most expensive tasks first.
+ *  I | (vector<double>) estimated cost of each task
+ */
+const std::vector<std::vector<int> > SweepEngine::scheduleByCost(
+        const std::vector<double>& taskCosts) {
+    std::vector<std::pair<double,int> > costs(taskCosts.size());
+    for(size_t n=0; n < taskCosts.size(); n++) {
+        costs[n]=std::make_pair(-taskCosts[n],(int) n);
+    }
+    std::sort(costs.begin(),costs.end());
+
+    int nWorkers=pool.getNumThreads();
+    std::vector<std::vector<int> > queues(nWorkers);
+    std::vector<double> load(nWorkers,0);
+    for(size_t n=0; n < costs.size(); n++) {
+        int w = std::min_element(load.begin(),load.end()) - load.begin();
+        queues[w].push_back(costs[n].second);
+        load[w] -= costs[n].first;
+    }
+    return queues;
+}
+
+
+/* (void) configure
+ *    | Settings of one point, as runIsingModel sets them
+ */
+void SweepEngine::configure(IsingModel& model, const SweepPoint& point) {
+    model.setDebug             (false);
+    model.setNumThreads        (1);
+    model.setNumMCSteps        (point.numSteps);
+    model.setTargetEffSamples  (targetEffSamples);
+    model.setCorrelationInterval(correlationInterval);
+    model.setStructureFactorInterval(structureFactorInterval);
+    model.setClusterInterval   (clusterInterval);
+    model.setBlockInterval     (blockInterval);
+    model.setOutOfCore         (scratchDir);
+    model.setLatticeDepth      (point.depth);
+    model.setHausdorffDimension(point.hDim);
+    model.setHausdorffMethod   ("SCALING");
+    model.setMCMethod          ("METROPOLIS");
+    model.setInteractionSigma  (point.sigma);
+    model.setTemperature       (point.kbT);
+    model.setCouplingConsts    (point.h,point.J);
+}
+
+
+/* (void) runPoint
+ *    | Simulate one point and fill its record
+ *  I | (SweepPoint) the point
+ *    | (ResultRecord&) its results (output)
+ */
+void SweepEngine::runPoint(const SweepPoint& point, ResultRecord& record) {
+    IsingModel model;
+    configure(model,point);
+    model.setup();
+    model.randomizeSpins();
+    simulate(model,point,record);
+}
+
+
+/* (void) runGroup
+ *    | Run the points of one group on a single model. The lattice is set
+ *    | up for the first point that is not in the store; later points only
+ *    | change kbT, h, J and the steps and, with warm starts, begin from the
+ *    | spins the previous point ended with (burn-in detection then ends
+ *    | early). The previous point's hash is then part of the configuration
+ *    | hash, so warm and cold results are stored apart. A point whose
+ *    | predecessor came from the store starts cold, as do all points
+ *    | without warm starts. A point that failed continues from its
+ *    | checkpoint, with the start the manifest has for it.
+ *  I | (vector<SweepPoint>) all points
+ *    | (vector<int>) indices of the group's points, in walking order
+ */
+void SweepEngine::runGroup(const std::vector<SweepPoint>& points,
+                           const std::vector<int>& group) {
+    IsingModel model;
+    bool isBuilt=false;
+    unsigned long long previousHash=0; // previous point of the group
+    unsigned long long spinsHash=0;    // run that left the model's spins
+    for(size_t n=0; n < group.size(); n++) {
+        const SweepPoint& point=points[group[n]];
+        if(n == 0) {
+            configure(model,point);
+        } else {
+            model.setNumMCSteps    (point.numSteps);
+            model.setTemperature   (point.kbT);
+            model.setCouplingConsts(point.h,point.J);
+        }
+
+        // The manifest and the checkpoints know the point by its
+        // cold-start hash
+        model.setStartHash(0);
+        unsigned long long key=model.getConfigurationHash();
+
+        ResultRecord record;
+        model.setStartHash(warmStart ? previousHash : 0);
+        unsigned long long hash=model.getConfigurationHash();
+        bool cached = !store.getDirectory().empty() && store.load(hash,record);
+        if(!cached && model.getStartHash() != 0 && model.getStartHash() != spinsHash) {
+            model.setStartHash(0);
+            hash=key;
+            cached = !store.getDirectory().empty() && store.load(hash,record);
+        }
+        if(!cached) {
+            bool useCheckpoint = checkpointInterval > 0 && !manifest.getFileName().empty();
+            std::string checkpoint = useCheckpoint ? getCheckpointFile(key) : "";
+            if(!manifest.getFileName().empty()) {
+                std::lock_guard<std::mutex> guard(outputLock);
+
+                // A point that failed continues from its checkpoint, which
+                // belongs to the start it was run from
+                if(useCheckpoint && access(checkpoint.c_str(),F_OK) == 0) {
+                    model.setStartHash(manifest.getStartHash(key));
+                    hash=model.getConfigurationHash();
+                }
+                manifest.setState(key,SweepManifest::kRunning);
+                manifest.setStartHash(key,model.getStartHash());
+                manifest.write();
+            }
+            if(!isBuilt) model.setup();
+            isBuilt=true;
+            if(model.getStartHash() == 0) {
+                model.setAllSpins(1);
+                model.randomizeSpins();
+            }
+            if(useCheckpoint) model.setCheckpoint(checkpoint,checkpointInterval);
+            simulate(model,point,record);
+            spinsHash=hash;
+        }
+        previousHash=hash;
+        finish(point,record,cached,key);
+    }
+}
+
+
+/* (void) simulate
+ *    | Run a set-up model from its current spins and fill the record
+ */
+void SweepEngine::simulate(IsingModel& model, const SweepPoint& point,
+                           ResultRecord& record) {
+    record.clear();
+    record.addValue("m_o",  model.getMagnetization());
+    record.addValue("Ham_o",model.getEffHamiltonian());
+    model.runMonteCarlo();
+    fillRecord(model,point,record);
+}
+
+
+/* (void) fillRecord
+ *    | Parameters and results under the names of runIsingModel's record
+ *    | (its scalar branches). Graphs are left out, no ROOT objects are
+ *    | created on the worker threads.
+ */
+void SweepEngine::fillRecord(IsingModel& model, const SweepPoint& point,
+                             ResultRecord& record) {
+    record.setTag("RUN");
+    record.setConfigurationHash(model.getConfigurationHash());
+    record.addParameter("hDim",    point.hDim);
+    record.addParameter("depth",   point.depth);
+    record.addParameter("kbT",     point.kbT);
+    record.addParameter("sigma",   point.sigma);
+    record.addParameter("h",       point.h);
+    record.addParameter("J",       point.J);
+    record.addParameter("numSteps",point.numSteps);
+    record.addParameter("threads", 1);
+
+    record.addValue("m",         model.getm());
+    record.addValue("Ham",       model.getEffHamiltonian());
+    record.addValue("Z",         0);
+    record.addValue("h",         model.getH());
+    record.addValue("J",         model.getJ());
+    record.addValue("sigma",     model.getInteractionSigma());
+    record.addValue("kbT",       model.getkbT());
+    record.addValue("hSlices",   model.getHausdorffSlices());
+    record.addValue("hSpacing",  model.getHausdorffScale());
+    record.addValue("hDim",      model.getHausdorffDimension());
+    record.addValue("numSpins",  model.getNumSpins());
+    record.addValue("depth",     model.getLatticeDepth());
+    record.addValue("numSteps",  model.getNumMCSteps());
+    record.addValue("numSweeps", model.getNumSweeps());
+    record.addValue("numBurnIn", model.getNumBurnInSweeps());
+    record.addValue("equilibrated",model.getIsEquilibrated());
+    record.addValue("tauE",      model.getTauIntEnergy());
+    record.addValue("tauM",      model.getTauIntMagnetization());
+    record.addValue("numEff",    model.getNumEffSamples());
+    record.addValue("acceptance",model.getAcceptanceRate());
+    record.addValue("E_avg",     model.getMeanEnergy().value);
+    record.addValue("E_err",     model.getMeanEnergy().error);
+    record.addValue("absM_avg",  model.getMeanAbsMagnetization().value);
+    record.addValue("absM_err",  model.getMeanAbsMagnetization().error);
+    record.addValue("C",         model.getSpecificHeat().value);
+    record.addValue("C_err",     model.getSpecificHeat().error);
+    record.addValue("chi",       model.getSusceptibility().value);
+    record.addValue("chi_err",   model.getSusceptibility().error);
+    record.addValue("U",         model.getBinderCumulant().value);
+    record.addValue("U_err",     model.getBinderCumulant().error);
+    record.addValue("xi",        model.getCorrelationLength());
+    record.addValue("xi_Sk",     model.getStructureFactorLength());
+
+    ClusterAnalysis& clusters=model.getClusterAnalysis();
+    record.addValue("domLargest",clusters.getLargestFraction(ClusterAnalysis::kDomains));
+    record.addValue("domSpan",   clusters.getSpanningProbability(ClusterAnalysis::kDomains));
+    record.addValue("fkLargest", clusters.getLargestFraction(ClusterAnalysis::kFKClusters));
+    record.addValue("fkSpan",    clusters.getSpanningProbability(ClusterAnalysis::kFKClusters));
+    record.addValue("fkMeanSize",clusters.getMeanClusterSize(ClusterAnalysis::kFKClusters));
+
+    std::vector<double> length, U, UErr, R, RErr;
+    BlockSpins& blocks=model.getBlockSpins();
+    for(int k=0; k < blocks.getNumLevels() && blockInterval > 0; k++) {
+        length.push_back(blocks.getBlockLength(k));
+        U.push_back(blocks.getBinderCumulant(k).value);
+        UErr.push_back(blocks.getBinderCumulant(k).error);
+        R.push_back(blocks.getCorrelationRatio(k).value);
+        RErr.push_back(blocks.getCorrelationRatio(k).error);
+    }
+    record.addArray("blockLength",length);
+    record.addArray("blockU",     U);
+    record.addArray("blockU_err", UErr);
+    record.addArray("blockR",     R);
+    record.addArray("blockR_err", RErr);
+}
+
+
+/* (void) finish
+ *    | Write a finished point and report the progress (at most every 10 s)
+ *  I | (SweepPoint) the point
+ *    | (ResultRecord&) its results
+ *    | (bool) whether they came from the store
+ *    | (ull) its key in the manifest (getConfigurationHash of the point)
+ */
+void SweepEngine::finish(const SweepPoint& point, ResultRecord& record,
+                         const bool cached, const unsigned long long key) {
+    std::lock_guard<std::mutex> guard(outputLock);
+    if(!cached && !store.getDirectory().empty()) {
+        store.store(record.getConfigurationHash(),record);
+    }
+    ResultFile::append(outFile,record);
+    if(!manifest.getFileName().empty()) {
+        unsigned long long hash=record.getConfigurationHash();
+        manifest.setState(key,SweepManifest::kDone,
+                          store.getDirectory().empty() ? outFile : store.getPath(hash));
+        manifest.write();
+        if(checkpointInterval > 0) remove(getCheckpointFile(key).c_str());
+    }
+    if(refineAxis >= 0) {
+        observed[point.index] = {record.getValue("chi"), record.getValue("C"),
+                                 record.getValue("U")};
+    }
+
+    nDone++;
+    if(cached) nCached++;
+    double now=sweepSeconds();
+    if(verbose && (now-lastReport > 10 || nDone == nPlanned)) {
+        std::cout<<"\t - Sweep: "<<nDone<<"/"<<nPlanned<<" points done";
+        if(nCached > 0) std::cout<<" ("<<nCached<<" from the store)";
+        std::cout<<std::endl;
+        lastReport=now;
+    }
+}
+
+
+/* (long) run
+ *    | Run every grid point on the pool and append the results to the
+ *    | output file, then the refinement stages. Each stage runs all of
+ *    | its new points at once, on every line of the grid.
+ *  O | (long) number of points written
+ */
+const long SweepEngine::run() {
+    if(outFile.empty()) {
+        std::cout<<"ERROR: No output file for the sweep"<<std::endl;
+        exit(EXIT_FAILURE);
+    }
+    std::vector<SweepPoint> points=getPoints();
+    nDone=0;
+    nCached=0;
+    nPlanned=0;
+    observed.clear();
+    previous.clear();
+    lastReport=sweepSeconds();
+
+    // Restart from the manifest of an earlier run
+    if(!manifest.getFileName().empty() && manifest.read()) {
+        readPrevious();
+        if(verbose) {
+            std::cout<<"\t - Manifest "<<manifest.getFileName()<<": "
+                     <<manifest.getNumPoints(SweepManifest::kDone)<<" points done, "
+                     <<manifest.getNumPoints(SweepManifest::kFailed)<<" failed"
+                     <<(checkpointInterval > 0 ? ", unfinished points continue from"
+                                                 " their checkpoints" : "")
+                     <<std::endl;
+        }
+    }
+    if(checkpointInterval > 0 && !manifest.getFileName().empty()) {
+        mkdir((manifest.getFileName()+".ckpt").c_str(),0755);
+    }
+    runPoints(points);
+
+    for(int stage=1; refineAxis >= 0 && stage <= refineMaxStages; stage++) {
+        std::vector<SweepPoint> added=refine(points);
+        if(added.empty()) break;
+        if(verbose) {
+            std::cout<<"\t - Refinement stage "<<stage<<": "<<added.size()
+                     <<" points along "<<sweepAxisNames[refineAxis]<<std::endl;
+        }
+        runPoints(added);
+        points.insert(points.end(),added.begin(),added.end());
+    }
+    if(!manifest.getFileName().empty()) manifest.write();
+    return nDone;
+}
+
+
+/* (ull) getConfigurationHash
+ *    | Hash of a point's results (IsingModel::getConfigurationHash),
+ *    | without building the lattice
+ */
+const unsigned long long SweepEngine::getConfigurationHash(const SweepPoint& point) {
+    IsingModel model;
+    configure(model,point);
+    return model.getConfigurationHash();
+}
+
+
+/* (string) getCheckpointFile
+ */
+const std::string SweepEngine::getCheckpointFile(const unsigned long long hash) {
+    char name[32];
+    snprintf(name,sizeof(name),"%016llx.ckpt",hash);
+    return manifest.getFileName()+".ckpt/"+name;
+}
+
+
+/* (void) readPrevious
+ *    | chi, C and U of the points in the result file, by manifest key,
+ *    | so that a restarted refinement sees the finished points. The key
+ *    | is recomputed from the parameters, as warm-started records carry
+ *    | a different hash. Points that reached the file but not the
+ *    | manifest (a crash in between) are marked done, not run twice.
+ */
+void SweepEngine::readPrevious() {
+    ResultFile file;
+    file.open(outFile);
+    ResultRecord record;
+    for(long k=0; k < file.getNumRecords(); k++) {
+        if(!file.read(k,record)) continue;
+        SweepPoint point;
+        point.hDim    =record.getParameter("hDim");
+        point.depth   =record.getParameter("depth");
+        point.kbT     =record.getParameter("kbT");
+        point.sigma   =record.getParameter("sigma");
+        point.h       =record.getParameter("h");
+        point.J       =record.getParameter("J");
+        point.numSteps=record.getParameter("numSteps");
+        unsigned long long key=getConfigurationHash(point);
+        previous[key] = {record.getValue("chi"),record.getValue("C"),record.getValue("U")};
+        if(manifest.getState(key) != SweepManifest::kDone) {
+            unsigned long long hash=record.getConfigurationHash();
+            manifest.setState(key,SweepManifest::kDone,
+                              store.getDirectory().empty() ? outFile : store.getPath(hash));
+        }
+    }
+}
+
+
+/* (void) runPoints
+ *    | Run a set of points on the pool, grouped by lattice and dealt out
+ *    | by cost
+ */
+void SweepEngine::runPoints(const std::vector<SweepPoint>& allPoints) {
+    // Points the manifest has as done are not run again
+    std::vector<SweepPoint> points;
+    long nDoneBefore=0;
+    for(const SweepPoint& point : allPoints) {
+        if(!manifest.getFileName().empty()) {
+            unsigned long long hash=getConfigurationHash(point);
+            manifest.plan(hash,point);
+            if(manifest.getState(hash) == SweepManifest::kDone) {
+                if(previous.count(hash)) observed[point.index]=previous[hash];
+                nDoneBefore++;
+                continue;
+            }
+        }
+        points.push_back(point);
+    }
+    if(!manifest.getFileName().empty()) manifest.write();
+    if(verbose && nDoneBefore > 0) {
+        std::cout<<"\t - Sweep: "<<nDoneBefore<<" points done in an earlier run"<<std::endl;
+    }
+    if(points.empty()) return;
+    nPlanned += points.size();
+    std::vector<std::vector<int> > groups=groupByGeometry(points);
+    std::vector<double> costs(groups.size(),0);
+    double total=0;
+    for(size_t g=0; g < groups.size(); g++) {
+        for(size_t n=0; n < groups[g].size(); n++) {
+            costs[g] += estimateCost(points[groups[g][n]]);
+        }
+        total += costs[g];
+    }
+    if(verbose) {
+        std::cout<<"\t - Sweep: "<<points.size()<<" points in "
+                 <<groups.size()<<" lattice groups on "
+                 <<pool.getNumThreads()<<" threads, estimated "
+                 <<total/pool.getNumThreads()<<" s"<<std::endl;
+    }
+
+    pool.run(scheduleByCost(costs),[&](const int task, const int worker) {
+        runGroup(points,groups[task]);
+    });
+}
@@ -0,0 +1,227 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * SweepWriter.cpp                                                             *
+ *                                                                             *
+ * Definitions for the columnar time-series writer and reader                  *
+ * (see interface/SweepWriter.h)                                               *
+ *                                                                             *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#include "interface/SweepWriter.h"
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+static const char sweepMagic[]  = "ISWEEPS1";
+static const char sweepFooter[] = "ISWIDX01";
+
+SweepWriter::SweepWriter() : done(false) {};
+SweepWriter::~SweepWriter() {close();};
+
+
+/* (void) open
+ *    | Create the file, write the header and start the writer thread
+ *  I | (string) output file name
+ *    | (vector<string>) column names, in the order of the rows passed to add
+ */
+void SweepWriter::open(const std::string& fileName,
+                       const std::vector<std::string>& columns) {
+    close();
+    file=fopen(fileName.c_str(),"wb");
+    if(!file) {
+        std::cout<<"ERROR: Cannot open "<<fileName<<" for writing"<<std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    nColumns=columns.size();
+    unsigned int nCols=nColumns;
+    fwrite(sweepMagic,1,8,file);
+    fwrite(&nCols,sizeof(nCols),1,file);
+    for(int c=0; c < nColumns; c++) {
+        unsigned int len=columns.at(c).size();
+        fwrite(&len,sizeof(len),1,file);
+        fwrite(columns.at(c).data(),1,len,file);
+    }
+
+    nRows=0;
+    nWritten=0;
+    chunkOffsets.clear();
+    chunkFirstRows.clear();
+    batch=new std::vector<double>();
+    batch->reserve(batchSize*nColumns);
+    done.store(false);
+    writer=std::thread(&SweepWriter::writeLoop,this);
+}
+
+
+/* (void) add
+ *    | Append one row to the local batch; a full batch is handed to the
+ *    | writer if the queue has room, otherwise it keeps growing
+ *  I | (vector<double>) one value per column
+ */
+void SweepWriter::add(const std::vector<double>& row) {
+    if(!file) return;
+    if((int) row.size() != nColumns) {
+        std::cout<<"ERROR: Row has "<<row.size()<<" values, expected "
+                 <<nColumns<<std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    batch->insert(batch->end(),row.begin(),row.end());
+    nRows++;
+    if((int) batch->size() >= batchSize*nColumns) flush();
+}
+
+
+/* (void) flush
+ *    | Try to hand the current batch to the writer without waiting
+ */
+void SweepWriter::flush() {
+    if(batch->empty() || !queue.push(batch)) return;
+    batch=new std::vector<double>();
+    batch->reserve(batchSize*nColumns);
+}
+
+
+/* (void) close
+ *    | Hand over the last batch, wait for the writer to drain the queue
+ *    | and write the chunk index
+ */
+void SweepWriter::close() {
+    if(!file) return;
+
+    if(batch->empty()) delete batch;
+    else while(!queue.push(batch)) std::this_thread::yield();
+    batch=0;
+    done.store(true,std::memory_order_release);
+    writer.join();
+
+    unsigned long long nChunks=chunkOffsets.size();
+    for(size_t i=0; i < nChunks; i++) {
+        fwrite(&chunkOffsets[i],sizeof(unsigned long long),1,file);
+        fwrite(&chunkFirstRows[i],sizeof(unsigned long long),1,file);
+    }
+    fwrite(&nChunks,sizeof(nChunks),1,file);
+    fwrite(&nWritten,sizeof(nWritten),1,file);
+    fwrite(sweepFooter,1,8,file);
+    fclose(file);
+    file=0;
+}
+
+
+/* (void) writeLoop
+ *    | Writer thread: write batches as they arrive until close() is called
+ *    | and the queue is empty
+ */
+void SweepWriter::writeLoop() {
+    while(true) {
+        bool finished=done.load(std::memory_order_acquire);
+        std::vector<double>* rows;
+        while(queue.pop(rows)) {
+            writeChunk(*rows);
+            delete rows;
+        }
+        if(finished) break;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+
+/* (void) writeChunk
+ *    | Transpose a batch of rows into columns and write it as one chunk
+ */
+void SweepWriter::writeChunk(const std::vector<double>& rows) {
+    unsigned int n=rows.size()/nColumns;
+    chunkOffsets.push_back(ftello(file));
+    chunkFirstRows.push_back(nWritten);
+    fwrite(&n,sizeof(n),1,file);
+
+    std::vector<double> column(n);
+    for(int c=0; c < nColumns; c++) {
+        for(unsigned int r=0; r < n; r++) column[r]=rows[r*nColumns+c];
+        fwrite(column.data(),sizeof(double),n,file);
+    }
+    nWritten += n;
+}
+
+
+SweepReader::SweepReader() {};
+SweepReader::~SweepReader() {close();};
+
+
+/* (void) open
+ *    | Read the column names and the chunk index
+ *  I | (string) file written by SweepWriter
+ */
+void SweepReader::open(const std::string& fileName) {
+    close();
+    file=fopen(fileName.c_str(),"rb");
+    char magic[8];
+    if(!file || fread(magic,1,8,file) != 8 || memcmp(magic,sweepMagic,8) != 0) {
+        std::cout<<"ERROR: "<<fileName<<" is not a sweep file"<<std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    unsigned int nCols=0;
+    fread(&nCols,sizeof(nCols),1,file);
+    for(unsigned int c=0; c < nCols; c++) {
+        unsigned int len=0;
+        fread(&len,sizeof(len),1,file);
+        std::string name(len,' ');
+        fread(&name[0],1,len,file);
+        columnNames.push_back(name);
+    }
+
+    unsigned long long nChunks=0, nTotal=0;
+    fseeko(file,-24,SEEK_END);
+    fread(&nChunks,sizeof(nChunks),1,file);
+    fread(&nTotal,sizeof(nTotal),1,file);
+    if(fread(magic,1,8,file) != 8 || memcmp(magic,sweepFooter,8) != 0) {
+        std::cout<<"ERROR: "<<fileName<<" has no chunk index (not closed?)"<<std::endl;
+        exit(EXIT_FAILURE);
+    }
+    nRows=nTotal;
+
+    chunkOffsets.resize(nChunks);
+    chunkFirstRows.resize(nChunks);
+    fseeko(file,-24-16*(off_t) nChunks,SEEK_END);
+    for(size_t i=0; i < nChunks; i++) {
+        fread(&chunkOffsets[i],sizeof(unsigned long long),1,file);
+        fread(&chunkFirstRows[i],sizeof(unsigned long long),1,file);
+    }
+}
+
+
+/* (void) close
+ */
+void SweepReader::close() {
+    if(file) fclose(file);
+    file=0;
+    nRows=0;
+    columnNames.clear();
+    chunkOffsets.clear();
+    chunkFirstRows.clear();
+}
+
+
+/* (void) readColumn
+ *    | Load one column over all rows, reading only that column's data
+ *  I | (string) column name
+ *    | (vector<double>&) values (output)
+ */
+void SweepReader::readColumn(const std::string& column, std::vector<double>& values) {
+    int c=-1;
+    for(size_t i=0; i < columnNames.size(); i++) if(columnNames[i] == column) c=i;
+    if(!file || c < 0) {
+        std::cout<<"ERROR: No column "<<column<<" in sweep file"<<std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    values.resize(nRows);
+    for(size_t i=0; i < chunkOffsets.size(); i++) {
+        unsigned int n=0;
+        fseeko(file,chunkOffsets[i],SEEK_SET);
+        fread(&n,sizeof(n),1,file);
+        fseeko(file,(off_t) c*n*sizeof(double),SEEK_CUR);
+        fread(&values[chunkFirstRows[i]],sizeof(double),n,file);
+    }
+}
@@ -1,8 +1,16 @@
-#include "IsingModel.cpp"
+// The model comes from libIsingModel (make lib), which Cling loads
+// instead of interpreting the sources; executables link the objects
+#if defined(__CLING__) && !defined(__ACLIC__)
+R__LOAD_LIBRARY(libIsingModel)
+#endif
+#include "interface/IsingModel.h"
+#include "interface/ResultFile.h"
 #include "TFile.h"
 #include "TString.h"
 #include "TCanvas.h"
 #include "TTree.h"
+#include "TBranch.h"
+#include "TLeaf.h"
 
 std::clock_t start = std::clock();
 double getTimeDelta() {
@@ -27,7 +35,8 @@ void getPartitionFunction(Double_t HDIM,
                    Double_t COUPLING_H, 
                    Double_t COUPLING_J, 
                    Int_t NMCSTEPS, 
-                   Int_t NTHREADS) {
+                   Int_t NTHREADS,
+                   const char* OUTFILE="") {
     /*
      *  Make the ntuple 
      */
@@ -36,7 +45,10 @@ void getPartitionFunction(Double_t HDIM,
     sprintf(name, "%1.2f_d%i_%3.2ft_%1.2fs_%2.2fh_%2.2fj_%im_%i_PARTITION",
                 HDIM,DEPTH,KBT,SIGMA,
                 COUPLING_H,COUPLING_J,NMCSTEPS,NTHREADS);
-    TFile *outFile = new TFile(TString(name).ReplaceAll(".","-")+".root","RECREATE");
+    // With OUTFILE set, all configurations of a scan share one result file
+    Bool_t toResultFile = strlen(OUTFILE) > 0;
+    TFile *outFile = 0;
+    if(!toResultFile) outFile = new TFile(TString(name).ReplaceAll(".","-")+".root","RECREATE");
     TTree *outTree = new TTree("HausdorffIsingModel","Partition function data for HausdorffIsingModel");
 
     Int_t    tmagInit          =0;
@@ -116,6 +128,28 @@ void getPartitionFunction(Double_t HDIM,
     /*
      *  Write the output 
      */
+    if(toResultFile) {
+        ResultRecord record("PARTITION");
+        record.setConfigurationHash(model.getConfigurationHash());
+        record.addParameter("hDim",    HDIM);
+        record.addParameter("depth",   DEPTH);
+        record.addParameter("kbT",     KBT);
+        record.addParameter("sigma",   SIGMA);
+        record.addParameter("h",       COUPLING_H);
+        record.addParameter("J",       COUPLING_J);
+        record.addParameter("numSteps",NMCSTEPS);
+        record.addParameter("threads", NTHREADS);
+
+        TIter nextBranch(outTree->GetListOfBranches());
+        while(TBranch *branch = (TBranch*) nextBranch()) {
+            TLeaf *leaf = (TLeaf*) branch->GetListOfLeaves()->At(0);
+            if(branch->InheritsFrom("TBranchElement") || !leaf || leaf->GetLen() != 1) continue;
+            record.addValue(branch->GetName(),leaf->GetValue());
+        }
+
+        ResultFile::append(OUTFILE,record);
+        return;
+    }
     outFile->cd();
     outTree->Write();
     outFile->Close();
@@ -0,0 +1,68 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Autocorrelation.h                                                           *
+ *                                                                             *
+ * Online integrated autocorrelation time estimator. Key characteristics:      *
+ *  - Buffers a scalar time series (e.g. one entry per MC sweep)               *
+ *  - Autocorrelation function evaluated by FFT in O(n log n)                  *
+ *  - Sokal automatic windowing for tau_int                                    *
+ *  - Bounded buffer: when full, neighbouring entries are averaged in pairs    *
+ *                                                                             *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#ifndef AUTOCORRELATION_H
+#define AUTOCORRELATION_H
+
+#include <iosfwd>
+#include <vector>
+#include "FFT.h"
+
+class AutocorrelationEstimator {
+    public :
+        // Constructors, destructor
+        AutocorrelationEstimator(const int maxBuffer=1<<20);
+        virtual ~AutocorrelationEstimator();
+
+        // Settings
+        void setWindowConstant(const double c) {if(c > 0) windowC=c; stale=true;}
+        void setMaxBufferSize (const int num);
+
+        // Input
+        void add(const double x);
+        void reset();
+
+        // Checkpointing of the accumulated data
+        void writeState(std::ostream& os);
+        void readState(std::istream& is);
+
+        // Results (tau_int in units of input samples)
+        const long   getNumSamples()    {return nSamples;}
+        const double getMean();
+        const double getTauInt();
+        const double getNumEffSamples();
+        const int    getWindow()        {getTauInt(); return window*binSize;}
+        const int    getBinSize()       {return binSize;}
+
+    private :
+        // Settings
+        int    maxBufferSize=1<<20;
+        double windowC=6;
+
+        // Buffered series
+        std::vector<double> buffer;
+        int    binSize=1;
+        double pendingSum=0;
+        int    pendingCount=0;
+        long   nSamples=0;
+        double rawMean=0;
+        double rawM2=0;
+
+        // Cached results
+        bool   stale=true;
+        double tauInt=0.5;
+        int    window=0;
+        FFTPlan plan;
+
+        void compute();
+        void coarsen();
+};
+
+#endif
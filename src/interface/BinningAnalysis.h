@@ -0,0 +1,80 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * BinningAnalysis.h                                                           *
+ *                                                                             *
+ * Error analysis for correlated MC series. Key characteristics:               *
+ *  - Logarithmic binning: one accumulator per bin size 2^l, so memory is      *
+ *    O(log n) per observable and series are never stored                      *
+ *  - Jackknife over a fixed number of bins that are merged pairwise as the    *
+ *    series grows, giving errors for arbitrary functions of the means         *
+ *                                                                             *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#ifndef BINNINGANALYSIS_H
+#define BINNINGANALYSIS_H
+
+#include <functional>
+#include <iosfwd>
+#include <vector>
+
+// Central value with its statistical error
+struct Estimate {
+    double value;
+    double error;
+};
+
+class BinningAnalysis {
+    public :
+        // Constructors, destructor
+        BinningAnalysis(const int nObs=1, const int nBins=64);
+        virtual ~BinningAnalysis();
+
+        // Settings (both clear the accumulated data)
+        void setNumObservables   (const int num);
+        void setNumJackknifeBins (const int num);
+
+        // Input: one value per observable
+        void add(const std::vector<double>& x);
+        void reset();
+
+        // Checkpointing of the accumulated data
+        void writeState(std::ostream& os);
+        void readState(std::istream& is);
+
+        // Plain observables
+        const long   getNumSamples()     {return nSamples;}
+        const int    getNumLevels()      {return levels.size();}
+        const double getMean(const int iObs);
+        const double getBinningError(const int iObs, const int level);
+        const double getError(const int iObs);
+        const Estimate getEstimate(const int iObs);
+
+        // Derived observables f(<x_0>, <x_1>, ...)
+        const Estimate getJackknife(
+                const std::function<double(const std::vector<double>&)>& f);
+
+    private :
+        // Accumulators for bins of size 2^l
+        struct binLevel {
+            std::vector<double> pending;
+            bool   hasPending;
+            long   nBlocks;
+            std::vector<double> sum;
+            std::vector<double> sumSq;
+        };
+
+        int  nObservables=1;
+        long nSamples=0;
+        std::vector<double> total;
+        std::vector<binLevel> levels;
+
+        // Jackknife bins (sums over binLength samples each)
+        int  nJackknifeBins=64;
+        long binLength=1;
+        long pendingCount=0;
+        std::vector<double> pendingBin;
+        std::vector<std::vector<double> > bins;
+
+        void addToLevel(const int l, const std::vector<double>& x);
+        void mergeBins();
+};
+
+#endif
@@ -0,0 +1,64 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * BlockSpins.h                                                                *
+ *                                                                             *
+ * Block-spin observables on the levels of the fractal. Key characteristics:   *
+ *  - Level k blocks are the sub-cells of 2*slices^k sites per axis; level 0   *
+ *    is a single hypercube of 2^p corners, the top level the whole lattice    *
+ *  - One bottom-up pass per measurement: every level is summed from the       *
+ *    partial sums of its children, O(N) in total                              *
+ *  - Level-resolved Binder cumulants and correlation ratios, with jackknife   *
+ *    errors from a BinningAnalysis of the block moments                       *
+ *                                                                             *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#ifndef BLOCKSPINS_H
+#define BLOCKSPINS_H
+
+#include <iosfwd>
+#include <vector>
+#include "BinningAnalysis.h"
+#include "ConstView.h"
+
+class BlockSpins {
+    public :
+        // Constructors, destructor
+        BlockSpins();
+        virtual ~BlockSpins();
+
+        // Settings
+        void setup(const std::vector<int>& latticeDims,
+                   const int slices,
+                   const int depth,
+                   const std::vector<int>& active);
+        void reset();
+
+        // Checkpointing of the accumulated data
+        void writeState(std::ostream& os);
+        void readState(std::istream& is);
+
+        // Input: spins, 0 at missing sites
+        void accumulate(const ConstView<int> spins);
+
+        // Results per level, averaged over measurements
+        const int      getNumLevels()       {return nLevels;}
+        const long     getNumMeasurements() {return moments.getNumSamples();}
+        const int      getBlockLength(const int level);
+        const double   getMeanSquaredBlockSpin(const int level);
+        const Estimate getBinderCumulant(const int level);
+        const Estimate getCorrelationRatio(const int level);
+
+    private :
+        int nLevels=0;
+        int nSlices=2;
+
+        // Level-0 block of each site, parent block of each block
+        std::vector<int> siteBlock;
+        std::vector<std::vector<int> > parentBlock;
+        std::vector<std::vector<double> > blockCount; // active sites
+        std::vector<std::vector<double> > blockSum;
+
+        // <m^2> and <m^4> over the blocks of each level, per measurement
+        BinningAnalysis moments;
+        std::vector<double> sample;
+};
+
+#endif
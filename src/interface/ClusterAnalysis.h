@@ -0,0 +1,93 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * ClusterAnalysis.h                                                           *
+ *                                                                             *
+ * Geometric cluster statistics on the neighbour graph. Key characteristics:   *
+ *  - Union-find with union by size and path halving (near-linear labelling)   *
+ *  - Like-spin domains and Fortuin-Kasteleyn clusters (like-spin bonds kept   *
+ *    with probability 1 - exp(-2 K w_ij)), drawn from a generator of its own *
+ *    so that measuring does not change the Monte Carlo trajectory            *
+ *  - Accumulates size distributions, largest-cluster fraction, mean cluster   *
+ *    size and the probability that a cluster spans the lattice               *
+ *                                                                             *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#ifndef CLUSTERANALYSIS_H
+#define CLUSTERANALYSIS_H
+
+#include <iosfwd>
+#include <vector>
+#include "RandomGenerator.h"
+#include "ConstView.h"
+
+class UnionFind {
+    public :
+        UnionFind(const int n=0) {reset(n);}
+        virtual ~UnionFind() {};
+
+        void reset(const int n);
+        int  find(int i);
+        void unite(const int i, const int j);
+        const int getSize(const int i) {return size[find(i)];}
+
+    private :
+        std::vector<int> parent;
+        std::vector<int> size;
+};
+
+class ClusterAnalysis {
+    public :
+        // Constructors, destructor
+        ClusterAnalysis();
+        virtual ~ClusterAnalysis();
+
+        // Cluster definitions
+        enum {kDomains, kFKClusters, kNumTypes};
+
+        // Settings
+        void setup(const std::vector<int>& latticeDims,
+                   const ConstView<int> nbrOffsets,
+                   const ConstView<int> nbrIndices,
+                   const ConstView<double> nbrWeights,
+                   const std::vector<int>& active);
+        void reset();
+        void setSeed(const unsigned int seed) {rng.SetSeed(seed);}
+
+        // Checkpointing of the accumulated data and the generator
+        void writeState(std::ostream& os);
+        void readState(std::istream& is);
+
+        // Input: spins (0 at missing sites) and the coupling K = J/kbT for
+        // the FK bond probabilities
+        void accumulate(const ConstView<int> spins, const double K);
+
+        // Results, averaged over measurements
+        const int    getNumMeasurements()           {return nMeasurements;}
+        const double getLargestFraction(const int type);
+        const double getMeanClusterSize(const int type);
+        const double getSpanningProbability(const int type);
+        const std::vector<double> getSizeDistribution(const int type);
+
+    private :
+        int nMeasurements=0;
+        int nDims=0;
+        double nActive=0;
+        ConstView<int>    offsets;
+        ConstView<int>    neighbours;
+        ConstView<double> weights;
+
+        // Bit 2j (2j+1) set for sites on the lower (upper) face of axis j
+        std::vector<int> boundaryMask;
+
+        RandomGenerator rng;
+        UnionFind labels;
+        std::vector<int> rootMask;
+
+        // Per cluster type
+        std::vector<double> sumLargest;
+        std::vector<double> sumSizeSq;
+        std::vector<double> nSpanning;
+        std::vector<std::vector<double> > sizeCounts;
+
+        void collect(const int type, const ConstView<int> spins);
+};
+
+#endif
@@ -0,0 +1,49 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * ConstView.h                                                                 *
+ *                                                                             *
+ * Read-only view of a contiguous array owned by someone else. Key             *
+ * characteristics:                                                            *
+ *  - Pointer plus length, copying a view never copies the data                *
+ *  - Works with range-based for loops and standard algorithms                 *
+ *  - Only valid while the owner neither resizes nor frees the array           *
+ *                                                                             *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#ifndef CONSTVIEW_H
+#define CONSTVIEW_H
+
+#include <cstddef>
+#include <vector>
+
+template <class T>
+class ConstView {
+    public :
+        typedef const T* const_iterator;
+
+        ConstView() : first(0), length(0) {}
+        ConstView(const T* data, const size_t n) : first(data), length(n) {}
+        ConstView(const std::vector<T>& vec) : first(vec.data()), length(vec.size()) {}
+
+        const T*     data()  const {return first;}
+        const size_t size()  const {return length;}
+        const bool   empty() const {return length == 0;}
+        const T* begin() const {return first;}
+        const T* end()   const {return first+length;}
+
+        const T& operator[](const size_t i) const {return first[i];}
+        const T& front() const {return first[0];}
+        const T& back()  const {return first[length-1];}
+
+        // Elements [offset, offset+n) as a view of their own
+        ConstView<T> subView(const size_t offset, const size_t n) const {
+            return ConstView<T>(first+offset,n);
+        }
+
+        // Explicit copy, for callers that need to keep the values
+        std::vector<T> toVector() const {return std::vector<T>(begin(),end());}
+
+    private :
+        const T* first;
+        size_t   length;
+};
+
+#endif
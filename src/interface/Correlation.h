@@ -0,0 +1,74 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Correlation.h                                                               *
+ *                                                                             *
+ * Spin-spin correlation function accumulator. Key characteristics:            *
+ *  - G(d) binned by graph distance on the neighbour graph, measured from a    *
+ *    fixed set of source sites (BFS distances computed once at setup)         *
+ *  - G(r) binned by Euclidean distance class on the embedding grid, from      *
+ *    the FFT of the embedded spin field (zeros at missing sites, zero-padded  *
+ *    so that open boundaries do not wrap around)                              *
+ *  - Second-moment correlation length from the pair sums                      *
+ *                                                                             *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#ifndef CORRELATION_H
+#define CORRELATION_H
+
+#include <complex>
+#include <iosfwd>
+#include <vector>
+#include "FFT.h"
+#include "ConstView.h"
+
+class SpinCorrelation {
+    public :
+        // Constructors, destructor
+        SpinCorrelation();
+        virtual ~SpinCorrelation();
+
+        // Settings
+        void setNumSources(const int num) {if(num > 0) nSources=num;}
+        void setup(const std::vector<int>& paddedDims,
+                   const std::vector<int>& embeddedIndex,
+                   const std::vector<int>& active,
+                   const ConstView<int> nbrOffsets,
+                   const ConstView<int> nbrIndices,
+                   GridFFT* fft);
+        void reset();
+
+        // Checkpointing of the accumulated data
+        void writeState(std::ostream& os);
+        void readState(std::istream& is);
+
+        // Input: spins (0 at missing sites) and the forward FFT of the
+        // embedded spin field on the padded grid
+        void accumulate(const ConstView<int> spins,
+                        const std::vector<std::complex<double> >& spectrum);
+
+        // Results, averaged over measurements
+        const int getNumMeasurements() {return nMeasurements;}
+        const std::vector<double> getGraphCorrelation();
+        void getEuclideanCorrelation(std::vector<double>& r,
+                                     std::vector<double>& G);
+        const double getCorrelationLength();
+
+    private :
+        int nSources=8;
+        int nMeasurements=0;
+        int nDims=0;
+        GridFFT* gridFFT=0;
+        std::vector<std::complex<double> > workspace;
+
+        // Graph distance binning
+        std::vector<int> sources;
+        std::vector<int> sourceDistances; // nSources x nSites, -1 = unreachable
+        std::vector<double> graphSum;
+        std::vector<double> graphPairs;
+
+        // Euclidean distance classes on the padded grid
+        std::vector<int>    distanceClass; // per displacement, -1 = no pairs
+        std::vector<double> classR2;
+        std::vector<double> classSum;
+        std::vector<double> classPairs;
+};
+
+#endif
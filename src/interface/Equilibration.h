@@ -0,0 +1,54 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Equilibration.h                                                             *
+ *                                                                             *
+ * Burn-in detection for MC time series. Key characteristics:                  *
+ *  - MSER-m (marginal standard error rule) on batch means of the series       *
+ *  - The series is declared equilibrated once the optimal truncation point    *
+ *    falls in the first half of the data                                      *
+ *  - Checks are only repeated when the series has grown, so the total cost    *
+ *    stays linear in the burn-in length                                       *
+ *                                                                             *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#ifndef EQUILIBRATION_H
+#define EQUILIBRATION_H
+
+#include <iosfwd>
+#include <vector>
+
+class EquilibrationDetector {
+    public :
+        // Constructors, destructor
+        EquilibrationDetector(const int batch=5);
+        virtual ~EquilibrationDetector();
+
+        // Settings
+        void setBatchSize (const int num) {if(num > 0) batchSize=num;}
+        void setMinBatches(const int num) {if(num > 1) minBatches=num;}
+
+        // Input
+        void add(const double x);
+        void reset();
+
+        // Checkpointing of the accumulated data
+        void writeState(std::ostream& os);
+        void readState(std::istream& is);
+
+        // Results
+        const bool isEquilibrated();
+        const int  getNumSamples()       {return series.size();}
+        const int  getTruncationPoint()  {return truncation;}
+        const std::vector<double>& getSeries() {return series;}
+
+    private :
+        int batchSize=5;
+        int minBatches=20;
+        std::vector<double> series;
+
+        bool equilibrated=false;
+        int  truncation=-1;
+        int  nextCheck=0;
+
+        int mserTruncation();
+};
+
+#endif
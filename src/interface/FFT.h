@@ -0,0 +1,69 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * FFT.h                                                                       *
+ *                                                                             *
+ * Radix-2 fast Fourier transform used by the time-series and lattice          *
+ * analyses. Key characteristics:                                              *
+ *  - Plan object holds the bit-reversal table and twiddle factors, so         *
+ *    repeated transforms of the same length do no setup work                  *
+ *  - In-place complex transforms with arbitrary stride                        *
+ *  - Row-major multi-dimensional transforms built from per-axis plans         *
+ *                                                                             *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#ifndef FFT_H
+#define FFT_H
+
+#include <complex>
+#include <vector>
+
+class FFTPlan {
+    public :
+        // Constructors, destructor
+        FFTPlan(const int n=1);
+        virtual ~FFTPlan();
+
+        // Settings
+        void resize(const int n);
+        const int getSize() {return size;}
+
+        // Transforms (inverse includes the 1/n normalization)
+        void forward(std::complex<double>* data, const int stride=1);
+        void inverse(std::complex<double>* data, const int stride=1);
+
+        // Utils
+        static int nextPowerOfTwo(const int n);
+
+    private :
+        int size=0;
+        std::vector<int> bitReverse;
+        std::vector<std::complex<double> > twiddles;
+
+        void transform(std::complex<double>* data, const int stride,
+                       const bool invert);
+};
+
+class GridFFT {
+    public :
+        // Constructors, destructor
+        GridFFT();
+        virtual ~GridFFT();
+
+        // Settings (each axis length must be a power of two)
+        void setDimensions(const std::vector<int>& dims);
+        const std::vector<int>& getDimensions() {return dimensions;}
+        const int getSize() {return size;}
+
+        // Transforms over every axis of a row-major array
+        void forward(std::vector<std::complex<double> >& data);
+        void inverse(std::vector<std::complex<double> >& data);
+
+    private :
+        std::vector<int> dimensions;
+        std::vector<int> strides;
+        std::vector<FFTPlan> plans;
+        int size=0;
+
+        void transform(std::vector<std::complex<double> >& data,
+                       const bool invert);
+};
+
+#endif
@@ -14,8 +14,75 @@
 #include <vector>
 #include <iostream>
 #include <cmath>
-#include "TRandom3.h"
+#include "RandomGenerator.h"
 #include "TGraph.h"
+#include "Autocorrelation.h"
+#include "Equilibration.h"
+#include "BinningAnalysis.h"
+#include "Correlation.h"
+#include "StructureFactor.h"
+#include "ClusterAnalysis.h"
+#include "SiteMaps.h"
+#include "BlockSpins.h"
+#include "SweepWriter.h"
+#include "Snapshots.h"
+#include "RingBuffer.h"
+#include "ConstView.h"
+#include "MappedArray.h"
+
+// Per-sweep Monte Carlo counters (one proposal per spin, or per spin
+// group for HYBRID)
+struct SweepStats {
+    long   proposals=0;
+    long   accepted=0;
+    double sumAbsDeltaE=0;
+};
+
+// One active site, as seen through IsingModel::getActiveSites()
+struct ActiveSite {
+    int index;
+    int S;
+    ConstView<double> coords;
+};
+
+// Walks the active sites in site order without copying any array
+class ActiveSiteIterator {
+    public :
+        ActiveSiteIterator(const int* idx, const int* spins,
+                           const double* coords, const int p)
+            : index(idx), spinData(spins), coordData(coords), nDims(p) {}
+
+        ActiveSite operator*() const {
+            ActiveSite site;
+            site.index  = *index;
+            site.S      = spinData[*index];
+            site.coords = ConstView<double>(coordData + (size_t) *index*nDims,nDims);
+            return site;
+        }
+        ActiveSiteIterator& operator++() {index++; return *this;}
+        bool operator==(const ActiveSiteIterator& it) const {return index == it.index;}
+        bool operator!=(const ActiveSiteIterator& it) const {return index != it.index;}
+
+    private :
+        const int*    index;
+        const int*    spinData;
+        const double* coordData;
+        int           nDims;
+};
+
+class ActiveSiteRange {
+    public :
+        ActiveSiteRange(const ActiveSiteIterator& b, const ActiveSiteIterator& e,
+                        const int n) : first(b), last(e), length(n) {}
+        ActiveSiteIterator begin() const {return first;}
+        ActiveSiteIterator end()   const {return last;}
+        const int size()           const {return length;}
+
+    private :
+        ActiveSiteIterator first;
+        ActiveSiteIterator last;
+        int length;
+};
 
 class IsingModel {
     public :
@@ -27,17 +94,41 @@ class IsingModel {
         void setDebug             (const bool dbg   ) {debug = dbg;}
         void setNumThreads        (const int num    );
         void setNumMCSteps        (const int num    );
+        void setTargetEffSamples  (const int num    );
+        void setAutoEquilibrate   (const bool autoEq);
+        void setCorrelationInterval(const int num   );
+        void setStructureFactorInterval(const int num);
+        void addStructureFactorWaveVector(const std::vector<double>& k);
+        void setClusterInterval   (const int num    );
+        void setSiteMapInterval   (const int num    );
+        void setBlockInterval     (const int num    );
+        void setSweepOutput       (const std::string& fileName);
+        void setSnapshotOutput    (const std::string& fileName,
+                                   const int num);
+        void setCheckpoint        (const std::string& fileName,
+                                   const double seconds);
+        void setSeed              (const unsigned int num) {seed = num;}
+        void setStartHash         (const unsigned long long hash) {startHash = hash;}
+        void setConvergenceHistory(const int num    );
+        void setOutOfCore         (const std::string& directory,
+                                   const int tileLevel=-1);
         void setLatticeDepth      (const int num    );
         void setHausdorffDimension(const double dim );
-        void setHausdorffMethod   (char* const  hmtd);
-        void setMCMethod          (char* const  mcmd);
+        void setHausdorffMethod   (const char* hmtd);
+        void setMCMethod          (const char* mcmd);
         void setInteractionSigma  (const double sig );   
         void setTemperature       (const double tkbT);
         void setCouplingConsts    (const double H,
                                    const double J); 
 
-        const std::vector<int> getSpinArray();
-        const std::vector<int> getLatticeDimensions();
+        // Views of the internal arrays, valid until the next setup/reset.
+        // Spins change in place as the simulation runs.
+        ConstView<int>             getSpinArray()         {return spinValues;}
+        const std::vector<int>&    getLatticeDimensions() {return latticeDimensions;}
+        ConstView<double>          getSiteCoordinates()   {return siteCoordinates;}
+        ConstView<int>             getActiveIndices()     {return activeIndices;}
+        ConstView<double>          getSiteCoordinates(const int i);
+        ActiveSiteRange            getActiveSites();
         const std::string      getHausdorffMethod() 
                                     {return hausdorffMethod ;}
         const std::string      getMCMethod() 
@@ -50,13 +141,45 @@ class IsingModel {
         const double getHausdorffScale()     {return hausdorffScale  ;}
         const double getInteractionSigma()   {return interactionSigma;}   
         const double getNumMCSteps()         {return nMCSteps        ;}
-        const std::vector<double> getMCInfo(){return mcInfo          ;}
-        const std::vector<double> getHybridInfo(){return hybridInfo  ;}
+        const int    getTargetEffSamples()   {return targetEffSamples;}
+        const unsigned int getSeed()         {return seed            ;}
+        const unsigned long long getStartHash() {return startHash    ;}
+        const unsigned long long getGeometryHash();
+        const unsigned long long getSettingsHash();
+        const unsigned long long getConfigurationHash();
+        const int    getNumSweeps()          {return nSweeps         ;}
+        const int    getNumBurnInSweeps()    {return nBurnInSweeps   ;}
+        const bool   getIsEquilibrated()     {return isEquilibrated  ;}
+        const int    getConvergenceHistory() {return sweepHistory.getCapacity();}
+        const bool   getIsOutOfCore()        {return outOfCore       ;}
+        const int    getSweepTileLevel()     {return sweepTileLevel  ;}
+        const std::vector<SweepStats> getSweepHistory();
+        const RingBuffer<SweepStats>& getSweepHistoryBuffer() {return sweepHistory;}
+        const std::vector<double> getHybridInfo();
+        const double getAcceptanceRate();
         
         // Observables
         const int    getMagnetization();
         const double getEffHamiltonian(const std::vector<int>& flips=std::vector<int>());
         const double getEffHamiltonian(const int flip);
+        const double getTauIntEnergy()       {return energyAutocorr.getTauInt();}
+        const double getTauIntMagnetization(){return absMagAutocorr.getTauInt();}
+        const double getNumEffSamples();
+        const Estimate getMeanEnergy();
+        const Estimate getMeanAbsMagnetization();
+        const Estimate getSpecificHeat();
+        const Estimate getSusceptibility();
+        const Estimate getBinderCumulant();
+        const double getCorrelationLength()  {return correlation.getCorrelationLength();}
+        const double getStructureFactorLength(){return structureFactor.getCorrelationLength();}
+        const std::vector<double> getSelectedStructureFactor()
+                                             {return structureFactor.getSelected();}
+        ClusterAnalysis& getClusterAnalysis(){return clusters;}
+        const std::vector<double> getSiteMagnetization()
+                                             {return siteMaps.getMagnetizationMap();}
+        const std::vector<double> getSiteBondCorrelation()
+                                             {return siteMaps.getBondMap();}
+        BlockSpins& getBlockSpins()          {return blockSpins;}
         const double computePartitionFunction(
                 const int start=0,
                 const std::vector<int>& flips=std::vector<int>());
@@ -80,42 +203,25 @@ class IsingModel {
 
         // Plots
         TGraph* getConvergenceGr();
+        TGraph* getEquilibrationGr();
+        TGraph* getGraphCorrelationGr();
+        TGraph* getEuclideanCorrelationGr();
+        TGraph* getStructureFactorGr();
+        TGraph* getClusterSizeGr(const int type);
 
     private :
-        // Spins
-        struct spin {
-           int S;
-           bool active;
-           std::vector<double> coords;
-           bool operator < (const spin& ts) const {
-                for(int iS=0; iS < coords.size(); iS++) {
-                    if(coords.at(iS) < ts.coords.at(iS)) return true;
-                    else if(coords.at(iS) > ts.coords.at(iS)) return false;
-                    else continue;
-                }
-                return false;
-            }
-           bool operator <= (const spin& ts) const {
-                return !(*this > ts);
-            }
-           bool operator > (const spin& ts) const {
-                for(int iS=0; iS < coords.size(); iS++) {
-                    if(coords.at(iS) > ts.coords.at(iS)) return true;
-                    else if(coords.at(iS) < ts.coords.at(iS)) return false;
-                    else continue;
-                }
-                return false;
-           }
-           bool operator >= (const spin& ts) const {
-                return !(*this < ts);
-           }
-        };
-
-        typedef struct spin spin;
+        // Spins, in flat arrays with site i at row-major position i of the
+        // lattice. Spins are +-1, 0 marks a missing site (which keeps 0
+        // whatever it is set to).
+        MappedArray<int>    spinValues;
+        MappedArray<double> siteCoordinates;
+        MappedArray<int>    activeIndices;
+        void   setSpin(const int i, const int S) {
+            if(spinValues[i] != 0) spinValues[i] = S;
+        }
         
         // Settings
         bool   debug=false;
-        std::vector<spin> spinArray;
         std::vector<int > latticeDimensions;
         int    latticeDepth=1;
         int    nThreads=1;
@@ -125,6 +231,8 @@ class IsingModel {
         double hausdorffSlices=2;
         double hausdorffScale=1/3;
         int    nMCSteps=10000;
+        int    targetEffSamples=0;
+        bool   autoEquilibrate=true;
         std::string hausdorffMethod="SCALING";
         std::string mcMethod="HEATBATH";
 
@@ -141,19 +249,111 @@ class IsingModel {
         double xmax=1; // Necessary for nearest-neighbor sum
         double xmin=0; // Same as above, see getEffHamiltonian definition
         bool   hasBeenSetup=false;
-        double metropolisStep(TRandom3* rNG);
-        double heatBathStep(TRandom3* rNG);
+        int    nSweeps=0;
+        int    nBurnInSweeps=0;
+        bool   isEquilibrated=false;
+        EquilibrationDetector burnInDetector;
+        AutocorrelationEstimator energyAutocorr;
+        AutocorrelationEstimator absMagAutocorr;
+        enum {kObsE, kObsE2, kObsAbsM, kObsM2, kObsM4, kNumObs};
+        BinningAnalysis measurements;
+        void   measure();
+        void   measureEmbeddedField(const bool doCorrelation,
+                                    const bool doStructureFactor);
+        void   buildNeighbourTable();
+        void   buildEmbedding();
+        void   setupCorrelations();
+        void   setupStructureFactor();
+
+        // Neighbour graph (CSR) with the |r_i-r_j|^sigma coupling factors
+        MappedArray<int>    neighbourOffsets;
+        MappedArray<int>    neighbourIndices;
+        MappedArray<double> neighbourWeights;
+        int    getNeighbour(const int i, const int j, const int dir);
+
+        // Out-of-core mode: the arrays above live in scratch files and
+        // single-spin sweeps visit the lattice tile by tile, with local
+        // energy updates
+        bool   outOfCore=false;
+        std::string backingDirectory;
+        int    requestedTileLevel=-1;
+        int    sweepTileLevel=0;
+        long   sweepBandSites=0;
+        MappedArray<int> sweepOrder;
+        void   buildSweepOrder();
+        void   adviseSweepWindow(const long n);
+        double getFlipEnergy(const int i);
+
+        // Spins embedded on a zero-padded power-of-two grid. One FFT of
+        // the field serves both the correlation and S(k) measurements.
+        std::vector<int>    embeddingDimensions;
+        std::vector<int>    embeddedIndex;
+        std::vector<std::complex<double> > embeddedField;
+        GridFFT embeddingFFT;
+
+        // Correlation measurements
+        int    correlationInterval=0;
+        bool   hasCorrelationSetup=false;
+        SpinCorrelation correlation;
+
+        // Structure factor measurements
+        int    structureFactorInterval=0;
+        bool   hasStructureFactorSetup=false;
+        StructureFactor structureFactor;
+
+        // Domain and FK cluster measurements
+        int    clusterInterval=0;
+        bool   hasClusterSetup=false;
+        ClusterAnalysis clusters;
+
+        // Per-site <S_i> and <S_i S_nbr> maps
+        int    siteMapInterval=0;
+        SiteMaps siteMaps;
+
+        // Block magnetizations on every level of the fractal
+        int    blockInterval=0;
+        BlockSpins blockSpins;
+
+        // Per-measurement time series, written in the background
+        std::string sweepOutputFile;
+        std::vector<double> sweepRow;
+        SweepWriter sweepWriter;
+
+        // Spin configurations, 1 bit per site
+        std::string snapshotFile;
+        int    snapshotInterval=0;
+        SnapshotWriter snapshotWriter;
+        void   openStreams();
+        void   closeStreams();
+
+        // Run state kept across sweeps, so that a checkpoint holds all of it
+        unsigned int seed=4357;
+        // Configuration hash of the run whose final spins this run starts
+        // from (a warm start), 0 if it starts from randomized spins
+        unsigned long long startHash=0;
+        RandomGenerator rng;
+        bool   burningIn=false;
+        int    nextCheck=100;
+        int    nSpinsPerThread=1;
+        bool   runComplete=false;
+
+        // Checkpoint/restart
+        std::string checkpointFile;
+        double checkpointInterval=0;
+        void   writeCheckpoint(const std::string& fileName);
+        bool   readCheckpoint(const std::string& fileName);
+        bool   hasEnoughSamples();
+        double metropolisStep(RandomGenerator* rNG);
+        double heatBathStep(RandomGenerator* rNG);
         void   hybridStep(const double rng, const std::vector<int>& spinFlips);
-        double getDistanceSq(const spin i1, const spin i2);
+        double getDistanceSq(const int i1, const int i2);
         void   nextPermutation(std::vector<int>& tvN, const int max);
         void   addSpins(const int depth, 
                         const std::vector<double>& x0, 
                         const std::vector<double>& x1);
-        std::vector<double> mcInfo;
-        std::vector<double> hybridInfo;
-         
-        // C++ utils
-        void swap(spin *a, spin *b);
-        void QuickSort(std::vector<spin>& vec, int left, int right);
-        int QSPartition(std::vector<spin>& vec, int left, int right);
+
+        // Convergence diagnostics: counters of the running sweep and a
+        // fixed-size history of the last completed ones
+        SweepStats sweepStats;
+        RingBuffer<SweepStats> sweepHistory;
 };
@@ -0,0 +1,50 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * LinkDef.h                                                                   *
+ *                                                                             *
+ * Classes in the libIsingModel dictionary (make lib), for macros that load   *
+ * the library instead of interpreting the sources. None of them is written   *
+ * to ROOT files, so no streamers are generated ("-").                         *
+ *                                                                             *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#ifdef __CLING__
+
+#pragma link off all globals;
+#pragma link off all classes;
+#pragma link off all functions;
+
+// Model
+#pragma link C++ class IsingModel-;
+#pragma link C++ class RandomGenerator-;
+#pragma link C++ struct SweepStats-;
+#pragma link C++ struct ActiveSite-;
+#pragma link C++ class ActiveSiteIterator-;
+#pragma link C++ class ActiveSiteRange-;
+#pragma link C++ class ConstView<int>-;
+#pragma link C++ class ConstView<double>-;
+
+// Analysis modules
+#pragma link C++ struct Estimate-;
+#pragma link C++ class AutocorrelationEstimator-;
+#pragma link C++ class EquilibrationDetector-;
+#pragma link C++ class BinningAnalysis-;
+#pragma link C++ class SpinCorrelation-;
+#pragma link C++ class StructureFactor-;
+#pragma link C++ class UnionFind-;
+#pragma link C++ class ClusterAnalysis-;
+#pragma link C++ class SiteMaps-;
+#pragma link C++ class BlockSpins-;
+
+// Output
+#pragma link C++ class SweepReader-;
+#pragma link C++ class SnapshotReader-;
+#pragma link C++ class ResultRecord-;
+#pragma link C++ class ResultFile-;
+#pragma link C++ class ResultStore-;
+
+// Sweeps
+#pragma link C++ struct SweepPoint-;
+#pragma link C++ struct ManifestEntry-;
+#pragma link C++ class SweepManifest-;
+#pragma link C++ class SweepEngine-;
+
+#endif
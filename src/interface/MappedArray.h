@@ -0,0 +1,125 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * MappedArray.h                                                               *
+ *                                                                             *
+ * Fixed-size array in memory-mapped storage. Key characteristics:             *
+ *  - Anonymous memory by default, or a scratch file in a given directory so   *
+ *    that the kernel can page the data out to disk instead of swap            *
+ *  - The scratch file is unlinked as soon as it is mapped, nothing is left    *
+ *    behind if the process dies                                               *
+ *  - Access pattern hints (madvise) for the whole array or a range            *
+ *                                                                             *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#ifndef MAPPEDARRAY_H
+#define MAPPEDARRAY_H
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "ConstView.h"
+
+template <class T>
+class MappedArray {
+    public :
+        // Access pattern hints
+        enum {kNormal, kSequential, kRandom, kWillNeed, kDontNeed};
+
+        MappedArray() {}
+        virtual ~MappedArray() {release();}
+
+        // Zero-filled storage for n elements. An empty directory gives
+        // anonymous memory, otherwise the pages are backed by a scratch
+        // file in that directory.
+        void allocate(const size_t n, const std::string& directory="") {
+            release();
+            if(n == 0) return;
+            size_t bytes = n*sizeof(T);
+            void* address=MAP_FAILED;
+            if(directory.empty()) {
+                address = mmap(0,bytes,PROT_READ|PROT_WRITE,MAP_PRIVATE|MAP_ANONYMOUS,-1,0);
+            } else {
+                std::string name=directory+"/IsingModel.XXXXXX";
+                std::vector<char> path(name.begin(),name.end());
+                path.push_back('\0');
+                int fd=mkstemp(path.data());
+                if(fd >= 0) {
+                    unlink(path.data());
+                    if(ftruncate(fd,bytes) == 0) {
+                        address = mmap(0,bytes,PROT_READ|PROT_WRITE,MAP_SHARED,fd,0);
+                    }
+                    close(fd);
+                }
+            }
+            if(address == MAP_FAILED) {
+                std::cout<<"ERROR: Could not map "<<bytes<<" bytes"
+                         <<(directory.empty() ? "" : " in "+directory)<<std::endl;
+                exit(EXIT_FAILURE);
+            }
+            first=(T*) address;
+            length=n;
+            fileBacked=!directory.empty();
+        }
+
+        // Same, filled with a value
+        void assign(const size_t n, const T& value, const std::string& directory="") {
+            allocate(n,directory);
+            for(size_t i=0; i < n; i++) first[i]=value;
+        }
+
+        void release() {
+            if(first) munmap(first,length*sizeof(T));
+            first=0;
+            length=0;
+            fileBacked=false;
+        }
+
+        // Hint for elements [offset, offset+n). Dropping pages is only
+        // honoured for file-backed storage, where they are reread from
+        // the file; anonymous pages would come back zeroed.
+        void advise(const int hint, const size_t offset=0, size_t n=(size_t) -1) {
+            if(!first || offset >= length) return;
+            if(n > length-offset) n = length-offset;
+            if(hint == kDontNeed && !fileBacked) return;
+
+            size_t page  = sysconf(_SC_PAGESIZE);
+            size_t begin = (size_t) (first+offset);
+            size_t end   = (size_t) (first+offset+n);
+            begin -= begin % page;
+
+            int advice=MADV_NORMAL;
+            if(hint == kSequential) advice=MADV_SEQUENTIAL;
+            if(hint == kRandom)     advice=MADV_RANDOM;
+            if(hint == kWillNeed)   advice=MADV_WILLNEED;
+            if(hint == kDontNeed)   advice=MADV_DONTNEED;
+            madvise((void*) begin,end-begin,advice);
+        }
+
+        T*        data()                         {return first;}
+        const T*  data()                   const {return first;}
+        const size_t size()                const {return length;}
+        const bool   empty()               const {return length == 0;}
+        const bool   isFileBacked()        const {return fileBacked;}
+        T&        operator[](const size_t i)       {return first[i];}
+        const T&  operator[](const size_t i) const {return first[i];}
+        T*        begin()                        {return first;}
+        T*        end()                          {return first+length;}
+        const T*  begin()                  const {return first;}
+        const T*  end()                    const {return first+length;}
+
+        ConstView<T> view()        const {return ConstView<T>(first,length);}
+        operator ConstView<T>()    const {return view();}
+
+    private :
+        // One owner per mapping
+        MappedArray(const MappedArray&);
+        MappedArray& operator=(const MappedArray&);
+
+        T*     first=0;
+        size_t length=0;
+        bool   fileBacked=false;
+};
+
+#endif
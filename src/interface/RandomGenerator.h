@@ -0,0 +1,58 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * RandomGenerator.h                                                           *
+ *                                                                             *
+ * Mersenne twister with the TRandom3 calls used in this package (Uniform,     *
+ * Integer, SetSeed) and a state that can be saved and restored exactly, so    *
+ * a run restarted from a checkpoint continues the same trajectory.            *
+ *                                                                             *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#ifndef RANDOMGENERATOR_H
+#define RANDOMGENERATOR_H
+
+#include <istream>
+#include <ostream>
+#include <random>
+
+class RandomGenerator {
+    public :
+        // Seed 0 draws a seed from the system entropy source
+        RandomGenerator(const unsigned int seed=4357) {SetSeed(seed);}
+        virtual ~RandomGenerator() {};
+
+        void SetSeed(const unsigned int seed) {
+            engine.seed(seed != 0 ? seed : std::random_device()());
+        }
+
+        // Seed of an independent sub-stream of a run (splitmix64 of the
+        // run seed and the stream number), never 0
+        static unsigned int deriveSeed(const unsigned int seed, const unsigned int stream) {
+            unsigned long long z = ((unsigned long long) seed << 32 | stream)
+                                 + 0x9E3779B97F4A7C15ULL;
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+            unsigned int derived = (unsigned int) (z ^ (z >> 31));
+            return derived != 0 ? derived : 1;
+        }
+
+        // Uniform in (0,1), 32-bit resolution like TRandom3::Rndm
+        double Uniform() {
+            return (engine() + 0.5) * 2.3283064365386963e-10;
+        }
+        double Uniform(const double x1, const double x2) {
+            return x1 + (x2-x1)*Uniform();
+        }
+
+        // Uniform integer in [0,imax)
+        unsigned int Integer(const unsigned int imax) {
+            return (unsigned int) (imax*Uniform());
+        }
+
+        // Exact text form of the 624-word engine state
+        void writeState(std::ostream& os) {os<<engine<<'\n';}
+        void readState(std::istream& is)  {is>>engine; is.get();}
+
+    private :
+        std::mt19937 engine;
+};
+
+#endif
@@ -0,0 +1,142 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * ResultFile.h                                                                *
+ *                                                                             *
+ * Results of many configurations appended to one file. Key characteristics:   *
+ *  - One record per configuration: a tag, the parameter tuple (the key),      *
+ *    named scalars and named arrays                                           *
+ *  - Records and their index entries are appended under an exclusive flock,  *
+ *    so concurrent jobs on one node can share a file                          *
+ *  - The index (<file>.idx, fixed-size entries: key hash, offset, length)     *
+ *    gives a lookup by parameter tuple without scanning the data             *
+ *  - ResultStore: one file per configuration hash in a directory tree, so a  *
+ *    run can check whether an identical configuration has already finished  *
+ *  - merge() combines many result files into one, keeping the newest record  *
+ *    of each configuration, sorted by the parameter tuple, with a parameter  *
+ *    table (<file>.par) for selecting slices without reading the records     *
+ *                                                                             *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#ifndef RESULTFILE_H
+#define RESULTFILE_H
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+class ResultRecord {
+    public :
+        typedef std::vector<std::pair<std::string,double> > NamedValues;
+        typedef std::vector<std::pair<std::string,std::vector<double> > > NamedArrays;
+
+        // Constructors, destructor
+        ResultRecord(const std::string& recordTag="") : tag(recordTag) {};
+        virtual ~ResultRecord() {};
+
+        // Filling
+        void setTag(const std::string& recordTag) {tag=recordTag;}
+        void setConfigurationHash(const unsigned long long h) {configHash=h;}
+        void addParameter(const std::string& name, const double value);
+        void addValue(const std::string& name, const double value);
+        void addArray(const std::string& name, const std::vector<double>& values);
+        void clear();
+
+        // Access
+        const std::string& getTag()        {return tag;}
+        const unsigned long long getConfigurationHash() {return configHash;}
+        const NamedValues& getParameters() {return parameters;}
+        const NamedValues& getValues()     {return values;}
+        const NamedArrays& getArrays()     {return arrays;}
+        const double getParameter(const std::string& name);
+        const double getValue(const std::string& name);
+        const std::vector<double> getArray(const std::string& name);
+
+        // Hash of the tag and parameter tuple, the lookup key
+        const unsigned long long getKey();
+
+        // Serialization of one record
+        const std::string serialize();
+        bool deserialize(const std::string& data);
+
+    private :
+        std::string tag;
+        unsigned long long configHash=0; // 0 if not set
+        NamedValues parameters;
+        NamedValues values;
+        NamedArrays arrays;
+};
+
+class ResultFile {
+    public :
+        // Constructors, destructor
+        ResultFile();
+        virtual ~ResultFile();
+
+        // Append one record (safe against concurrent appends on one node)
+        static void append(const std::string& fileName, ResultRecord& record);
+
+        // Merge result files into a new sorted file with a parameter table,
+        // returns the number of records written
+        static const long merge(const std::vector<std::string>& inputs,
+                                const std::string& fileName, const int nThreads=1);
+
+        // Reading: load the index, then look records up by key or position
+        void open(const std::string& fileName);
+        const long getNumRecords() {return entries.size();}
+        bool read(const long k, ResultRecord& record);
+        bool find(ResultRecord& key);
+        bool locate(const long k, unsigned long long& offset, unsigned long long& length);
+
+        // Parameter table (merged files; otherwise built from the records)
+        const std::vector<std::string>& getParameterNames();
+        const double getParameter(const long k, const std::string& name);
+
+        // Records with lo <= parameter <= hi, optionally among a previous
+        // selection, in file order
+        const std::vector<long> select(const std::string& name,
+                                       const double lo, const double hi);
+        const std::vector<long> select(const std::string& name,
+                                       const double lo, const double hi,
+                                       const std::vector<long>& among);
+
+    private :
+        struct indexEntry {
+            unsigned long long key;
+            unsigned long long offset;
+            unsigned long long length;
+        };
+
+        std::string dataFile;
+        std::vector<indexEntry> entries;
+        std::map<unsigned long long,long> latest; // key -> newest entry
+
+        // Row k holds the parameters of record k (NaN where missing)
+        std::vector<std::string> parNames;
+        std::vector<double> parTable;
+        bool hasParTable=false;
+
+        bool readAt(const indexEntry& entry, ResultRecord& record);
+        void loadParTable();
+};
+
+class ResultStore {
+    public :
+        // Constructors, destructor
+        ResultStore(const std::string& dir="") : directory(dir) {};
+        virtual ~ResultStore() {};
+
+        void setDirectory(const std::string& dir) {directory=dir;}
+        const std::string& getDirectory()         {return directory;}
+
+        // <directory>/<first two hex digits>/<hash as 16 hex digits>.rec
+        const std::string getPath(const unsigned long long hash);
+
+        // Content-addressed access; store() replaces the file atomically
+        bool contains(const unsigned long long hash);
+        bool load(const unsigned long long hash, ResultRecord& record);
+        void store(const unsigned long long hash, ResultRecord& record);
+
+    private :
+        std::string directory;
+};
+
+#endif
@@ -0,0 +1,70 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * RingBuffer.h                                                                *
+ *                                                                             *
+ * Fixed-capacity history of the most recent entries. Key characteristics:     *
+ *  - Storage is allocated once, pushing never reallocates                     *
+ *  - Indexing is oldest-first, back() is the newest entry                     *
+ *  - Counts every entry ever pushed, so callers can number them               *
+ *                                                                             *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#ifndef RINGBUFFER_H
+#define RINGBUFFER_H
+
+#include <vector>
+#include "StateIO.h"
+
+template <class T>
+class RingBuffer {
+    public :
+        RingBuffer(const int cap=1024) {setCapacity(cap);}
+        virtual ~RingBuffer() {};
+
+        // Changing the capacity drops the stored entries
+        void setCapacity(const int cap) {
+            if(cap < 1) return;
+            buffer.assign(cap,T());
+            clear();
+        }
+        void clear() {head=0; count=0; nPushed=0;}
+
+        void push(const T& entry) {
+            buffer[head]=entry;
+            head = (head+1) % buffer.size();
+            if(count < (int) buffer.size()) count++;
+            nPushed++;
+        }
+
+        const int  getCapacity()  const {return buffer.size();}
+        const int  size()         const {return count;}
+        const bool empty()        const {return count == 0;}
+        const long getNumPushed() const {return nPushed;}
+
+        // i = 0 is the oldest stored entry
+        const T& at(const int i) const {
+            int n=buffer.size();
+            return buffer[(head - count + i + n) % n];
+        }
+        const T& back() const {return at(count-1);}
+
+        // Checkpointing (T must be plain data)
+        void writeState(std::ostream& os) {
+            StateIO::write(os,buffer);
+            StateIO::write(os,head);
+            StateIO::write(os,count);
+            StateIO::write(os,nPushed);
+        }
+        void readState(std::istream& is) {
+            StateIO::read(is,buffer);
+            StateIO::read(is,head);
+            StateIO::read(is,count);
+            StateIO::read(is,nPushed);
+        }
+
+    private :
+        std::vector<T> buffer;
+        int  head=0;
+        int  count=0;
+        long nPushed=0;
+};
+
+#endif
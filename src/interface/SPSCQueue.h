@@ -0,0 +1,63 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * SPSCQueue.h                                                                 *
+ *                                                                             *
+ * Bounded lock-free queue for one producer and one consumer thread. Key       *
+ * characteristics:                                                            *
+ *  - push and pop never block, they return false when full / empty           *
+ *  - Capacity is rounded up to a power of two, one slot is kept free          *
+ *  - Acquire/release ordering on the two indices only, no locks              *
+ *                                                                             *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#ifndef SPSCQUEUE_H
+#define SPSCQUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+template <class T>
+class SPSCQueue {
+    public :
+        SPSCQueue(const size_t cap=64) {
+            size_t n=2;
+            while(n < cap+1) n <<= 1;
+            slots.resize(n);
+            mask=n-1;
+            head.store(0);
+            tail.store(0);
+        }
+        virtual ~SPSCQueue() {};
+
+        // Producer side
+        bool push(const T& item) {
+            size_t t=tail.load(std::memory_order_relaxed);
+            size_t next=(t+1) & mask;
+            if(next == head.load(std::memory_order_acquire)) return false;
+            slots[t]=item;
+            tail.store(next,std::memory_order_release);
+            return true;
+        }
+
+        // Consumer side
+        bool pop(T& item) {
+            size_t h=head.load(std::memory_order_relaxed);
+            if(h == tail.load(std::memory_order_acquire)) return false;
+            item=slots[h];
+            head.store((h+1) & mask,std::memory_order_release);
+            return true;
+        }
+
+        bool empty() {
+            return head.load(std::memory_order_acquire)
+                   == tail.load(std::memory_order_acquire);
+        }
+
+    private :
+        std::vector<T> slots;
+        size_t mask;
+        // Separate cache lines so the two threads do not false-share
+        alignas(64) std::atomic<size_t> head;
+        alignas(64) std::atomic<size_t> tail;
+};
+
+#endif
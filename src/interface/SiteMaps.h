@@ -0,0 +1,54 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * SiteMaps.h                                                                  *
+ *                                                                             *
+ * Time-averaged per-site maps over the measurement phase. Key                 *
+ * characteristics:                                                            *
+ *  - <S_i> and <S_i S_nbr> (averaged over the neighbours of i) per site       *
+ *  - Flat float arrays, filled with branch-free loops the compiler can        *
+ *    vectorize; the sums are integer valued and exact below 2^24              *
+ *  - Replaces dumping full snapshots and averaging them offline               *
+ *                                                                             *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#ifndef SITEMAPS_H
+#define SITEMAPS_H
+
+#include <iosfwd>
+#include <vector>
+#include "ConstView.h"
+
+class SiteMaps {
+    public :
+        // Constructors, destructor
+        SiteMaps();
+        virtual ~SiteMaps();
+
+        // Settings
+        void setup(const ConstView<int> nbrOffsets,
+                   const ConstView<int> nbrIndices);
+        void reset();
+
+        // Checkpointing of the accumulated data
+        void writeState(std::ostream& os);
+        void readState(std::istream& is);
+
+        // Input: spins, 0 at missing sites
+        void accumulate(const ConstView<int> spins);
+
+        // Results, averaged over measurements
+        const int getNumMeasurements() {return nMeasurements;}
+        const std::vector<double> getMagnetizationMap();
+        const std::vector<double> getBondMap();
+
+    private :
+        int nMeasurements=0;
+        ConstView<int> offsets;
+        ConstView<int> neighbours;
+
+        // Per-measurement values and running sums
+        std::vector<float> spinValues;
+        std::vector<float> bondValues;
+        std::vector<float> spinSum;
+        std::vector<float> bondSum;
+};
+
+#endif
@@ -0,0 +1,91 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Snapshots.h                                                                 *
+ *                                                                             *
+ * Compact spin-configuration snapshots with random access. Key                *
+ * characteristics:                                                            *
+ *  - 1 bit per site (1 = up, 0 = down or missing)                             *
+ *  - Every snapshot between keyframes is stored as the XOR with its          *
+ *    predecessor, run-length encoded (zero runs + literal bytes)             *
+ *  - A keyframe every n snapshots bounds the decoding work of a seek         *
+ *  - A footer index gives the offset and tag (e.g. sweep) of every snapshot  *
+ *                                                                             *
+ * File layout (native byte order):                                            *
+ *    "ISNAPS01" | nSites (u64) | keyframe interval (u32)                      *
+ *    records:   type (u8, 0 = keyframe, 1 = delta) | length (u32) | payload   *
+ *    footer:    nSnaps x (offset (u64), tag (i64)) | nSnaps (u64) |           *
+ *               "ISNIDX01"                                                    *
+ *                                                                             *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#ifndef SNAPSHOTS_H
+#define SNAPSHOTS_H
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "ConstView.h"
+
+class SnapshotWriter {
+    public :
+        // Constructors, destructor (closes the file)
+        SnapshotWriter();
+        virtual ~SnapshotWriter();
+
+        // Settings
+        void setKeyframeInterval(const int num) {if(num > 0) keyframeInterval=num;}
+        void open(const std::string& fileName, const long sites);
+        void close();
+        const bool isOpen() {return file != 0;}
+
+        // Input: spins (0 at missing sites) and a tag stored in the index
+        void add(const ConstView<int> spins, const long tag);
+
+        const long getNumSnapshots() {return offsets.size();}
+
+    private :
+        int   keyframeInterval=64;
+        long  nSites=0;
+        FILE* file=0;
+        std::vector<unsigned char> previous;
+        std::vector<unsigned char> current;
+        std::vector<unsigned char> payload;
+        std::vector<unsigned long long> offsets;
+        std::vector<long long> tags;
+
+        void writeRecord(const unsigned char type);
+};
+
+class SnapshotReader {
+    public :
+        // Constructors, destructor
+        SnapshotReader();
+        virtual ~SnapshotReader();
+
+        void open(const std::string& fileName);
+        void close();
+
+        const long getNumSnapshots() {return offsets.size();}
+        const long getNumSites()     {return nSites;}
+        const long getTag(const long k) {return tags.at(k);}
+
+        // Decode snapshot k into a caller buffer of getNumSites() values
+        // (+1/-1) or (nSites+7)/8 packed bytes
+        void read(const long k, int* spins);
+        void readBits(const long k, unsigned char* bits);
+
+    private :
+        FILE* file=0;
+        long  nSites=0;
+        int   keyframeInterval=1;
+        std::vector<unsigned long long> offsets;
+        std::vector<long long> tags;
+
+        // Last decoded snapshot, so sequential reads apply one delta each
+        long  cachedIndex=-1;
+        std::vector<unsigned char> cached;
+        std::vector<unsigned char> payload;
+
+        void decode(const long k);
+        void applyRecord(const long k);
+};
+
+#endif
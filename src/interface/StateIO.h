@@ -0,0 +1,81 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * StateIO.h                                                                   *
+ *                                                                             *
+ * Helpers for binary checkpoints and content hashes. Key characteristics:     *
+ *  - Raw native-order values and length-prefixed vectors (exact round trip   *
+ *    of doubles, no formatting)                                               *
+ *  - 64-bit FNV-1a hashing of the same values                                 *
+ *                                                                             *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#ifndef STATEIO_H
+#define STATEIO_H
+
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace StateIO {
+
+    inline void write(std::ostream& os, const std::string& value) {
+        unsigned long long n=value.size();
+        os.write(reinterpret_cast<const char*>(&n),sizeof(n));
+        os.write(value.data(),n);
+    }
+
+    inline void read(std::istream& is, std::string& value) {
+        unsigned long long n=0;
+        is.read(reinterpret_cast<char*>(&n),sizeof(n));
+        if(!is) return;
+        value.assign(n,' ');
+        is.read(&value[0],n);
+    }
+
+    template <class T>
+    void write(std::ostream& os, const T& value) {
+        os.write(reinterpret_cast<const char*>(&value),sizeof(T));
+    }
+
+    template <class T>
+    void read(std::istream& is, T& value) {
+        is.read(reinterpret_cast<char*>(&value),sizeof(T));
+    }
+
+    template <class T>
+    void write(std::ostream& os, const std::vector<T>& values) {
+        unsigned long long n=values.size();
+        write(os,n);
+        for(size_t i=0; i < values.size(); i++) write(os,values[i]);
+    }
+
+    template <class T>
+    void read(std::istream& is, std::vector<T>& values) {
+        unsigned long long n=0;
+        read(is,n);
+        if(!is) return;
+        values.resize(n);
+        for(size_t i=0; i < values.size(); i++) read(is,values[i]);
+    }
+
+    // 64-bit FNV-1a, chained through the hash argument
+    inline unsigned long long hash(const void* data, const size_t len,
+                                   unsigned long long h=14695981039346656037ULL) {
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        for(size_t i=0; i < len; i++) {
+            h ^= bytes[i];
+            h *= 1099511628211ULL;
+        }
+        return h;
+    }
+
+    template <class T>
+    unsigned long long hash(const T& value, unsigned long long h) {
+        return hash(&value,sizeof(T),h);
+    }
+
+    inline unsigned long long hash(const std::string& value, unsigned long long h) {
+        return hash(value.data(),value.size(),h);
+    }
+}
+
+#endif
@@ -0,0 +1,73 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * StructureFactor.h                                                           *
+ *                                                                             *
+ * Static structure factor accumulator, S(k) = <|sum_j S_j e^{ik.x_j}|^2>/N.   *
+ * Key characteristics:                                                        *
+ *  - Full grid: |F(k)|^2 of the embedded spin field, reusing the forward FFT  *
+ *    already computed for the correlation function                            *
+ *  - Selected wave vectors: direct sums over the physical site coordinates,   *
+ *    i.e. the scattering signature of the fractal itself                      *
+ *  - Correlation length from S(0) and S(k_min)                                *
+ *                                                                             *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#ifndef STRUCTUREFACTOR_H
+#define STRUCTUREFACTOR_H
+
+#include <complex>
+#include <iosfwd>
+#include <vector>
+#include "ConstView.h"
+
+class StructureFactor {
+    public :
+        // Constructors, destructor
+        StructureFactor();
+        virtual ~StructureFactor();
+
+        // Settings
+        void addWaveVector(const std::vector<double>& k);
+        void clearWaveVectors() {waveVectors.clear();}
+        void setup(const std::vector<int>& paddedDims,
+                   const std::vector<int>& latticeDims,
+                   const ConstView<double> coords,
+                   const std::vector<int>& active);
+        void reset();
+
+        // Checkpointing of the accumulated data
+        void writeState(std::ostream& os);
+        void readState(std::istream& is);
+
+        // Input: spins (0 at missing sites) and the forward FFT of the
+        // embedded spin field on the padded grid
+        void accumulate(const ConstView<int> spins,
+                        const std::vector<std::complex<double> >& spectrum);
+
+        // Results, averaged over measurements
+        const int    getNumMeasurements()  {return nMeasurements;}
+        const int    getNumWaveVectors()   {return waveVectors.size();}
+        const double getSelected(const int iK);
+        const std::vector<double> getSelected();
+        void getRadialAverage(std::vector<double>& k, std::vector<double>& S);
+        const double getCorrelationLength();
+
+    private :
+        int nMeasurements=0;
+        int nDims=0;
+        double nActive=0;
+
+        // Full embedding grid
+        std::vector<int>    paddedDimensions;
+        std::vector<double> gridSum;
+        std::vector<int>    kShell;     // |k| class of each grid point
+        std::vector<double> shellK;
+        std::vector<double> shellCount;
+        std::vector<int>    kMinIndices;
+        double kMin=0;
+
+        // Selected wave vectors (phases precomputed per site)
+        std::vector<std::vector<double> > waveVectors;
+        std::vector<std::vector<std::complex<double> > > phases;
+        std::vector<double> selectedSum;
+};
+
+#endif
@@ -0,0 +1,206 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * SweepEngine.h                                                               *
+ *                                                                             *
+ * Parameter sweeps in one process. Key characteristics:                       *
+ *  - The grid is the Cartesian product of the h, J, kbT, sigma, steps, dim   *
+ *    and depth lists, in the order SubmitCondor.py uses for its job numbers  *
+ *  - Points run on a work-stealing thread pool, one single-threaded model   *
+ *    per point, so a many-core node stays busy without one process per point *
+ *  - Points sharing a lattice (dim, depth, sigma) run as a group on one     *
+ *    worker: the lattice is built once and each point starts from the spins *
+ *    of its neighbour in kbT, h and J                                       *
+ *  - Groups are ordered by estimated cost, the most expensive first, and     *
+ *    dealt to the workers longest-processing-time first                      *
+ *  - Optionally the grid is refined along one axis in stages: midpoints are  *
+ *    added where chi, C or the Binder slope peak, until the spacing there    *
+ *    reaches a target resolution                                             *
+ *  - Every finished point is appended to one result file (ResultFile.h)      *
+ *    under the same names as runIsingModel's output; with a result store     *
+ *    set, points that are already stored are not run again                   *
+ *  - With a manifest, the state of every point is kept on disk, so that a    *
+ *    restarted sweep only runs the points that did not finish                *
+ *                                                                             *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#ifndef SWEEPENGINE_H
+#define SWEEPENGINE_H
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "ResultFile.h"
+#include "WorkStealingPool.h"
+
+class IsingModel;
+
+// One point of the grid
+struct SweepPoint {
+    int    index=0;    // position in the grid
+    double hDim=1;
+    int    depth=1;
+    double kbT=1;
+    double sigma=0;
+    double h=0;
+    double J=1;
+    int    numSteps=1000;
+};
+
+// Manifest of a sweep: the state of every point, the start it was run
+// from and where its result is, keyed by the configuration hash of a cold
+// start at the point. The text file (one line per point) is rewritten
+// under a temporary name and renamed, so it is always complete.
+struct ManifestEntry {
+    SweepPoint  point;
+    int         state=0;
+    unsigned long long startHash=0; // IsingModel::setStartHash of the run
+    std::string location;
+};
+
+class SweepManifest {
+    public :
+        enum {kPlanned, kRunning, kDone, kFailed, kNumStates};
+
+        SweepManifest(const std::string& name="") : fileName(name) {};
+        virtual ~SweepManifest() {};
+
+        void setFileName(const std::string& name) {fileName=name;}
+        const std::string& getFileName()          {return fileName;}
+        static const char* getStateName(const int state);
+
+        // Read the file (false if there is none), write it out
+        bool read();
+        void write();
+
+        // Points, by configuration hash
+        void plan(const unsigned long long hash, const SweepPoint& point);
+        void setState(const unsigned long long hash, const int state,
+                      const std::string& location="");
+        const int  getState(const unsigned long long hash);
+        void setStartHash(const unsigned long long hash, const unsigned long long start);
+        const unsigned long long getStartHash(const unsigned long long hash);
+        const long getNumPoints(const int state);
+        const long getNumPoints() {return entries.size();}
+
+    private :
+        std::string fileName;
+        std::map<unsigned long long,ManifestEntry> entries;
+};
+
+class SweepEngine {
+    public :
+        // Constructors, destructor
+        SweepEngine();
+        virtual ~SweepEngine();
+
+        // Parameter lists ("hDim", "depth", "kbT", "sigma", "h", "J",
+        // "numSteps"), parsed from "a,b,c" or "first:last:step"
+        void setList(const std::string& name, const std::vector<double>& values);
+        static const std::vector<double> parseList(const std::string& text);
+
+        // Settings
+        void setNumThreads        (const int num) {pool.setNumThreads(num);}
+        void setOutput            (const std::string& fileName) {outFile=fileName;}
+        void setStoreDirectory    (const std::string& dir) {store.setDirectory(dir);}
+        void setTargetEffSamples  (const int num) {targetEffSamples=num;}
+        void setCorrelationInterval(const int num) {correlationInterval=num;}
+        void setStructureFactorInterval(const int num) {structureFactorInterval=num;}
+        void setClusterInterval   (const int num) {clusterInterval=num;}
+        void setBlockInterval     (const int num) {blockInterval=num;}
+        void setScratchDirectory  (const std::string& dir) {scratchDir=dir;}
+        void setWarmStart         (const bool warm) {warmStart=warm;}
+        void setManifest          (const std::string& fileName) {manifest.setFileName(fileName);}
+        void setCheckpointInterval(const double seconds) {checkpointInterval=seconds;}
+        void setVerbose           (const bool v) {verbose=v;}
+
+        // The expanded grid
+        const std::vector<SweepPoint> getPoints();
+        const long getNumPoints();
+
+        // Cost model: seconds = steps*(perBond*bonds + perSpin*N) per point,
+        // with N*N*z bonds visited per sweep in core (full energy sum per
+        // flip) and N*z out of core (local updates). N and z follow from
+        // dim and depth without building the lattice.
+        void setCostModel(const double perBond, const double perSpin);
+        void calibrateCost();
+        const double getCostPerBond() {return costPerBond;}
+        const double getCostPerSpin() {return costPerSpin;}
+        const double estimateCost(const SweepPoint& point);
+        static const double getNumSpins(const SweepPoint& point);
+        static const double getCoordination(const SweepPoint& point);
+
+        // Points in runs sharing one lattice, in the order they are
+        // walked; groups costing more than a worker's share are split
+        const std::vector<std::vector<int> > groupByGeometry(
+                const std::vector<SweepPoint>& points);
+
+        // Adaptive refinement along one axis ("kbT", "h", "J", "sigma" or
+        // "hDim"). After the grid, every line of points along the axis gets
+        // midpoints next to its chi and C maxima and in the interval of
+        // steepest Binder cumulant, stage after stage, until these intervals
+        // are no wider than the resolution or maxStages is reached.
+        void setRefinement(const std::string& name, const double resolution,
+                           const int maxStages=10);
+
+        // Run every point, returns the number of points written
+        const long run();
+
+        // Single point, no output
+        void runPoint(const SweepPoint& point, ResultRecord& record);
+
+    private :
+        std::vector<std::vector<double> > lists;
+        std::string outFile;
+        ResultStore store;
+        int    targetEffSamples=0;
+        int    correlationInterval=0;
+        int    structureFactorInterval=0;
+        int    clusterInterval=0;
+        int    blockInterval=0;
+        std::string scratchDir;
+        bool   warmStart=true;
+        bool   verbose=true;
+
+        // Restarts: the manifest, per-point checkpoints next to it
+        // (<manifest>.ckpt/<hash>.ckpt) and chi, C, U of the points that
+        // finished in an earlier run, for the refinement
+        SweepManifest manifest;
+        double checkpointInterval=0;
+        std::map<unsigned long long,std::vector<double> > previous;
+        const unsigned long long getConfigurationHash(const SweepPoint& point);
+        const std::string getCheckpointFile(const unsigned long long hash);
+        void   readPrevious();
+        WorkStealingPool pool;
+
+        // Refinement
+        int    refineAxis=-1;
+        double refineResolution=0;
+        int    refineMaxStages=0;
+        std::map<int,std::vector<double> > observed; // chi, C, U by point index
+        const std::vector<SweepPoint> refine(const std::vector<SweepPoint>& points);
+
+        // Defaults from runSweep --calibrate on a development machine
+        double costPerBond=8e-9;
+        double costPerSpin=1.7e-7;
+        const std::vector<std::vector<int> > scheduleByCost(
+                const std::vector<double>& costs);
+
+        // Progress, shared by the workers
+        std::mutex outputLock;
+        long   nDone=0;
+        long   nCached=0;
+        long   nPlanned=0;
+        double lastReport=0;
+
+        void   configure(IsingModel& model, const SweepPoint& point);
+        void   simulate(IsingModel& model, const SweepPoint& point,
+                        ResultRecord& record);
+        void   runGroup(const std::vector<SweepPoint>& points,
+                        const std::vector<int>& group);
+        void   fillRecord(IsingModel& model, const SweepPoint& point,
+                          ResultRecord& record);
+        void   runPoints(const std::vector<SweepPoint>& points);
+        void   finish(const SweepPoint& point, ResultRecord& record,
+                      const bool cached, const unsigned long long key);
+};
+
+#endif
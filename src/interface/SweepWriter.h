@@ -0,0 +1,90 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * SweepWriter.h                                                               *
+ *                                                                             *
+ * Columnar per-measurement time series on disk. Key characteristics:          *
+ *  - The MC thread appends rows to a local batch and hands full batches to   *
+ *    a background writer through a bounded lock-free queue; when the queue   *
+ *    is full the batch keeps growing, so the MC thread never waits           *
+ *  - The writer stores each batch as a chunk of contiguous columns and       *
+ *    indexes the chunks in a footer                                           *
+ *  - SweepReader loads single columns without touching the others            *
+ *                                                                             *
+ * File layout (native byte order, all values double):                         *
+ *    "ISWEEPS1" | nCols (u32) | nCols x (len (u32), name)                     *
+ *    chunks:  nRows (u32) | nCols x nRows values, column after column         *
+ *    footer:  nChunks x (offset (u64), firstRow (u64)) | nChunks (u64) |      *
+ *             nRows (u64) | "ISWIDX01"                                        *
+ *                                                                             *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#ifndef SWEEPWRITER_H
+#define SWEEPWRITER_H
+
+#include <atomic>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+#include "SPSCQueue.h"
+
+class SweepWriter {
+    public :
+        // Constructors, destructor (closes the file)
+        SweepWriter();
+        virtual ~SweepWriter();
+
+        // Settings
+        void setBatchSize(const int num) {if(num > 0) batchSize=num;}
+        void open(const std::string& fileName,
+                  const std::vector<std::string>& columns);
+        void close();
+        const bool isOpen() {return file != 0;}
+
+        // Input: one value per column, from the producer thread only
+        void add(const std::vector<double>& row);
+
+        const long getNumRows() {return nRows;}
+
+    private :
+        int    batchSize=1024;
+        int    nColumns=0;
+        long   nRows=0;
+        FILE*  file=0;
+
+        // Producer side
+        std::vector<double>* batch=0;
+
+        // Writer thread
+        SPSCQueue<std::vector<double>*> queue;
+        std::thread writer;
+        std::atomic<bool> done;
+        std::vector<unsigned long long> chunkOffsets;
+        std::vector<unsigned long long> chunkFirstRows;
+        unsigned long long nWritten=0;
+
+        void flush();
+        void writeLoop();
+        void writeChunk(const std::vector<double>& rows);
+};
+
+class SweepReader {
+    public :
+        // Constructors, destructor
+        SweepReader();
+        virtual ~SweepReader();
+
+        void open(const std::string& fileName);
+        void close();
+
+        const long getNumRows()                        {return nRows;}
+        const std::vector<std::string> getColumnNames(){return columnNames;}
+        void readColumn(const std::string& column, std::vector<double>& values);
+
+    private :
+        FILE* file=0;
+        long  nRows=0;
+        std::vector<std::string> columnNames;
+        std::vector<unsigned long long> chunkOffsets;
+        std::vector<unsigned long long> chunkFirstRows;
+};
+
+#endif
@@ -0,0 +1,107 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * WorkStealingPool.h                                                          *
+ *                                                                             *
+ * Fixed set of threads working through numbered tasks. Key characteristics:   *
+ *  - Every worker owns a queue, filled before the run (contiguous blocks by   *
+ *    default, or as given by the caller)                                      *
+ *  - A worker takes its own tasks from the front, in the given order; an      *
+ *    idle worker steals from the back of the fullest other queue, so the     *
+ *    owner keeps walking its own tasks in order                              *
+ *  - Tasks are meant to be coarse (whole simulations), each queue has its    *
+ *    own mutex                                                                *
+ *                                                                             *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#ifndef WORKSTEALINGPOOL_H
+#define WORKSTEALINGPOOL_H
+
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class WorkStealingPool {
+    public :
+        typedef std::function<void(const int task, const int worker)> Work;
+
+        WorkStealingPool(const int n=1) {setNumThreads(n);}
+        virtual ~WorkStealingPool() {};
+
+        void setNumThreads(const int n) {if(n > 0) nThreads=n;}
+        const int  getNumThreads() const {return nThreads;}
+        const long getNumStolen()  const {return nStolen;}
+
+        // Tasks 0..nTasks-1, in contiguous blocks of about equal size
+        void run(const int nTasks, const Work& work) {
+            std::vector<std::vector<int> > queues(nThreads);
+            for(int t=0; t < nTasks; t++) {
+                queues[(long) t*nThreads/nTasks].push_back(t);
+            }
+            run(queues,work);
+        }
+
+        // Initial queue per worker (queues beyond the number of threads
+        // are shared out round-robin)
+        void run(const std::vector<std::vector<int> >& queues, const Work& work) {
+            slots.assign(nThreads,std::deque<int>());
+            for(size_t q=0; q < queues.size(); q++) {
+                std::deque<int>& slot=slots[q % nThreads];
+                slot.insert(slot.end(),queues[q].begin(),queues[q].end());
+            }
+            locks=std::vector<std::mutex>(nThreads);
+            nStolen=0;
+
+            std::vector<std::thread> workers;
+            for(int w=0; w < nThreads; w++) {
+                workers.push_back(std::thread(&WorkStealingPool::workLoop,this,w,std::cref(work)));
+            }
+            for(size_t w=0; w < workers.size(); w++) workers[w].join();
+        }
+
+    private :
+        int nThreads=1;
+        long nStolen=0;
+        std::vector<std::deque<int> > slots;
+        std::vector<std::mutex> locks;
+        std::mutex stealLock;
+
+        void workLoop(const int self, const Work& work) {
+            int task;
+            while(next(self,task)) work(task,self);
+        }
+
+        // Own queue first, then the back of the fullest other queue
+        bool next(const int self, int& task) {
+            {
+                std::lock_guard<std::mutex> guard(locks[self]);
+                if(!slots[self].empty()) {
+                    task=slots[self].front();
+                    slots[self].pop_front();
+                    return true;
+                }
+            }
+            while(true) {
+                int victim=-1;
+                size_t most=0;
+                for(int w=0; w < nThreads; w++) {
+                    if(w == self) continue;
+                    std::lock_guard<std::mutex> guard(locks[w]);
+                    if(slots[w].size() > most) {
+                        most=slots[w].size();
+                        victim=w;
+                    }
+                }
+                if(victim < 0) return false;
+
+                std::lock_guard<std::mutex> guard(locks[victim]);
+                if(slots[victim].empty()) continue;
+                task=slots[victim].back();
+                slots[victim].pop_back();
+                std::lock_guard<std::mutex> count(stealLock);
+                nStolen++;
+                return true;
+            }
+        }
+};
+
+#endif
@@ -0,0 +1,82 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * mergeResults.cpp                                                            *
+ *                                                                             *
+ * Merge the result files of a scan (see interface/ResultFile.h) into one      *
+ * file sorted by the parameter tuple. Standalone, does not need ROOT:         *
+ *                                                                             *
+ *   mergeResults [-j threads] [-l listFile] OUTFILE INPUT...                  *
+ *                                                                             *
+ * An INPUT that is a directory stands for every result file in it (files     *
+ * with a .idx next to them). With -l the input names are read from a file,   *
+ * one per line ("-" for stdin), for scans with more files than fit on a      *
+ * command line.                                                               *
+ *                                                                             *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#include "interface/ResultFile.h"
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <thread>
+#include <dirent.h>
+#include <getopt.h>
+
+// Add a result file, or all result files in a directory (sorted by name)
+void addInput(const std::string& name, std::vector<std::string>& inputs) {
+    DIR* dir=opendir(name.c_str());
+    if(!dir) {
+        inputs.push_back(name);
+        return;
+    }
+    std::vector<std::string> found;
+    for(struct dirent* f=readdir(dir); f; f=readdir(dir)) {
+        std::string file=f->d_name;
+        if(file.size() > 4 && file.compare(file.size()-4,4,".idx") == 0) {
+            found.push_back(name+"/"+file.substr(0,file.size()-4));
+        }
+    }
+    closedir(dir);
+    std::sort(found.begin(),found.end());
+    inputs.insert(inputs.end(),found.begin(),found.end());
+}
+
+
+int main(int argc, char** argv) {
+    int nThreads=std::max(1u,std::thread::hardware_concurrency());
+    std::vector<std::string> inputs;
+
+    int opt;
+    while((opt=getopt(argc,argv,"j:l:h")) != -1) {
+        if(opt == 'j') {
+            nThreads=std::max(1,atoi(optarg));
+        } else if(opt == 'l') {
+            std::ifstream file;
+            if(std::string(optarg) != "-") file.open(optarg);
+            std::istream& list = std::string(optarg) == "-" ? std::cin : file;
+            if(!list) {
+                std::cout<<"ERROR: Cannot read input list "<<optarg<<std::endl;
+                return EXIT_FAILURE;
+            }
+            for(std::string line; std::getline(list,line); ) {
+                if(!line.empty()) addInput(line,inputs);
+            }
+        } else {
+            std::cout<<"Usage: "<<argv[0]<<" [-j threads] [-l listFile] OUTFILE INPUT..."<<std::endl;
+            return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+    if(optind >= argc) {
+        std::cout<<"Usage: "<<argv[0]<<" [-j threads] [-l listFile] OUTFILE INPUT..."<<std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::string outFile=argv[optind];
+    for(int i=optind+1; i < argc; i++) addInput(argv[i],inputs);
+    if(inputs.empty()) {
+        std::cout<<"ERROR: No input files"<<std::endl;
+        return EXIT_FAILURE;
+    }
+
+    ResultFile::merge(inputs,outFile,nThreads);
+    return EXIT_SUCCESS;
+}
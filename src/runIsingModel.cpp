@@ -1,8 +1,17 @@
-#include "IsingModel.cpp"
+// The model comes from libIsingModel (make lib), which Cling loads
+// instead of interpreting the sources; executables link the objects
+#if defined(__CLING__) && !defined(__ACLIC__)
+R__LOAD_LIBRARY(libIsingModel)
+#endif
+#include "interface/IsingModel.h"
+#include "interface/ResultFile.h"
 #include "TFile.h"
 #include "TString.h"
 #include "TCanvas.h"
 #include "TTree.h"
+#include "TBranch.h"
+#include "TLeaf.h"
+#include <cstdio>
 
 std::clock_t start = std::clock();
 double getTimeDelta() {
@@ -19,6 +28,12 @@ bool niceAssert(TString statement, bool isTrue) {
     return isTrue;
 }
 
+// Store a graph as the two arrays <name>_x and <name>_y
+void addGraph(ResultRecord& record, const char* name, TGraph* gr) {
+    record.addArray((TString(name)+"_x").Data(),std::vector<double>(gr->GetX(),gr->GetX()+gr->GetN()));
+    record.addArray((TString(name)+"_y").Data(),std::vector<double>(gr->GetY(),gr->GetY()+gr->GetN()));
+}
+
 
 void runIsingModel(Double_t HDIM, 
                    Int_t DEPTH, 
@@ -27,7 +42,19 @@ void runIsingModel(Double_t HDIM,
                    Double_t COUPLING_H, 
                    Double_t COUPLING_J, 
                    Int_t NMCSTEPS, 
-                   Int_t NTHREADS) {
+                   Int_t NTHREADS,
+                   Int_t NEFFSAMPLES=0,
+                   Int_t CORRINTERVAL=0,
+                   Int_t SKINTERVAL=0,
+                   Int_t CLUSTERINTERVAL=0,
+                   Int_t SITEMAPINTERVAL=0,
+                   Int_t BLOCKINTERVAL=0,
+                   Bool_t SWEEPOUTPUT=false,
+                   Int_t SNAPSHOTINTERVAL=0,
+                   Double_t CHECKPOINTSEC=0,
+                   const char* OUTFILE="",
+                   const char* SCRATCHDIR="",
+                   const char* STOREDIR="") {
     /*
      *  Make the ntuple 
      */
@@ -36,7 +63,13 @@ void runIsingModel(Double_t HDIM,
     sprintf(name, "%1.2f_d%i_%3.2ft_%1.2fs_%2.2fh_%2.2fj_%im_%i",
                 HDIM,DEPTH,KBT,SIGMA,
                 COUPLING_H,COUPLING_J,NMCSTEPS,NTHREADS);
-    TFile *outFile = new TFile(TString(name).ReplaceAll(".","-")+".root","RECREATE");
+    // With OUTFILE set, all configurations of a scan share one result file
+    Bool_t toResultFile = strlen(OUTFILE) > 0;
+    // With STOREDIR set, finished configurations are kept by their hash and
+    // an identical configuration is not run again
+    Bool_t useStore = strlen(STOREDIR) > 0;
+    TFile *outFile = 0;
+    if(!toResultFile) outFile = new TFile(TString(name).ReplaceAll(".","-")+".root","RECREATE");
     TTree *outTree = new TTree("HausdorffIsingModel","Simulated data for HausdorffIsingModel");
 
     Int_t    tmag              =0;
@@ -44,6 +77,9 @@ void runIsingModel(Double_t HDIM,
     Int_t    tnumSpins         =0;
     Int_t    tlatticeDepth     =0;
     Int_t    tnumMCSteps       =0; 
+    Int_t    tnumSweeps        =0;
+    Int_t    tnumBurnIn        =0;
+    Bool_t   tequilibrated     =false;
     Int_t    thausdorffSlices  =0;
     Double_t thausdorffSpacing =0;
     Double_t thausdorffDim     =0;
@@ -54,6 +90,27 @@ void runIsingModel(Double_t HDIM,
     Double_t tJ                =0;
     Double_t tsig              =0;
     Double_t tkbT              =0;
+    Double_t ttauE             =0;
+    Double_t ttauM             =0;
+    Double_t tnumEff           =0;
+    Double_t tacceptance       =0;
+    Double_t tavgE             =0;
+    Double_t tavgEErr          =0;
+    Double_t tavgAbsM          =0;
+    Double_t tavgAbsMErr       =0;
+    Double_t tC                =0;
+    Double_t tCErr             =0;
+    Double_t tchi              =0;
+    Double_t tchiErr           =0;
+    Double_t tU                =0;
+    Double_t tUErr             =0;
+    Double_t txi               =0;
+    Double_t txiSk             =0;
+    Double_t tdomLargest       =0;
+    Double_t tdomSpan          =0;
+    Double_t tfkLargest        =0;
+    Double_t tfkSpan           =0;
+    Double_t tfkMeanSize       =0;
     TString  tMCMethod         ="METROPOLIS";
 
     outTree->Branch("m",        &tmag);
@@ -75,6 +132,44 @@ void runIsingModel(Double_t HDIM,
 
     outTree->Branch("numSteps", &tnumMCSteps);
     outTree->Branch("MCMethod", &tMCMethod);
+    outTree->Branch("numSweeps",&tnumSweeps);
+    outTree->Branch("numBurnIn",&tnumBurnIn);
+    outTree->Branch("equilibrated",&tequilibrated);
+    outTree->Branch("tauE",     &ttauE);
+    outTree->Branch("tauM",     &ttauM);
+    outTree->Branch("numEff",   &tnumEff);
+    outTree->Branch("acceptance",&tacceptance);
+
+    outTree->Branch("E_avg",    &tavgE);
+    outTree->Branch("E_err",    &tavgEErr);
+    outTree->Branch("absM_avg", &tavgAbsM);
+    outTree->Branch("absM_err", &tavgAbsMErr);
+    outTree->Branch("C",        &tC);
+    outTree->Branch("C_err",    &tCErr);
+    outTree->Branch("chi",      &tchi);
+    outTree->Branch("chi_err",  &tchiErr);
+    outTree->Branch("U",        &tU);
+    outTree->Branch("U_err",    &tUErr);
+    outTree->Branch("xi",       &txi);
+    outTree->Branch("xi_Sk",    &txiSk);
+
+    outTree->Branch("domLargest", &tdomLargest);
+    outTree->Branch("domSpan",    &tdomSpan);
+    outTree->Branch("fkLargest",  &tfkLargest);
+    outTree->Branch("fkSpan",     &tfkSpan);
+    outTree->Branch("fkMeanSize", &tfkMeanSize);
+
+    // Per fractal level, from single hypercubes up to the whole lattice
+    std::vector<Int_t>    tblockLength;
+    std::vector<Double_t> tblockU;
+    std::vector<Double_t> tblockUErr;
+    std::vector<Double_t> tblockR;
+    std::vector<Double_t> tblockRErr;
+    outTree->Branch("blockLength", &tblockLength);
+    outTree->Branch("blockU",      &tblockU);
+    outTree->Branch("blockU_err",  &tblockUErr);
+    outTree->Branch("blockR",      &tblockR);
+    outTree->Branch("blockR_err",  &tblockRErr);
 
     /*
      *  Make the model
@@ -83,6 +178,15 @@ void runIsingModel(Double_t HDIM,
     model.setDebug             (true);
     model.setNumThreads        (NTHREADS);
     model.setNumMCSteps        (NMCSTEPS);
+    model.setTargetEffSamples  (NEFFSAMPLES);
+    model.setCorrelationInterval(CORRINTERVAL);
+    model.setStructureFactorInterval(SKINTERVAL);
+    model.setClusterInterval   (CLUSTERINTERVAL);
+    model.setSiteMapInterval   (SITEMAPINTERVAL);
+    model.setBlockInterval     (BLOCKINTERVAL);
+    if(SWEEPOUTPUT) model.setSweepOutput((TString(name).ReplaceAll(".","-")+".sweeps").Data());
+    model.setSnapshotOutput((TString(name).ReplaceAll(".","-")+".snaps").Data(),SNAPSHOTINTERVAL);
+    model.setOutOfCore         (SCRATCHDIR);
     model.setLatticeDepth      (DEPTH);
     model.setHausdorffDimension(HDIM);
     model.setHausdorffMethod   ("SCALING");
@@ -91,6 +195,29 @@ void runIsingModel(Double_t HDIM,
     model.setTemperature       (KBT);
     model.setCouplingConsts    (COUPLING_H,COUPLING_J); 
 
+    ResultStore store(STOREDIR);
+    unsigned long long configHash = model.getConfigurationHash();
+
+    // The checkpoint name carries the configuration hash, so that a run
+    // with other settings never finds it. It is removed once the results
+    // are written, a finished checkpoint is never reused.
+    std::string checkpointName;
+    if(CHECKPOINTSEC > 0) {
+        char hashText[32];
+        snprintf(hashText,sizeof(hashText),"-%016llx.ckpt",configHash);
+        checkpointName = (TString(name).ReplaceAll(".","-")+hashText).Data();
+        model.setCheckpoint(checkpointName,CHECKPOINTSEC);
+    }
+    ResultRecord cached;
+    if(useStore && store.load(configHash,cached)) {
+        std::cout<<"\t - Found in result store: "<<store.getPath(configHash)<<std::endl;
+        if(toResultFile) {
+            ResultFile::append(OUTFILE,cached);
+            return;
+        }
+        std::cout<<"WARNING: ROOT output needs a fresh run, not using the stored result"<<std::endl;
+    }
+
     /*
      *  Run the model
      */
@@ -121,7 +248,38 @@ void runIsingModel(Double_t HDIM,
     tkbT             = model.getkbT();
     tnumMCSteps      = model.getNumMCSteps();
     tnumSpins        = model.getNumSpins();
+    tnumSweeps       = model.getNumSweeps();
+    tnumBurnIn       = model.getNumBurnInSweeps();
+    tequilibrated    = model.getIsEquilibrated();
+    ttauE            = model.getTauIntEnergy();
+    ttauM            = model.getTauIntMagnetization();
+    tnumEff          = model.getNumEffSamples();
+    tacceptance      = model.getAcceptanceRate();
+    tavgE            = model.getMeanEnergy().value;
+    tavgEErr         = model.getMeanEnergy().error;
+    tavgAbsM         = model.getMeanAbsMagnetization().value;
+    tavgAbsMErr      = model.getMeanAbsMagnetization().error;
+    tC               = model.getSpecificHeat().value;
+    tCErr            = model.getSpecificHeat().error;
+    tchi             = model.getSusceptibility().value;
+    tchiErr          = model.getSusceptibility().error;
+    tU               = model.getBinderCumulant().value;
+    tUErr            = model.getBinderCumulant().error;
+    txi              = model.getCorrelationLength();
+    txiSk            = model.getStructureFactorLength();
+    tdomLargest      = model.getClusterAnalysis().getLargestFraction(ClusterAnalysis::kDomains);
+    tdomSpan         = model.getClusterAnalysis().getSpanningProbability(ClusterAnalysis::kDomains);
+    tfkLargest       = model.getClusterAnalysis().getLargestFraction(ClusterAnalysis::kFKClusters);
+    tfkSpan          = model.getClusterAnalysis().getSpanningProbability(ClusterAnalysis::kFKClusters);
+    tfkMeanSize      = model.getClusterAnalysis().getMeanClusterSize(ClusterAnalysis::kFKClusters);
     tMCMethod        = TString(model.getMCMethod().data());
+    for(int k=0; k < model.getBlockSpins().getNumLevels() && BLOCKINTERVAL > 0; k++) {
+        tblockLength.push_back(model.getBlockSpins().getBlockLength(k));
+        tblockU.push_back(model.getBlockSpins().getBinderCumulant(k).value);
+        tblockUErr.push_back(model.getBlockSpins().getBinderCumulant(k).error);
+        tblockR.push_back(model.getBlockSpins().getCorrelationRatio(k).value);
+        tblockRErr.push_back(model.getBlockSpins().getCorrelationRatio(k).error);
+    }
 
     outTree->Fill();
 
@@ -129,13 +287,232 @@ void runIsingModel(Double_t HDIM,
      *  Write the output 
      */
     std::cout<<"\t - Writing output"<<std::endl;
+    if(toResultFile || useStore) {
+        ResultRecord record("RUN");
+        record.setConfigurationHash(configHash);
+        record.addParameter("hDim",    HDIM);
+        record.addParameter("depth",   DEPTH);
+        record.addParameter("kbT",     KBT);
+        record.addParameter("sigma",   SIGMA);
+        record.addParameter("h",       COUPLING_H);
+        record.addParameter("J",       COUPLING_J);
+        record.addParameter("numSteps",NMCSTEPS);
+        record.addParameter("threads", NTHREADS);
+
+        // Every numeric scalar branch, under its branch name
+        TIter nextBranch(outTree->GetListOfBranches());
+        while(TBranch *branch = (TBranch*) nextBranch()) {
+            TLeaf *leaf = (TLeaf*) branch->GetListOfLeaves()->At(0);
+            if(branch->InheritsFrom("TBranchElement") || !leaf || leaf->GetLen() != 1) continue;
+            record.addValue(branch->GetName(),leaf->GetValue());
+        }
+        record.addArray("blockLength",std::vector<double>(tblockLength.begin(),tblockLength.end()));
+        record.addArray("blockU",     tblockU);
+        record.addArray("blockU_err", tblockUErr);
+        record.addArray("blockR",     tblockR);
+        record.addArray("blockR_err", tblockRErr);
+
+        addGraph(record,"ConvergenceGr",model.getConvergenceGr());
+        addGraph(record,"EquilibrationGr",model.getEquilibrationGr());
+        if(CORRINTERVAL > 0) {
+            addGraph(record,"GraphCorrelationGr",model.getGraphCorrelationGr());
+            addGraph(record,"EuclideanCorrelationGr",model.getEuclideanCorrelationGr());
+        }
+        if(SKINTERVAL > 0) addGraph(record,"StructureFactorGr",model.getStructureFactorGr());
+        if(CLUSTERINTERVAL > 0) {
+            addGraph(record,"DomainSizeGr",model.getClusterSizeGr(ClusterAnalysis::kDomains));
+            addGraph(record,"FKClusterSizeGr",model.getClusterSizeGr(ClusterAnalysis::kFKClusters));
+        }
+        if(SITEMAPINTERVAL > 0) {
+            record.addArray("SiteMaps_coords",model.getSiteCoordinates().toVector());
+            record.addArray("SiteMaps_S_avg", model.getSiteMagnetization());
+            record.addArray("SiteMaps_SS_avg",model.getSiteBondCorrelation());
+        }
+
+        if(useStore) store.store(configHash,record);
+        if(toResultFile) {
+            ResultFile::append(OUTFILE,record);
+            if(!checkpointName.empty()) remove(checkpointName.c_str());
+            return;
+        }
+    }
     outFile->cd();
     TGraph *convGr = (TGraph*) model.getConvergenceGr()->Clone();
     convGr->Write();
+    TGraph *equilGr = model.getEquilibrationGr();
+    equilGr->SetName("EquilibrationGr");
+    equilGr->Write();
+    if(CORRINTERVAL > 0) {
+        TGraph *graphCorrGr = model.getGraphCorrelationGr();
+        graphCorrGr->SetName("GraphCorrelationGr");
+        graphCorrGr->Write();
+        TGraph *euclCorrGr = model.getEuclideanCorrelationGr();
+        euclCorrGr->SetName("EuclideanCorrelationGr");
+        euclCorrGr->Write();
+    }
+    if(SKINTERVAL > 0) {
+        TGraph *skGr = model.getStructureFactorGr();
+        skGr->SetName("StructureFactorGr");
+        skGr->Write();
+    }
+    if(CLUSTERINTERVAL > 0) {
+        TGraph *domSizeGr = model.getClusterSizeGr(ClusterAnalysis::kDomains);
+        domSizeGr->SetName("DomainSizeGr");
+        domSizeGr->Write();
+        TGraph *fkSizeGr = model.getClusterSizeGr(ClusterAnalysis::kFKClusters);
+        fkSizeGr->SetName("FKClusterSizeGr");
+        fkSizeGr->Write();
+    }
     outTree->Write();
+
+    // One entry per site: coordinates and the time-averaged maps
+    if(SITEMAPINTERVAL > 0) {
+        TTree *siteTree = new TTree("SiteMaps","Per-site averages over the measurement phase");
+        std::vector<Double_t> tcoords;
+        Int_t    tactive   =0;
+        Double_t tsiteS    =0;
+        Double_t tsiteSS   =0;
+        siteTree->Branch("coords", &tcoords);
+        siteTree->Branch("active", &tactive);
+        siteTree->Branch("S_avg",  &tsiteS);
+        siteTree->Branch("SS_avg", &tsiteSS);
+
+        ConstView<int>      spins  = model.getSpinArray();
+        ConstView<double>   coords = model.getSiteCoordinates();
+        std::vector<double> siteS  = model.getSiteMagnetization();
+        std::vector<double> siteSS = model.getSiteBondCorrelation();
+        int p = model.getLatticeDimensions().size();
+        for(int i=0; i < model.getNumSpins(); i++) {
+            tcoords.assign(coords.begin()+i*p,coords.begin()+(i+1)*p);
+            tactive = (spins[i] != 0);
+            tsiteS  = siteS.at(i);
+            tsiteSS = siteSS.at(i);
+            siteTree->Fill();
+        }
+        siteTree->Write();
+    }
     outFile->Close();
+    if(!checkpointName.empty()) remove(checkpointName.c_str());
+
+
+
+
+}
+
+
+#if !defined(__CINT__) && !defined(__CLING__) && !defined(__ACLIC__)
+/*
+ *  Standalone executable (make run). Arguments are given in the order of
+ *  the macro, as --name=value (or --name value), or both; options
+ *  override positional arguments.
+ */
+static const int nRunArgs=20;
+static const char* runArgNames[nRunArgs] = {
+    "dim","depth","kbT","sigma","h","J","steps","threads",
+    "neff","corr","sk","clusters","sitemaps","blocks","sweeps",
+    "snapshots","checkpoint","out","scratch","store"};
+static const char* runArgDefaults[nRunArgs] = {
+    "","","","","","","","1",
+    "0","0","0","0","0","0","0",
+    "0","0","","",""};
+
+void printUsage() {
+    std::cout<<"Usage: runIsingModel [options] DIM DEPTH KBT SIGMA H J STEPS [THREADS ...]\n"
+             <<"  --dim        Hausdorff dimension\n"
+             <<"  --depth      lattice depth\n"
+             <<"  --kbT        temperature\n"
+             <<"  --sigma      interaction sigma\n"
+             <<"  --h, --J     coupling constants\n"
+             <<"  --steps      number of MC steps\n"
+             <<"  --threads    number of threads (1)\n"
+             <<"  --neff       run until this many effective samples (0: off)\n"
+             <<"  --corr, --sk, --clusters, --sitemaps, --blocks, --snapshots\n"
+             <<"               measurement intervals in sweeps (0: off)\n"
+             <<"  --sweeps     write per-sweep rows (flag)\n"
+             <<"  --checkpoint checkpoint interval in seconds (0: off)\n"
+             <<"  --out        append to this result file instead of writing ROOT output\n"
+             <<"  --scratch    directory for out-of-core lattice storage\n"
+             <<"  --store      result store directory\n"
+             <<"Positional arguments follow the order of the macro arguments."<<std::endl;
+}
+
+// Numeric argument, exits on anything that is not a number
+double parseNumber(const int k, const std::string& value) {
+    char* end=0;
+    double x=strtod(value.c_str(),&end);
+    if(value.empty() || *end != '\0') {
+        std::cout<<"ERROR: Invalid value '"<<value<<"' for --"<<runArgNames[k]<<std::endl;
+        exit(EXIT_FAILURE);
+    }
+    return x;
+}
+
+int main(int argc, char** argv) {
+    std::vector<std::string> args(runArgDefaults,runArgDefaults+nRunArgs);
+    std::vector<bool> given(nRunArgs,false);
+
+    int nPositional=0;
+    for(int i=1; i < argc; i++) {
+        std::string arg=argv[i];
+        if(arg == "-h" || arg == "--help") {
+            printUsage();
+            return EXIT_SUCCESS;
+        }
 
+        // Positional (negative numbers included)
+        if(arg.compare(0,2,"--") != 0) {
+            if(nPositional == nRunArgs) {
+                std::cout<<"ERROR: Too many arguments"<<std::endl;
+                return EXIT_FAILURE;
+            }
+            args[nPositional]=arg;
+            given[nPositional++]=true;
+            continue;
+        }
 
+        std::string name=arg.substr(2), value;
+        size_t eq=name.find('=');
+        bool hasValue = eq != std::string::npos;
+        if(hasValue) {
+            value=name.substr(eq+1);
+            name=name.substr(0,eq);
+        }
+        int k = std::find(runArgNames,runArgNames+nRunArgs,name) - runArgNames;
+        if(k == nRunArgs) {
+            std::cout<<"ERROR: Unknown option "<<arg<<std::endl;
+            printUsage();
+            return EXIT_FAILURE;
+        }
+        if(!hasValue && name == "sweeps") {
+            value="1";
+        } else if(!hasValue) {
+            if(i+1 == argc) {
+                std::cout<<"ERROR: Missing value for "<<arg<<std::endl;
+                return EXIT_FAILURE;
+            }
+            value=argv[++i];
+        }
+        args[k]=value;
+        given[k]=true;
+    }
 
+    for(int k=0; k < 7; k++) {
+        if(given[k]) continue;
+        std::cout<<"ERROR: --"<<runArgNames[k]<<" is required"<<std::endl;
+        printUsage();
+        return EXIT_FAILURE;
+    }
 
+    runIsingModel(parseNumber(0,args[0]), (int) parseNumber(1,args[1]),
+                  parseNumber(2,args[2]), parseNumber(3,args[3]),
+                  parseNumber(4,args[4]), parseNumber(5,args[5]),
+                  (int) parseNumber(6,args[6]), (int) parseNumber(7,args[7]),
+                  (int) parseNumber(8,args[8]), (int) parseNumber(9,args[9]),
+                  (int) parseNumber(10,args[10]), (int) parseNumber(11,args[11]),
+                  (int) parseNumber(12,args[12]), (int) parseNumber(13,args[13]),
+                  parseNumber(14,args[14]) != 0, (int) parseNumber(15,args[15]),
+                  parseNumber(16,args[16]), args[17].c_str(),
+                  args[18].c_str(), args[19].c_str());
+    return EXIT_SUCCESS;
 }
+#endif
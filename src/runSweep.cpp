@@ -0,0 +1,163 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * runSweep.cpp                                                                *
+ *                                                                             *
+ * Run a whole parameter grid in one process (see interface/SweepEngine.h):   *
+ *                                                                             *
+ *   runSweep --out FILE --dim LIST --depth LIST --kbT LIST --sigma LIST       *
+ *            --h LIST --J LIST --steps LIST [options]                         *
+ *                                                                             *
+ * A LIST is "a,b,c" or "first:last:step". The lists take the place of the    *
+ * SubmitCondor.py options (--dimList etc.), one result file replaces the     *
+ * per-job outputs.                                                            *
+ *                                                                             *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+#include "interface/SweepEngine.h"
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+
+void printUsage() {
+    std::cout<<"Usage: runSweep --out FILE --dim LIST --depth LIST --kbT LIST --sigma LIST\n"
+             <<"                --h LIST --J LIST --steps LIST [options]\n"
+             <<"  LIST         a,b,c or first:last:step\n"
+             <<"  --threads    worker threads (all cores)\n"
+             <<"  --out        result file, one record per point\n"
+             <<"  --store      result store directory, stored points are not rerun\n"
+             <<"  --manifest   file with the state of every point; a restart with the\n"
+             <<"               same manifest runs only the points not done\n"
+             <<"  --checkpoint checkpoint interval in seconds (0: off), failed points\n"
+             <<"               continue from <manifest>.ckpt/ on a restart\n"
+             <<"  --neff       run until this many effective samples (0: off)\n"
+             <<"  --corr, --sk, --clusters, --blocks\n"
+             <<"               measurement intervals in sweeps (0: off)\n"
+             <<"  --scratch    directory for out-of-core lattice storage\n"
+             <<"  --refine     axis (kbT, h, J, sigma or dim) to refine near the peaks\n"
+             <<"               of chi, C and the Binder slope\n"
+             <<"  --resolution spacing the refinement stops at (default: 1% of the\n"
+             <<"               axis range)\n"
+             <<"  --stages     maximum number of refinement stages (10)\n"
+             <<"  --cold       start every point from random spins, not from the\n"
+             <<"               previous point on the same lattice\n"
+             <<"  --costModel  perBond,perSpin seconds for the cost estimates\n"
+             <<"  --calibrate  measure the cost model on this machine and print it"<<std::endl;
+}
+
+int main(int argc, char** argv) {
+    SweepEngine engine;
+    engine.setNumThreads(std::max(1u,std::thread::hardware_concurrency()));
+    std::string outFile;
+
+    // Grid axes by option name
+    const char* axes[][2] = {
+        {"dim","hDim"}, {"depth","depth"}, {"kbT","kbT"}, {"sigma","sigma"},
+        {"h","h"}, {"J","J"}, {"steps","numSteps"}};
+    std::vector<bool> given(7,false);
+    std::vector<std::string> lists(7);
+    bool calibrate=false;
+    std::string refineName;
+    double resolution=0;
+    int    maxStages=10;
+
+    for(int i=1; i < argc; i++) {
+        std::string arg=argv[i];
+        if(arg == "-h" || arg == "--help") {
+            printUsage();
+            return EXIT_SUCCESS;
+        }
+        if(arg == "--calibrate") {
+            calibrate=true;
+            continue;
+        }
+        if(arg == "--cold") {
+            engine.setWarmStart(false);
+            continue;
+        }
+        std::string name = arg.compare(0,2,"--") == 0 ? arg.substr(2) : "";
+        std::string value;
+        size_t eq=name.find('=');
+        if(eq != std::string::npos) {
+            value=name.substr(eq+1);
+            name=name.substr(0,eq);
+        } else if(!name.empty() && i+1 < argc) {
+            value=argv[++i];
+        } else {
+            std::cout<<"ERROR: Expected --option value, got "<<arg<<std::endl;
+            printUsage();
+            return EXIT_FAILURE;
+        }
+
+        bool known=false;
+        for(int a=0; a < 7; a++) {
+            if(name != axes[a][0]) continue;
+            engine.setList(axes[a][1],SweepEngine::parseList(value));
+            given[a]=true;
+            lists[a]=value;
+            known=true;
+        }
+        if(known) continue;
+        if(name == "threads")        engine.setNumThreads(atoi(value.c_str()));
+        else if(name == "out")       outFile=value;
+        else if(name == "store")     engine.setStoreDirectory(value);
+        else if(name == "manifest")  engine.setManifest(value);
+        else if(name == "checkpoint")engine.setCheckpointInterval(atof(value.c_str()));
+        else if(name == "neff")      engine.setTargetEffSamples(atoi(value.c_str()));
+        else if(name == "corr")      engine.setCorrelationInterval(atoi(value.c_str()));
+        else if(name == "sk")        engine.setStructureFactorInterval(atoi(value.c_str()));
+        else if(name == "clusters")  engine.setClusterInterval(atoi(value.c_str()));
+        else if(name == "blocks")    engine.setBlockInterval(atoi(value.c_str()));
+        else if(name == "scratch")   engine.setScratchDirectory(value);
+        else if(name == "refine")    refineName=value;
+        else if(name == "resolution")resolution=atof(value.c_str());
+        else if(name == "stages")    maxStages=atoi(value.c_str());
+        else if(name == "costModel") {
+            std::vector<double> c=SweepEngine::parseList(value);
+            if(c.size() != 2) {
+                std::cout<<"ERROR: --costModel expects perBond,perSpin"<<std::endl;
+                return EXIT_FAILURE;
+            }
+            engine.setCostModel(c[0],c[1]);
+        }
+        else {
+            std::cout<<"ERROR: Unknown option --"<<name<<std::endl;
+            printUsage();
+            return EXIT_FAILURE;
+        }
+    }
+
+    if(calibrate) {
+        engine.calibrateCost();
+        std::cout<<"--costModel "<<engine.getCostPerBond()<<","
+                 <<engine.getCostPerSpin()<<std::endl;
+        return EXIT_SUCCESS;
+    }
+
+    for(int a=0; a < 7; a++) {
+        if(given[a]) continue;
+        std::cout<<"ERROR: --"<<axes[a][0]<<" is required"<<std::endl;
+        printUsage();
+        return EXIT_FAILURE;
+    }
+    if(outFile.empty()) {
+        std::cout<<"ERROR: --out is required"<<std::endl;
+        return EXIT_FAILURE;
+    }
+    for(int a=0; a < 7 && !refineName.empty(); a++) {
+        if(refineName != axes[a][0]) continue;
+        std::vector<double> values=SweepEngine::parseList(lists[a]);
+        if(resolution <= 0) {
+            resolution = 0.01*(*std::max_element(values.begin(),values.end())
+                              -*std::min_element(values.begin(),values.end()));
+        }
+        engine.setRefinement(axes[a][1],resolution,maxStages);
+        refineName.clear();
+    }
+    if(!refineName.empty()) {
+        std::cout<<"ERROR: Unknown --refine axis "<<refineName<<std::endl;
+        return EXIT_FAILURE;
+    }
+
+    engine.setOutput(outFile);
+    engine.run();
+    return EXIT_SUCCESS;
+}
@@ -1,8 +1,21 @@
-#include "IsingModel.cpp"
+// The model comes from libIsingModel (make lib), which Cling loads
+// instead of interpreting the sources; executables link the objects
+#if defined(__CLING__) && !defined(__ACLIC__)
+R__LOAD_LIBRARY(libIsingModel)
+#endif
+#include "interface/IsingModel.h"
+#include "interface/ResultFile.h"
+#include "interface/SweepEngine.h"
 #include "TFile.h"
 #include "TCanvas.h"
 #include "TGraph.h"
 #include "TMultiGraph.h"
+#include <chrono>
+#include <fstream>
+#include <numeric>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
     
 
 std::clock_t start = std::clock();
@@ -20,6 +33,370 @@ bool niceAssert(TString statement, bool isTrue) {
     return isTrue;
 }
 
+// Checks of the analysis modules on series with known answers
+void testAnalysis() {
+    std::cout<<"\n\n***********************************************"<<std::endl;
+    std::cout<<"* Checking the analysis modules               *"<<std::endl;
+    std::cout<<"***********************************************"<<std::endl;
+    RandomGenerator rng(4357);
+
+    // Jackknife: 100 samples stay in single-sample bins, so the error of
+    // <x> is the standard error and that of <x^2>-<x>^2 can be computed
+    // by leaving out each sample in turn
+    BinningAnalysis binning(2,64);
+    std::vector<double> xs;
+    for(int i=0; i < 100; i++) {
+        double x=rng.Uniform();
+        xs.push_back(x);
+        binning.add({x,x*x});
+    }
+    int n=xs.size();
+    double mean=0, varSum=0;
+    for(int i=0; i < n; i++) mean += xs[i]/n;
+    for(int i=0; i < n; i++) varSum += pow(xs[i]-mean,2);
+    Estimate jkMean=binning.getJackknife([](const std::vector<double>& m) {return m[0];});
+    niceAssert("Jackknife error of <x> is the standard error",
+               fabs(jkMean.error - sqrt(varSum/(n*(n-1.)))) < 1e-12);
+
+    std::vector<double> leaveOut(n);
+    double leaveOutMean=0, leaveOutVar=0;
+    for(int i=0; i < n; i++) {
+        double s1=0, s2=0;
+        for(int j=0; j < n; j++) {
+            if(j == i) continue;
+            s1 += xs[j];
+            s2 += xs[j]*xs[j];
+        }
+        leaveOut[i] = s2/(n-1) - pow(s1/(n-1),2);
+        leaveOutMean += leaveOut[i]/n;
+    }
+    for(int i=0; i < n; i++) leaveOutVar += pow(leaveOut[i]-leaveOutMean,2);
+    Estimate jkVar=binning.getJackknife([](const std::vector<double>& m) {
+        return m[1]-m[0]*m[0];
+    });
+    niceAssert("Jackknife error of <x^2>-<x>^2 matches a direct calculation",
+               fabs(jkVar.error - sqrt((n-1.)/n*leaveOutVar)) < 1e-12);
+
+    // AR(1) series x_t = phi x_{t-1} + noise: tau_int = (1+phi)/(2(1-phi))
+    double phi=0.8;
+    double tauExact=(1+phi)/(2*(1-phi));
+    AutocorrelationEstimator autocorr;
+    double x=0;
+    for(int t=0; t < (1<<18); t++) {
+        x = phi*x + (rng.Uniform()-0.5);
+        autocorr.add(x);
+    }
+    std::cout<<"\t\t- AR(1) tau_int: "<<autocorr.getTauInt()
+             <<" (exact "<<tauExact<<")"<<std::endl;
+    niceAssert("tau_int of an AR(1) series is within 5% of (1+phi)/(2(1-phi))",
+               fabs(autocorr.getTauInt()/tauExact - 1) < 0.05);
+
+    // MSER: an offset on the first 200 samples is cut off, together with
+    // at most a few batches of the stationary part
+    EquilibrationDetector detector;
+    for(int t=0; t < 1000; t++) detector.add((t < 200 ? 5 : 0) + rng.Uniform()-0.5);
+    bool equilibrated=detector.isEquilibrated();
+    int truncation=detector.getTruncationPoint();
+    std::cout<<"\t\t- MSER truncation: "<<truncation<<" (offset ends at 200)"<<std::endl;
+    niceAssert("MSER removes an injected offset",
+               equilibrated && truncation >= 200 && truncation <= 250);
+}
+
+// The energy observable has the sign of the Hamiltonian: a cold lattice
+// with all spins aligned and J > 0 keeps E = beta*H < 0
+void testEnergy() {
+    std::cout<<"\n\n***********************************************"<<std::endl;
+    std::cout<<"* Checking the sign of the energy             *"<<std::endl;
+    std::cout<<"***********************************************"<<std::endl;
+    IsingModel model;
+    model.setNumMCSteps        (200);
+    model.setLatticeDepth      (2);
+    model.setHausdorffDimension(2);
+    model.setHausdorffMethod   ("SCALING");
+    model.setMCMethod          ("METROPOLIS");
+    model.setInteractionSigma  (0);
+    model.setTemperature       (0.01);
+    model.setCouplingConsts    (0,1);
+    model.setup();
+    model.setAllSpins(1);
+    model.runMonteCarlo();
+    double energy=model.getMeanEnergy().value;
+    std::cout<<"\t\t- E_avg: "<<energy<<", beta*H: "<<model.getEffHamiltonian()<<std::endl;
+    niceAssert("An aligned lattice with J > 0 has E_avg < 0",
+               energy < 0 && fabs(energy-model.getEffHamiltonian()) < 1e-9*fabs(energy));
+}
+
+// Open L x L square lattice in the layout of IsingModel: site x*L+y,
+// neighbour lists in CSR form, and the embedding on a 2L x 2L grid
+struct TestLattice {
+    int L, nSites;
+    std::vector<int> offsets, indices, active, embedded, padded;
+    std::vector<double> weights, coords;
+    GridFFT fft;
+
+    TestLattice(const int size) : L(size), nSites(size*size) {
+        offsets.push_back(0);
+        for(int x=0; x < L; x++) {
+            for(int y=0; y < L; y++) {
+                if(x > 0)   indices.push_back((x-1)*L+y);
+                if(x < L-1) indices.push_back((x+1)*L+y);
+                if(y > 0)   indices.push_back(x*L+y-1);
+                if(y < L-1) indices.push_back(x*L+y+1);
+                offsets.push_back(indices.size());
+                coords.push_back(x);
+                coords.push_back(y);
+                embedded.push_back(x*2*L+y);
+            }
+        }
+        weights.assign(indices.size(),1);
+        active.assign(nSites,1);
+        padded.assign(2,2*L);
+        fft.setDimensions(padded);
+    }
+
+    // Forward transform of the embedded spin field
+    std::vector<std::complex<double> > getSpectrum(const std::vector<int>& spins) {
+        std::vector<std::complex<double> > field(fft.getSize(),0);
+        for(int i=0; i < nSites; i++) field[embedded[i]] = spins[i];
+        fft.forward(field);
+        return field;
+    }
+};
+
+// Checks of the lattice measurements on configurations with known answers
+void testLatticeModules() {
+    std::cout<<"\n\n***********************************************"<<std::endl;
+    std::cout<<"* Checking the lattice measurements           *"<<std::endl;
+    std::cout<<"***********************************************"<<std::endl;
+    TestLattice lattice(4);
+    std::vector<int> allUp(lattice.nSites,1);
+
+    // All spins up: <S_i S_j> = 1 at every distance
+    SpinCorrelation correlation;
+    correlation.setup(lattice.padded,lattice.embedded,lattice.active,
+                      lattice.offsets,lattice.indices,&lattice.fft);
+    correlation.accumulate(allUp,lattice.getSpectrum(allUp));
+    std::vector<double> graphG=correlation.getGraphCorrelation();
+    std::vector<double> r, euclideanG;
+    correlation.getEuclideanCorrelation(r,euclideanG);
+    bool allOne = !graphG.empty() && !euclideanG.empty();
+    for(size_t d=0; d < graphG.size(); d++) allOne = allOne && fabs(graphG[d]-1) < 1e-9;
+    for(size_t c=0; c < euclideanG.size(); c++) allOne = allOne && fabs(euclideanG[c]-1) < 1e-9;
+    niceAssert("G(r) = 1 at every distance on an all-up lattice",allOne);
+
+    // Checkerboard: all weight at k = (pi,pi), where S(k) = N
+    std::vector<int> checkerboard(lattice.nSites);
+    for(int i=0; i < lattice.nSites; i++) checkerboard[i] = (i/lattice.L + i%lattice.L) % 2 ? -1 : 1;
+    StructureFactor structureFactor;
+    structureFactor.addWaveVector({M_PI,M_PI});
+    structureFactor.addWaveVector({M_PI,0});
+    structureFactor.addWaveVector({0,0});
+    structureFactor.setup(lattice.padded,std::vector<int>(2,lattice.L),
+                          lattice.coords,lattice.active);
+    structureFactor.accumulate(checkerboard,lattice.getSpectrum(checkerboard));
+    std::vector<double> k, S;
+    structureFactor.getRadialAverage(k,S);
+    int peak = std::max_element(S.begin(),S.end()) - S.begin();
+    std::cout<<"\t\t- S(k) peaks at |k| = "<<k.at(peak)<<" with "<<S.at(peak)<<std::endl;
+    niceAssert("S(k) of a checkerboard peaks at k = (pi,pi)",
+               fabs(k.at(peak) - sqrt(2.)*M_PI) < 1e-9
+               && fabs(structureFactor.getSelected(0) - lattice.nSites) < 1e-9
+               && structureFactor.getSelected(1) < 1e-9
+               && structureFactor.getSelected(2) < 1e-9);
+
+    // All spins aligned: one domain of all N sites, and with a strong
+    // coupling every FK bond is occupied as well
+    ClusterAnalysis clusters;
+    clusters.setup(std::vector<int>(2,lattice.L),lattice.offsets,lattice.indices,
+                   lattice.weights,lattice.active);
+    clusters.setSeed(4357);
+    clusters.accumulate(allUp,100);
+    bool oneCluster=true;
+    for(int type=0; type < ClusterAnalysis::kNumTypes; type++) {
+        std::vector<double> sizes=clusters.getSizeDistribution(type);
+        oneCluster = oneCluster && clusters.getLargestFraction(type) == 1
+                     && fabs(clusters.getMeanClusterSize(type) - lattice.nSites) < 1e-9
+                     && (int) sizes.size() > lattice.nSites && sizes[lattice.nSites] == 1
+                     && std::accumulate(sizes.begin(),sizes.end(),0.) == 1;
+    }
+    niceAssert("An aligned lattice is one cluster of size N",oneCluster);
+}
+
+// Settings of the checkpoint test
+void configureCheckpointTest(IsingModel& model) {
+    model.setNumMCSteps        (1000);
+    model.setLatticeDepth      (3);
+    model.setHausdorffDimension(2);
+    model.setHausdorffMethod   ("SCALING");
+    model.setMCMethod          ("METROPOLIS");
+    model.setInteractionSigma  (0);
+    model.setTemperature       (2.5);
+    model.setCouplingConsts    (0,1);
+    model.setSeed              (12345);
+}
+
+// A run killed after a checkpoint and resumed from it ends exactly like
+// one that was never interrupted. The run to kill goes in a child process.
+void testCheckpoint() {
+    std::cout<<"\n\n***********************************************"<<std::endl;
+    std::cout<<"* Checking checkpoint and resume              *"<<std::endl;
+    std::cout<<"***********************************************"<<std::endl;
+    const std::string fileName="IsingModel_TestCheckpoint.ckpt";
+    remove(fileName.c_str());
+
+    IsingModel reference;
+    configureCheckpointTest(reference);
+    reference.setup();
+    reference.randomizeSpins();
+    std::chrono::steady_clock::time_point begin=std::chrono::steady_clock::now();
+    reference.runMonteCarlo();
+    double seconds=std::chrono::duration<double>(std::chrono::steady_clock::now()-begin).count();
+
+    pid_t child=fork();
+    if(child == 0) {
+        IsingModel model;
+        configureCheckpointTest(model);
+        model.setCheckpoint(fileName,0.01);
+        model.setup();
+        model.randomizeSpins();
+        model.runMonteCarlo();
+        _exit(EXIT_SUCCESS);
+    }
+
+    // Kill the run halfway through, after its first checkpoint
+    int status=0;
+    pid_t finished=0;
+    while(access(fileName.c_str(),F_OK) != 0
+          && (finished=waitpid(child,&status,WNOHANG)) == 0) usleep(1000);
+    if(finished == 0) {
+        usleep(1e6*seconds/2);
+        kill(child,SIGKILL);
+        waitpid(child,&status,0);
+    }
+    bool interrupted = WIFSIGNALED(status);
+    std::cout<<"\t\t- Run "<<(interrupted ? "killed" : "not killed")
+             <<" (halfway is at "<<seconds/2<<" s)"<<std::endl;
+
+    // Started from other spins, the run only ends like the reference if
+    // it really continues from the checkpoint
+    IsingModel resumed;
+    configureCheckpointTest(resumed);
+    resumed.setCheckpoint(fileName,0);
+    resumed.setup();
+    resumed.setAllSpins(1);
+    resumed.runMonteCarlo();
+    remove(fileName.c_str());
+
+    niceAssert("A killed run resumes from its checkpoint to the same result",
+               interrupted
+               && resumed.getConfigurationHash() == reference.getConfigurationHash()
+               && resumed.getNumSweeps()         == reference.getNumSweeps()
+               && resumed.getNumBurnInSweeps()   == reference.getNumBurnInSweeps()
+               && resumed.getEffHamiltonian()    == reference.getEffHamiltonian()
+               && resumed.getMagnetization()     == reference.getMagnetization()
+               && resumed.getMeanEnergy().value  == reference.getMeanEnergy().value
+               && resumed.getMeanEnergy().error  == reference.getMeanEnergy().error
+               && resumed.getSusceptibility().value == reference.getSusceptibility().value);
+}
+
+// Restarts of a sweep: a point left running is read as failed, and a
+// sweep run again with its manifest only runs the points not done
+void testManifest() {
+    std::cout<<"\n\n***********************************************"<<std::endl;
+    std::cout<<"* Checking the sweep manifest                 *"<<std::endl;
+    std::cout<<"***********************************************"<<std::endl;
+    const std::string manifestName="IsingModel_TestSweep.manifest";
+    const std::string outName="IsingModel_TestSweep.res";
+    remove(manifestName.c_str());
+    remove(outName.c_str());
+    remove((outName+".idx").c_str());
+
+    std::ofstream lines(manifestName.c_str());
+    lines<<"# hash state index hDim depth kbT sigma h J numSteps start location\n"
+         <<"00000000000000aa running 0 2 2 1 0 0 1 100 0000000000000000\n"
+         <<"00000000000000bb done 1 2 2 2 0 0 1 100 0000000000000000 "<<outName<<"\n";
+    lines.close();
+    SweepManifest manifest(manifestName);
+    niceAssert("The manifest reads a point left running as failed",
+               manifest.read() && manifest.getState(0xaa) == SweepManifest::kFailed
+               && manifest.getState(0xbb) == SweepManifest::kDone);
+    remove(manifestName.c_str());
+
+    SweepEngine engine;
+    engine.setVerbose   (false);
+    engine.setNumThreads(1);
+    engine.setOutput    (outName);
+    engine.setManifest  (manifestName);
+    engine.setList("hDim",    {2});
+    engine.setList("depth",   {2});
+    engine.setList("kbT",     {1,2});
+    engine.setList("sigma",   {0});
+    engine.setList("h",       {0});
+    engine.setList("J",       {1});
+    engine.setList("numSteps",{100});
+    long nFirst=engine.run();
+    engine.setList("kbT",     {1,2,3});
+    long nSecond=engine.run();
+    ResultFile file;
+    file.open(outName);
+    std::vector<long> added=file.select("kbT",3,3);
+    niceAssert("A restarted sweep runs only the points not done",
+               nFirst == 2 && nSecond == 1 && file.getNumRecords() == 3 && added.size() == 1);
+
+    remove(manifestName.c_str());
+    remove(outName.c_str());
+    remove((outName+".idx").c_str());
+}
+
+// Round trip of the result file: appending, merging with a duplicate
+// configuration, and selecting by a parameter
+void testResultFile() {
+    std::cout<<"\n\n***********************************************"<<std::endl;
+    std::cout<<"* Checking the result files                   *"<<std::endl;
+    std::cout<<"***********************************************"<<std::endl;
+    const std::string names[3] = {"IsingModel_TestA.res","IsingModel_TestB.res",
+                                  "IsingModel_TestMerged.res"};
+    for(int i=0; i < 3; i++) {
+        remove(names[i].c_str());
+        remove((names[i]+".idx").c_str());
+        remove((names[i]+".par").c_str());
+    }
+
+    // The second file repeats the configuration at kbT=2 with a new value
+    const double kbTs[4] = {1,2,3,2};
+    for(int i=0; i < 4; i++) {
+        ResultRecord record("RUN");
+        record.setConfigurationHash(i < 3 ? i+1 : 2);
+        record.addParameter("kbT",kbTs[i]);
+        record.addValue("energy",i < 3 ? -kbTs[i] : -20);
+        ResultFile::append(names[i < 3 ? 0 : 1],record);
+    }
+
+    ResultFile file;
+    ResultRecord record;
+    file.open(names[0]);
+    niceAssert("Appended records are read back in order",
+               file.getNumRecords() == 3 && file.read(1,record)
+               && record.getConfigurationHash() == 2 && record.getValue("energy") == -2);
+
+    std::vector<std::string> inputs(names,names+2);
+    long nMerged=ResultFile::merge(inputs,names[2]);
+    file.open(names[2]);
+    std::vector<long> selected=file.select("kbT",1.5,2.5);
+    niceAssert("Merging keeps the last record of a duplicate configuration",
+               nMerged == 3 && file.getNumRecords() == 3 && selected.size() == 1
+               && file.read(selected[0],record) && record.getValue("energy") == -20);
+    niceAssert("Selection by kbT returns the records in range",
+               file.select("kbT",1.5,10).size() == 2 && file.select("kbT",4,10).empty());
+
+    for(int i=0; i < 3; i++) {
+        remove(names[i].c_str());
+        remove((names[i]+".idx").c_str());
+        remove((names[i]+".par").c_str());
+    }
+}
+
+
 void testIsingModel() {
     std::cout<<"***********************************************"<<std::endl;
     std::cout<<"* HausdorffIsingModel: TEST                   *"<<std::endl;
@@ -29,8 +406,25 @@ void testIsingModel() {
     std::cout<<"*       - 4D lattice has correct form         *"<<std::endl;
     std::cout<<"*       - Heat bath algorithm converges       *"<<std::endl;
     std::cout<<"*         (faster than Metropolis algorithm)  *"<<std::endl;
+    std::cout<<"*       - Jackknife, tau_int and MSER give    *"<<std::endl;
+    std::cout<<"*         known answers                       *"<<std::endl;
+    std::cout<<"*       - Aligned lattice has negative energy *"<<std::endl;
+    std::cout<<"*       - G(r), S(k) and clusters of known    *"<<std::endl;
+    std::cout<<"*         configurations                      *"<<std::endl;
+    std::cout<<"*       - Killed run resumes from checkpoint  *"<<std::endl;
+    std::cout<<"*       - Restarted sweep runs only the       *"<<std::endl;
+    std::cout<<"*         points not done                     *"<<std::endl;
+    std::cout<<"*       - Result files append, merge and      *"<<std::endl;
+    std::cout<<"*         select records                      *"<<std::endl;
     std::cout<<"***********************************************"<<std::endl;
 
+    testAnalysis();
+    testEnergy();
+    testLatticeModules();
+    testCheckpoint();
+    testManifest();
+    testResultFile();
+
     // Declare initial model, output files
     IsingModel model;
     TFile *fOut = new TFile("IsingModel_TestOutput.root","RECREATE");
@@ -201,3 +595,12 @@ void testIsingModel() {
     fOut->Close();
 
 }
+
+
+#if !defined(__CINT__) && !defined(__CLING__) && !defined(__ACLIC__)
+// Standalone executable (make test)
+int main() {
+    testIsingModel();
+    return EXIT_SUCCESS;
+}
+#endif
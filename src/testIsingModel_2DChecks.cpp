@@ -1,4 +1,9 @@
-#include "IsingModel.cpp"
+// The model comes from libIsingModel (make lib), which Cling loads
+// instead of interpreting the sources; executables link the objects
+#if defined(__CLING__) && !defined(__ACLIC__)
+R__LOAD_LIBRARY(libIsingModel)
+#endif
+#include "interface/IsingModel.h"
 #include "TFile.h"
 #include "TCanvas.h"
 #include "TGraph2D.h"
@@ -12,6 +12,8 @@ if [[ "$1" == "" ]] ; then
     echo "* - MAKE                                *"
     echo "* - TEST                                *"
     echo "* - JOBS                                *"
+    echo "* - LOCAL                               *"
+    echo "* - SWEEP                               *"
     echo "* - GIF                                 *"
     echo "* - RUN                                 *"
     echo "* - WWW                                 *"
@@ -47,7 +49,6 @@ MAKE )
 echo "Compiling simulation code:"
 
 make
-make test
 
 ;;
 
@@ -81,7 +82,8 @@ let arrSize*=depListSize
 let arrSize*=mcStepsListSize
 echo $arrSize
 
-cp -r src/ /eos/uscms/store/user/ecoleman/HausdorffIsingModel/
+make run
+cp runIsingModel /eos/uscms/store/user/ecoleman/HausdorffIsingModel/
 
 i=0
 step=10
@@ -111,6 +113,49 @@ done
 
 ;;
 
+#################################### LOCAL ####################################
+LOCAL )
+echo "Running the grid jobs on this machine:"
+
+make run
+
+python scripts/SubmitCondor.py \
+    --local \
+    --indir ${PWD} \
+    --outdir ${PWD}/output/ \
+    --hList ${hList} \
+    --jList ${jList} \
+    --tList ${tList} \
+    --sigList ${sigList} \
+    --mcStepsList $mcStepsList \
+    --dimList $dimList \
+    --depthList ${depList} \
+    --min 0 --max ${2:-1000000000}
+
+# Throttled by cores and memory instead of condor_q polling
+python scripts/RunLocal.py --jobdir ${PWD}/output/stdout/
+
+;;
+
+#################################### SWEEP ####################################
+SWEEP )
+echo "Running the whole grid on this node:"
+
+mkdir -p output
+./runSweep --out output/sweep.dat \
+    --h ${hList} \
+    --J ${jList} \
+    --kbT ${tList} \
+    --sigma ${sigList} \
+    --steps ${mcStepsList} \
+    --dim ${dimList} \
+    --depth ${depList} \
+    --store output/store \
+    --manifest output/sweep.manifest \
+    --checkpoint 600 ${@:2}
+
+;;
+
 #################################### GIF  #####################################
 GIF )
 echo "Making GIF animations:"
@@ -121,9 +166,9 @@ sh scripts/plotsToGIF.sh
 
 #################################### RUN  #####################################
 RUN )
-echo "Running simulation for configuration $2 $3 $4 $5 $6 $7 $8:"
+echo "Running simulation for configuration ${@:2}:"
 
-runIsingModel $2 $3 $4 $5 $6 $7 $8
+./runIsingModel ${@:2}
 
 ;;
 